@@ -0,0 +1,408 @@
+// superfreq_bench
+//
+// Cycle-accurate firmware benchmark for superfreq using the simavr AVR simulator.
+//
+// The compiled sketch is run on a simulated 16MHz ATmega328P.  A square wave is driven
+// into D2 and the benchmark marker pins from bench.h (A0..A3) and the display's SDA and
+// SCL pins are watched.  Every measurement is in CPU cycles, which do not depend on the
+// speed of the host, so results from different commits can be compared directly.
+//
+// Measurements:
+//   isr_latency     cycles from a stimulus edge to the edge ISR marker going high
+//   isr_duration    cycles the edge ISR marker is high
+//   compute         cycles the loop computation marker is high
+//   display         cycles the loop display marker is high
+//   loop_update     cycles for a whole display update cycle of loop()
+//   i2c_bit         cycles between SCL rising edges inside a transaction
+//   i2c_transaction cycles from I2C start to stop
+//   i2c_bytes       bytes per I2C transaction
+//   max_edge_rate   highest stimulus frequency at which every edge ran the ISR
+//   glyph_text      cycles per glyph of text in landscape and portrait
+//   glyph_text2x    cycles per glyph of 2x text in landscape and portrait
+//
+// The glyph measurements are made by the firmware itself at startup and printed on the
+// serial port, see benchGlyphs in bench.h.  Serial lines that start with "#bench " are
+// passed through to the results and the rest of the serial output is dropped.
+//
+// A VCD trace of the stimulus, marker, SDA and SCL pins is written for viewing in
+// GTKWave.
+//
+// usage: superfreq_bench [-f hz] [-d duty%] [-t ms] [-o trace.vcd] [-s] firmware.elf
+//   -f   stimulus frequency, default 1000
+//   -d   stimulus duty cycle, default 50
+//   -t   simulated run time after startup, default 2500
+//   -o   VCD output file, default superfreq_bench.vcd
+//   -s   also sweep the stimulus frequency to find max_edge_rate
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_irq.h"
+#include "sim_cycle_timers.h"
+#include "sim_vcd_file.h"
+#include "avr_ioport.h"
+#include "avr_uart.h"
+
+enum {
+    CPU_HZ = 16000000,
+    STARTUP_MS = 200,           // setup(), display initialization and first samples
+    SWEEP_MS = 50,
+    SERIAL_LINE = 128
+};
+
+// Marker pins on PORTC, matching bench.h
+enum {
+    MARK_ISR,
+    MARK_COMPUTE,
+    MARK_DISPLAY,
+    MARK_LOOP,
+    NUM_MARKERS,
+    PIN_SDA = 4,
+    PIN_SCL = 5
+};
+
+static const char * markerNames[NUM_MARKERS] = { "isr_duration", "compute", "display", "loop_update" };
+
+
+// Running min/mean/max of a cycle count
+typedef struct {
+    const char * name;
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+} stat_t;
+
+static void statAdd(stat_t * s, uint64_t v) {
+    if ((s->count == 0) || (v < s->min))  s->min = v;
+    if (v > s->max)  s->max = v;
+    s->sum += v;
+    s->count++;
+}
+
+static void statPrint(const stat_t * s) {
+    if (s->count == 0) {
+        printf("%-16s n=0\n", s->name);
+        return;
+    }
+    printf("%-16s n=%-6llu min=%-8llu mean=%-10.1f max=%llu\n", s->name,
+           (unsigned long long)s->count, (unsigned long long)s->min,
+           (double)s->sum / s->count, (unsigned long long)s->max);
+}
+
+
+typedef struct bench_t bench_t;
+
+// Pin change callbacks get the pin number through one of these
+typedef struct {
+    bench_t * bench;
+    int pin;
+} watch_t;
+
+struct bench_t {
+    avr_t * avr;
+    avr_irq_t * stimulus;
+    avr_cycle_count_t highCycles;
+    avr_cycle_count_t lowCycles;
+    uint8_t level;
+    avr_cycle_count_t measureStart;
+
+    // Stimulus edges waiting for the ISR marker
+    avr_cycle_count_t pendingEdge;
+    int fPending;
+    uint64_t stimulusEdges;
+    uint64_t isrRuns;
+
+    avr_cycle_count_t markerRise[NUM_MARKERS];
+    stat_t latency;
+    stat_t markers[NUM_MARKERS];
+
+    // I2C decoding
+    uint8_t sda;
+    uint8_t scl;
+    int fInTransaction;
+    avr_cycle_count_t transactionStart;
+    avr_cycle_count_t lastSclRise;
+    uint32_t sclRises;
+    stat_t i2cBit;
+    stat_t i2cTransaction;
+    stat_t i2cBytes;
+
+    watch_t watches[NUM_MARKERS + 2];
+
+    // Serial output, a line at a time
+    char line[SERIAL_LINE];
+    int lineLength;
+    char results[8][SERIAL_LINE];
+    int nResults;
+};
+
+
+static int measuring(bench_t * b) {
+    return b->avr->cycle >= b->measureStart;
+}
+
+
+// Stimulus square wave, driven by a cycle timer that reschedules itself on every edge
+static avr_cycle_count_t stimulusEdge(avr_t * avr, avr_cycle_count_t when, void * param) {
+    bench_t * b = (bench_t *)param;
+    b->level = !b->level;
+    avr_raise_irq(b->stimulus, b->level);
+    if (measuring(b)) {
+        b->stimulusEdges++;
+        b->pendingEdge = when;
+        b->fPending = 1;
+    }
+    return when + (b->level ? b->highCycles : b->lowCycles);
+}
+
+
+static void markerChanged(avr_irq_t * irq, uint32_t value, void * param) {
+    bench_t * b = ((watch_t *)param)->bench;
+    int marker = ((watch_t *)param)->pin;
+    avr_cycle_count_t now = b->avr->cycle;
+
+    if (value) {
+        b->markerRise[marker] = now;
+        if ((marker == MARK_ISR) && measuring(b)) {
+            b->isrRuns++;
+            if (b->fPending) {
+                statAdd(&b->latency, now - b->pendingEdge);
+                b->fPending = 0;
+            }
+        }
+    } else if (b->markerRise[marker] && measuring(b)) {
+        statAdd(&b->markers[marker], now - b->markerRise[marker]);
+    }
+}
+
+
+// I2C start is SDA falling while SCL is high and stop is SDA rising while SCL is high.
+// Every ninth SCL pulse is the ACK clock, so bytes are SCL pulses / 9.
+static void i2cChanged(avr_irq_t * irq, uint32_t value, void * param) {
+    bench_t * b = ((watch_t *)param)->bench;
+    avr_cycle_count_t now = b->avr->cycle;
+
+    if (((watch_t *)param)->pin == PIN_SDA) {
+        if (b->scl && b->sda && !value) {
+            b->fInTransaction = 1;
+            b->transactionStart = now;
+            b->sclRises = 0;
+            b->lastSclRise = 0;
+        } else if (b->scl && !b->sda && value && b->fInTransaction) {
+            b->fInTransaction = 0;
+            if (measuring(b)) {
+                statAdd(&b->i2cTransaction, now - b->transactionStart);
+                statAdd(&b->i2cBytes, b->sclRises / 9);
+            }
+        }
+        b->sda = value;
+    } else {
+        if (value && !b->scl && b->fInTransaction) {
+            if (b->lastSclRise && measuring(b)) {
+                statAdd(&b->i2cBit, now - b->lastSclRise);
+            }
+            b->lastSclRise = now;
+            b->sclRises++;
+        }
+        b->scl = value;
+    }
+}
+
+
+// Keep the serial lines that the firmware marked as benchmark results
+static void uartOutput(avr_irq_t * irq, uint32_t value, void * param) {
+    static const char prefix[] = "#bench ";
+    bench_t * b = (bench_t *)param;
+
+    if (value != '\n') {
+        if ((value != '\r') && (b->lineLength < SERIAL_LINE - 1)) {
+            b->line[b->lineLength++] = value;
+        }
+        return;
+    }
+    b->line[b->lineLength] = 0;
+    b->lineLength = 0;
+    if ((strncmp(b->line, prefix, sizeof(prefix) - 1) == 0) && (b->nResults < 8)) {
+        strcpy(b->results[b->nResults++], b->line + sizeof(prefix) - 1);
+    }
+}
+
+
+static void benchInit(bench_t * b, avr_t * avr, uint32_t hz, uint32_t duty) {
+    memset(b, 0, sizeof(*b));
+    b->avr = avr;
+    b->latency.name = "isr_latency";
+    for (int ix = 0; ix < NUM_MARKERS; ix++) {
+        b->markers[ix].name = markerNames[ix];
+    }
+    b->i2cBit.name = "i2c_bit";
+    b->i2cTransaction.name = "i2c_transaction";
+    b->i2cBytes.name = "i2c_bytes";
+    b->sda = b->scl = 1;
+
+    avr_cycle_count_t period = CPU_HZ / hz;
+    b->highCycles = period * duty / 100;
+    b->lowCycles = period - b->highCycles;
+    b->measureStart = avr_usec_to_cycles(avr, STARTUP_MS * 1000ULL);
+
+    b->stimulus = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 2);
+    avr_raise_irq(b->stimulus, 0);
+    avr_cycle_timer_register(avr, b->lowCycles, stimulusEdge, b);
+
+    for (int ix = 0; ix < NUM_MARKERS + 2; ix++) {
+        int pin = (ix < NUM_MARKERS) ? ix : (ix == NUM_MARKERS) ? PIN_SDA : PIN_SCL;
+        b->watches[ix].bench = b;
+        b->watches[ix].pin = pin;
+        avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('C'), pin),
+                                (ix < NUM_MARKERS) ? markerChanged : i2cChanged, &b->watches[ix]);
+    }
+
+    uint32_t flags = 0;
+    avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+    flags &= ~AVR_UART_FLAG_STDIO;
+    avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT),
+                            uartOutput, b);
+}
+
+
+static avr_t * loadFirmware(const char * path) {
+    static elf_firmware_t firmware;
+    memset(&firmware, 0, sizeof(firmware));
+    if (elf_read_firmware(path, &firmware) != 0) {
+        fprintf(stderr, "superfreq_bench: can't read %s\n", path);
+        exit(1);
+    }
+
+    avr_t * avr = avr_make_mcu_by_name("atmega328p");
+    if (!avr) {
+        fprintf(stderr, "superfreq_bench: simavr has no atmega328p core\n");
+        exit(1);
+    }
+    avr_init(avr);
+    avr_load_firmware(avr, &firmware);
+    avr->frequency = CPU_HZ;        // Arduino ELF files don't carry the clock frequency
+    return avr;
+}
+
+
+static void run(avr_t * avr, uint32_t ms) {
+    avr_cycle_count_t end = avr_usec_to_cycles(avr, ms * 1000ULL);
+    while (avr->cycle < end) {
+        int state = avr_run(avr);
+        if ((state == cpu_Done) || (state == cpu_Crashed)) {
+            fprintf(stderr, "superfreq_bench: simulation stopped, state %d\n", state);
+            exit(1);
+        }
+    }
+}
+
+
+// sweep
+//
+// Double the stimulus frequency until the ISR no longer runs once per edge, then
+// binary search between the last good and first bad rates.  Each point is a fresh
+// simulation so that the results are independent.
+static int sweepOnce(const char * path, uint32_t hz) {
+    bench_t b;
+    avr_t * avr = loadFirmware(path);
+    benchInit(&b, avr, hz, 50);
+    run(avr, STARTUP_MS + SWEEP_MS);
+    avr_terminate(avr);
+
+    // Allow for an edge that is still in flight at the end of the run
+    return (b.stimulusEdges > 0) && (b.isrRuns + 1 >= b.stimulusEdges);
+}
+
+static uint32_t sweep(const char * path) {
+    uint32_t good = 0;
+    uint32_t bad = 0;
+    for (uint32_t hz = 1000; hz <= CPU_HZ / 16; hz *= 2) {
+        if (!sweepOnce(path, hz)) {
+            bad = hz;
+            break;
+        }
+        good = hz;
+    }
+    if (bad == 0)  return good;
+
+    while (bad - good > good / 100) {
+        uint32_t mid = good + (bad - good) / 2;
+        if (sweepOnce(path, mid)) {
+            good = mid;
+        } else {
+            bad = mid;
+        }
+    }
+    return good;
+}
+
+
+int main(int argc, char * argv[]) {
+    uint32_t hz = 1000;
+    uint32_t duty = 50;
+    uint32_t runMs = 2500;
+    const char * vcdName = "superfreq_bench.vcd";
+    int fSweep = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:d:t:o:s")) != -1) {
+        switch (opt) {
+            case 'f':   hz = strtoul(optarg, NULL, 0);      break;
+            case 'd':   duty = strtoul(optarg, NULL, 0);    break;
+            case 't':   runMs = strtoul(optarg, NULL, 0);   break;
+            case 'o':   vcdName = optarg;                   break;
+            case 's':   fSweep = 1;                         break;
+            default:
+                fprintf(stderr, "usage: superfreq_bench [-f hz] [-d duty%%] [-t ms] [-o trace.vcd] [-s] firmware.elf\n");
+                return 2;
+        }
+    }
+    if ((optind >= argc) || (hz == 0) || (duty == 0) || (duty >= 100)) {
+        fprintf(stderr, "usage: superfreq_bench [-f hz] [-d duty%%] [-t ms] [-o trace.vcd] [-s] firmware.elf\n");
+        return 2;
+    }
+    const char * path = argv[optind];
+
+    bench_t b;
+    avr_vcd_t vcd;
+    avr_t * avr = loadFirmware(path);
+    benchInit(&b, avr, hz, duty);
+
+    avr_vcd_init(avr, vcdName, &vcd, 1 /* usec */);
+    avr_vcd_add_signal(&vcd, b.stimulus, 1, "D2_in");
+    static const char * pinNames[] = { "A0_isr", "A1_compute", "A2_display", "A3_loop", "SDA", "SCL" };
+    for (int ix = 0; ix < 6; ix++) {
+        avr_vcd_add_signal(&vcd, avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('C'), ix), 1, pinNames[ix]);
+    }
+    avr_vcd_start(&vcd);
+    run(avr, STARTUP_MS + runMs);
+    avr_vcd_stop(&vcd);
+
+    printf("stimulus_hz      %u\n", hz);
+    printf("stimulus_duty    %u\n", duty);
+    printf("stimulus_edges   %llu\n", (unsigned long long)b.stimulusEdges);
+    printf("isr_runs         %llu\n", (unsigned long long)b.isrRuns);
+    statPrint(&b.latency);
+    for (int ix = 0; ix < NUM_MARKERS; ix++) {
+        statPrint(&b.markers[ix]);
+    }
+    statPrint(&b.i2cBit);
+    statPrint(&b.i2cTransaction);
+    statPrint(&b.i2cBytes);
+    for (int ix = 0; ix < b.nResults; ix++) {
+        printf("%s\n", b.results[ix]);
+    }
+    avr_terminate(avr);
+
+    if (fSweep) {
+        printf("max_edge_rate    %u\n", sweep(path));
+    }
+    return 0;
+}
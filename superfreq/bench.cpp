@@ -0,0 +1,52 @@
+#include "superfreq.h"
+#include "bench.h"
+
+#ifdef SUPERFREQ_BENCH
+
+// The number of cycles taken to draw a row of text, which must be under 65536
+static uint16_t timeText(bool fPortrait, bool f2x, const char * str) {
+    display.setPortrait(fPortrait);
+    noInterrupts();
+    uint16_t t0 = TCNT1;
+    if (f2x) {
+        display.text2x(0, 0, str);
+    } else {
+        display.text(0, 0, str);
+    }
+    uint16_t cycles = TCNT1 - t0;
+    interrupts();
+    display.setPortrait(false);
+    return cycles;
+}
+
+
+static void printGlyphs(const char * name, uint16_t landscape, uint8_t nLandscape,
+                        uint16_t portrait, uint8_t nPortrait) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "#bench %-16s landscape=%u portrait=%u", name,
+             landscape / nLandscape, portrait / nPortrait);
+    Serial.println(buffer);
+}
+
+
+void benchGlyphs(void) {
+    uint8_t savedA = TCCR1A;
+    uint8_t savedB = TCCR1B;
+    TCCR1A = 0;
+    TCCR1B = _BV(CS10);
+
+    // A full row of each, 21 and 16 glyphs in landscape and 10 and 8 in portrait
+    uint16_t text = timeText(false, false, "ABCDEFGHIJKLMNOPQRSTU");
+    uint16_t textPortrait = timeText(true, false, "ABCDEFGHIJ");
+    uint16_t text2x = timeText(false, true, "ABCDEFGHIJKLMNOP");
+    uint16_t text2xPortrait = timeText(true, true, "ABCDEFGH");
+
+    TCCR1A = savedA;
+    TCCR1B = savedB;
+    display.clear();
+
+    printGlyphs("glyph_text", text, 21, textPortrait, 10);
+    printGlyphs("glyph_text2x", text2x, 16, text2xPortrait, 8);
+}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <Arduino.h>
+
+// Benchmark markers
+//
+// When the sketch is built with SUPERFREQ_BENCH defined, the code marks the start and
+// end of each stage by setting and clearing a pin on PORTC (A0..A3).  The simulator
+// harness in the bench directory watches these pins to measure the stage times in CPU
+// cycles, and they can also be probed with a scope or logic analyzer on real hardware.
+//
+// Each marker is a single sbi or cbi instruction, and they compile to nothing in a
+// normal build.
+
+enum {
+    BENCH_ISR = PC0,        // A0 - high while an edge interrupt is running
+    BENCH_COMPUTE = PC1,    // A1 - high while loop() computes results
+    BENCH_DISPLAY = PC2,    // A2 - high while loop() updates the display
+    BENCH_LOOP = PC3        // A3 - high for a whole display update cycle of loop()
+};
+
+// benchGlyphs
+//
+// Glyph rendering benchmark, run once at startup before the mode starts.  A full row
+// of text and of 2x text is drawn in landscape and in portrait, timed in CPU cycles
+// with Timer1 with interrupts off, and the cycles per glyph are printed on the serial
+// port as lines starting with "#bench ", which the simulator harness passes through.
+// The time includes the bit-banged I2C, so it is the whole cost of getting a glyph on
+// the screen.
+
+#ifdef SUPERFREQ_BENCH
+inline void benchBegin(void)        { DDRC |= _BV(BENCH_ISR) | _BV(BENCH_COMPUTE) | _BV(BENCH_DISPLAY) | _BV(BENCH_LOOP); }
+void benchGlyphs(void);
+#define BENCH_ON(marker)            (PORTC |= _BV(marker))
+#define BENCH_OFF(marker)           (PORTC &= ~_BV(marker))
+#else
+inline void benchBegin(void)        {}
+inline void benchGlyphs(void)       {}
+#define BENCH_ON(marker)            ((void)0)
+#define BENCH_OFF(marker)           ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef BLOCKDEV_H
+#define BLOCKDEV_H
+
+#include <stdint.h>
+
+// BlockDevice
+//
+// A storage device addressed in 512 byte blocks.  Writes are split into steps so that
+// the caller can send a block a few bytes at a time between other work and then poll
+// until the device has finished programming it, rather than waiting in one call.
+//
+// This only depends on stdint.h so that code written against it, like BlockLog, can
+// also be built on a host with a device backed by an ordinary file.
+
+class BlockDevice {
+    public:
+        enum {
+            BLOCK_SIZE = 512
+        };
+
+        virtual bool readBlock(uint32_t block, uint8_t * data) = 0;
+
+        // Write one block: writeBegin, then writeBytes until BLOCK_SIZE bytes have been
+        // sent, then writeEnd.  The next operation must wait until busy returns false.
+        virtual bool writeBegin(uint32_t block) = 0;
+        virtual void writeBytes(const uint8_t * data, uint16_t count) = 0;
+        virtual bool writeEnd(void) = 0;
+        virtual bool busy(void) = 0;
+};
+
+#endif
@@ -0,0 +1,167 @@
+#include <string.h>
+#include "blocklog.h"
+
+BlockLog::BlockLog(BlockDevice & device, uint8_t recordSize)
+    : device(device), recordSize(recordSize) {
+    capacity = (BlockDevice::BLOCK_SIZE - sizeof(BlockLogHeader)) / recordSize;
+    firstBlock = 0;
+    logState = FAILED;
+    sent = 0;
+    nPending = 0;
+    nDropped = 0;
+    droppedSince = 0;
+    memset(buffer, 0, sizeof(buffer));
+}
+
+
+// begin
+//
+// Read the first block to find the log on the device.  If it holds a log with the same
+// record size, that log is continued unless fNew is set, in which case a new log with
+// the next session number is started over it.  The end of the log is found with an
+// exponential search followed by a binary search, so only a few dozen blocks are read
+// even for a full card.  Returns false if the device can't be read.
+bool BlockLog::begin(uint32_t firstBlock, bool fNew) {
+    this->firstBlock = firstBlock;
+    nPending = 0;
+    nDropped = 0;
+    droppedSince = 0;
+
+    if (!device.readBlock(firstBlock, buffer)) {
+        logState = FAILED;
+        return false;
+    }
+
+    uint16_t session = 1;
+    uint32_t next = 0;
+    const BlockLogHeader & h = header();
+    if ((h.magic == BLOCKLOG_MAGIC) && (h.version == BLOCKLOG_VERSION) &&
+        (h.recordSize == recordSize) && (h.sequence == 0)) {
+        session = h.session;
+        if (fNew) {
+            session++;
+        } else {
+            uint32_t good = 0;
+            uint32_t bad = 1;
+            while (validBlock(bad, session)) {
+                good = bad;
+                bad <<= 1;
+                if (bad == 0)  break;
+            }
+            while (bad - good > 1) {
+                uint32_t mid = good + (bad - good) / 2;
+                if (validBlock(mid, session)) {
+                    good = mid;
+                } else {
+                    bad = mid;
+                }
+            }
+            next = good + 1;
+        }
+    }
+
+    startBlock(next);
+    header().session = session;
+    logState = IDLE;
+    return true;
+}
+
+
+// append
+//
+// Add one record of recordSize bytes to the log.  Returns false if the record had to
+// be dropped.
+bool BlockLog::append(const void * record) {
+    if (logState == IDLE) {
+        BlockLogHeader & h = header();
+        memcpy(buffer + sizeof(BlockLogHeader) + h.count * recordSize, record, recordSize);
+        if (++h.count == capacity) {
+            startWrite();
+        }
+        return true;
+    }
+
+    if ((logState != FAILED) && (nPending + recordSize <= PENDING_SIZE)) {
+        memcpy(pending + nPending, record, recordSize);
+        nPending += recordSize;
+        return true;
+    }
+
+    nDropped++;
+    if (droppedSince < 0xffff)  droppedSince++;
+    return false;
+}
+
+
+// flush
+//
+// Write the current block even though it isn't full, so that the records collected so
+// far are safe on the device.  The rest of that block is left unused.
+void BlockLog::flush(void) {
+    if ((logState == IDLE) && (header().count > 0)) {
+        startWrite();
+    }
+}
+
+
+// poll
+//
+// Call frequently.  Sends the next chunk of a block being written, or checks whether
+// the device has finished programming it.  When it has, the next block is started
+// with any records that were held back during the write.
+void BlockLog::poll(void) {
+    if (logState == SENDING) {
+        uint16_t n = BlockDevice::BLOCK_SIZE - sent;
+        if (n > CHUNK_SIZE)  n = CHUNK_SIZE;
+        device.writeBytes(buffer + sent, n);
+        sent += n;
+        if (sent == BlockDevice::BLOCK_SIZE) {
+            logState = device.writeEnd() ? PROGRAMMING : FAILED;
+        }
+    } else if ((logState == PROGRAMMING) && !device.busy()) {
+        startBlock(header().sequence + 1);
+        memcpy(buffer + sizeof(BlockLogHeader), pending, nPending);
+        header().count = nPending / recordSize;
+        nPending = 0;
+        logState = IDLE;
+    }
+}
+
+
+// validBlock
+//
+// Read a block and check that it is block sequence of the log with this session.
+// Uses the block buffer, so it may only be called from begin.
+bool BlockLog::validBlock(uint32_t sequence, uint16_t session) {
+    if (!device.readBlock(firstBlock + sequence, buffer))  return false;
+    const BlockLogHeader & h = header();
+    return (h.magic == BLOCKLOG_MAGIC) && (h.session == session) && (h.version == BLOCKLOG_VERSION) &&
+           (h.recordSize == recordSize) && (h.sequence == sequence);
+}
+
+
+// startBlock
+//
+// Clear the buffer and fill in the header for an empty block, keeping the session.
+void BlockLog::startBlock(uint32_t sequence) {
+    uint16_t session = header().session;
+    memset(buffer, 0, sizeof(buffer));
+    BlockLogHeader & h = header();
+    h.magic = BLOCKLOG_MAGIC;
+    h.session = session;
+    h.version = BLOCKLOG_VERSION;
+    h.recordSize = recordSize;
+    h.sequence = sequence;
+    h.dropped = droppedSince;
+    droppedSince = 0;
+}
+
+
+void BlockLog::startWrite(void) {
+    if (device.writeBegin(firstBlock + header().sequence)) {
+        sent = 0;
+        logState = SENDING;
+    } else {
+        logState = FAILED;
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef BLOCKLOG_H
+#define BLOCKLOG_H
+
+#include <stdint.h>
+#include "blockdev.h"
+
+// BlockLog
+//
+// Appends fixed size binary records to consecutive raw blocks of a BlockDevice, with
+// no file system.  Records are collected in a one block buffer, and only whole blocks
+// are written.  Each block starts with a header, so the log can be read back by
+// scanning blocks from the first one until the header no longer follows on.
+//
+// A block write is spread over calls to poll, a chunk at a time, followed by polling
+// for the end of programming, so a slow card never holds up the caller for long.
+// Records that arrive while the buffer is being written are held in a small pending
+// area and moved into the buffer when the write finishes.  If that fills as well,
+// records are dropped and the number lost is saved in the next block header.
+//
+// A log is identified by a session number in every block.  On begin, the log starting
+// at the first block is continued after its last block, found by a binary search, or
+// a new log is started with the next session number.  Blocks left over from an older
+// log have a different session, so they don't look like part of the current one.
+//
+// The header layout is shared with the host converter, so it is fixed, and only
+// uses naturally aligned fields.  Both the AVR and the usual hosts are little endian.
+
+#define BLOCKLOG_MAGIC      0x474c4653UL    // "SFLG"
+#define BLOCKLOG_VERSION    1
+
+struct BlockLogHeader {
+    uint32_t magic;         // BLOCKLOG_MAGIC
+    uint16_t session;       // log number, different for each new log
+    uint8_t version;        // BLOCKLOG_VERSION
+    uint8_t recordSize;     // bytes per record
+    uint32_t sequence;      // block number within the log, from zero
+    uint16_t count;         // records in this block
+    uint16_t dropped;       // records lost since the previous block
+};
+
+class BlockLog {
+    public:
+        enum {
+            CHUNK_SIZE = 64,        // bytes sent to the device per poll
+            PENDING_SIZE = 96       // bytes of records held while a block is written
+        };
+
+        enum State {
+            IDLE,                   // collecting records
+            SENDING,                // sending the buffer to the device
+            PROGRAMMING,            // waiting for the device to finish the write
+            FAILED                  // the device stopped responding
+        };
+
+        BlockLog(BlockDevice & device, uint8_t recordSize);
+
+        bool begin(uint32_t firstBlock, bool fNew);
+        bool append(const void * record);
+        void flush(void);
+        void poll(void);
+
+        State state(void) const         { return logState; }
+        uint16_t session(void) const    { return header().session; }
+        uint32_t blocks(void) const     { return header().sequence; }
+        uint32_t dropped(void) const    { return nDropped; }
+
+    private:
+        BlockLogHeader & header(void)               { return *(BlockLogHeader *)buffer; }
+        const BlockLogHeader & header(void) const   { return *(const BlockLogHeader *)buffer; }
+        bool validBlock(uint32_t sequence, uint16_t session);
+        void startBlock(uint32_t sequence);
+        void startWrite(void);
+
+        BlockDevice & device;
+        uint8_t recordSize;
+        uint16_t capacity;          // records per block
+        uint32_t firstBlock;
+        State logState;
+        uint16_t sent;              // bytes of the buffer sent in the current write
+        uint8_t nPending;
+        uint32_t nDropped;          // total records lost
+        uint16_t droppedSince;      // records lost since the last block was started
+        uint8_t pending[PENDING_SIZE];
+        uint8_t buffer[BlockDevice::BLOCK_SIZE];
+};
+
+#endif
@@ -0,0 +1,169 @@
+#include "superfreq.h"
+#include "burst.h"
+#include "capture.h"
+#include "tempco.h"
+#include "timebase.h"
+
+#if SUPERFREQ_MODE == MODE_BURST
+
+static const uint32_t gapTicks = (uint32_t)BURST_GAP_US * (TIMEBASE_HZ / 1000000);
+
+// The burst in progress
+static bool fInBurst;
+static uint32_t burstStart;
+static uint32_t lastEdge;
+static uint32_t burstEdges;
+
+// Start of the previous burst, for the repetition rate
+static bool fHavePrevStart;
+static uint32_t prevStart;
+
+// Totals since the last burstTake
+static BurstStats totals;
+
+
+static void endBurst(void) {
+    totals.bursts++;
+    totals.edges += burstEdges;
+    totals.periods += burstEdges - 1;
+    totals.lengthTicks += lastEdge - burstStart;
+    fInBurst = false;
+}
+
+
+void burstReset(void) {
+    fInBurst = false;
+    fHavePrevStart = false;
+    memset(&totals, 0, sizeof(totals));
+}
+
+
+// burstAddEdge
+//
+// Add the next rising edge.  A gap longer than the threshold ends the current burst
+// and the edge starts a new one.
+void burstAddEdge(uint32_t ticks) {
+    if (fInBurst && ((ticks - lastEdge) > gapTicks)) {
+        endBurst();
+    }
+
+    if (!fInBurst) {
+        fInBurst = true;
+        burstStart = ticks;
+        burstEdges = 0;
+        if (fHavePrevStart) {
+            totals.repeats++;
+            totals.repeatTicks += ticks - prevStart;
+        }
+        fHavePrevStart = true;
+        prevStart = ticks;
+    }
+
+    burstEdges++;
+    lastEdge = ticks;
+}
+
+
+// burstIdle
+//
+// End the current burst if no edge has arrived within the gap threshold.  Without this,
+// the last burst before a long idle period would not be reported until the next edge.
+// The comparison is signed because an edge may be processed with a timestamp that is
+// slightly later than now.
+void burstIdle(uint32_t now) {
+    if (fInBurst && ((int32_t)(now - lastEdge) > (int32_t)gapTicks)) {
+        endBurst();
+    }
+}
+
+
+// burstTake
+//
+// Return the totals for the bursts completed since the last call and start new totals.
+void burstTake(BurstStats & stats) {
+    stats = totals;
+    memset(&totals, 0, sizeof(totals));
+}
+
+
+static unsigned long lastUpdateMs;
+
+// The labels and units either side of the readings
+static TextField freqLabel(display, 0, 0, 5, true);
+static TextField edgeLabel(display, 2, 0, 5, true);
+static TextField lengthLabel(display, 4, 0, 5, true);
+static TextField repeatLabel(display, 6, 0, 5, true);
+static TextField freqUnit(display, 0, 14*8, 2, true);
+static TextField edgeUnit(display, 2, 14*8, 2, true);
+static TextField lengthUnit(display, 4, 14*8, 2, true);
+static TextField repeatUnit(display, 6, 14*8, 2, true);
+static TextField * const labels[] = {
+    &freqLabel, &edgeLabel, &lengthLabel, &repeatLabel,
+    &freqUnit, &edgeUnit, &lengthUnit, &repeatUnit
+};
+
+void burstSetup(void) {
+    freqLabel.set("Fin:");
+    edgeLabel.set("Edge:");
+    lengthLabel.set("Len:");
+    repeatLabel.set("Rep:");
+    freqUnit.set("Hz");
+    lengthUnit.set("ms");
+    repeatUnit.set("Hz");
+    flushFields(labels, sizeof(labels) / sizeof(labels[0]));
+    displayRefresh.setFields(labels, sizeof(labels) / sizeof(labels[0]));
+
+    timebaseBegin();
+    burstReset();
+    captureBegin(RISING);
+    lastUpdateMs = millis();
+}
+
+
+void burstLoop(void) {
+    CaptureEdge edge;
+    uint32_t now = timebaseNow();
+
+    while (captureGet(edge)) {
+        burstAddEdge(edge.ticks);
+    }
+    burstIdle(now);
+
+    if (millis() - lastUpdateMs < BURST_UPDATE_MS) {
+        return;
+    }
+    lastUpdateMs += BURST_UPDATE_MS;
+
+    char buffer[20];
+    BurstStats stats;
+    burstTake(stats);
+
+    if (captureTakeOverruns()) {
+        // Edges were lost, so the burst boundaries can't be trusted
+        strcpy(buffer, "  overrun");
+    } else if (stats.periods) {
+        dtostrf((float)stats.periods * TIMEBASE_HZ / tempcoTicks(stats.lengthTicks), 9, 0, buffer);
+    } else {
+        strcpy(buffer, "        -");
+    }
+    display.text2x(0, 5*8, buffer);
+
+    if (stats.bursts) {
+        dtostrf((float)stats.edges / stats.bursts, 9, 1, buffer);
+        display.text2x(2, 5*8, buffer);
+        dtostrf((float)tempcoTicks(stats.lengthTicks) / stats.bursts / (TIMEBASE_HZ / 1000), 9, 3, buffer);
+        display.text2x(4, 5*8, buffer);
+    } else {
+        display.text2x(2, 5*8, "        -");
+        display.text2x(4, 5*8, "        -");
+    }
+
+    if (stats.repeats) {
+        dtostrf((float)stats.repeats * TIMEBASE_HZ / tempcoTicks(stats.repeatTicks), 9, 2, buffer);
+    } else {
+        strcpy(buffer, "        -");
+    }
+    display.text2x(6, 5*8, buffer);
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef BURST_H
+#define BURST_H
+
+#include <Arduino.h>
+
+// Burst analyzer
+//
+// Intermittent clocks, like SPI SCK or a clock-gated logic block, are idle most of the
+// time and then run for a short burst.  Averaging the edges over a fixed interval gives
+// a meaningless frequency for these signals.  This mode splits the rising edges on D2
+// into bursts wherever the gap between two edges is longer than BURST_GAP_US and reports
+// the clock frequency inside the bursts, the number of edges per burst, the burst length,
+// and the rate at which bursts repeat.
+//
+// Everything is accumulated as the edges arrive, so no edge trace is stored.
+
+struct BurstStats {
+    uint16_t bursts;        // bursts completed
+    uint32_t edges;         // rising edges in all completed bursts
+    uint32_t periods;       // clock periods inside bursts, edges - 1 for each burst
+    uint32_t lengthTicks;   // sum of first-to-last edge times of each burst
+    uint16_t repeats;       // start-to-start intervals between consecutive bursts
+    uint32_t repeatTicks;   // sum of the start-to-start intervals
+};
+
+void burstReset(void);
+void burstAddEdge(uint32_t ticks);
+void burstIdle(uint32_t now);
+void burstTake(BurstStats & stats);
+
+void burstSetup(void);
+void burstLoop(void);
+
+#endif
@@ -0,0 +1,133 @@
+#include "superfreq.h"
+#include "capture.h"
+#include "bench.h"
+#include "timebase.h"
+
+#if USE_CAPTURE
+
+const byte CAPTURE_PIN = 2;     // INT0
+const byte GATE_PIN = 3;        // INT1
+
+// The queue size must be a power of two
+#define CAPTURE_QUEUE_MASK  (CAPTURE_QUEUE_SIZE - 1)
+
+static CaptureEdge captureQueue[CAPTURE_QUEUE_SIZE];
+static volatile uint8_t captureHead;   // written by the ISR
+static volatile uint8_t captureTail;   // written by captureGet
+static volatile uint16_t captureOverruns;
+
+
+static inline void queueEdge(uint32_t t, uint8_t level) {
+    uint8_t head = captureHead;
+    uint8_t next = (head + 1) & CAPTURE_QUEUE_MASK;
+    if (next == captureTail) {
+        captureOverruns++;
+    } else {
+        captureQueue[head].ticks = t;
+        captureQueue[head].level = level;
+        captureHead = next;
+    }
+}
+
+
+// The pin levels are read first because they can change again soon after the edge.
+ISR(INT0_vect) {
+    uint8_t pins = PIND;
+    uint32_t t = timebaseNowFromIsr();
+#if USE_CAPTURE_GATE
+    if (((pins & _BV(PD3)) != 0) != (GATE_ACTIVE_LEVEL == HIGH)) {
+        return;
+    }
+#endif
+    BENCH_ON(BENCH_ISR);
+    queueEdge(t, (pins & _BV(PD2)) ? HIGH : LOW);
+    BENCH_OFF(BENCH_ISR);
+}
+
+
+#if USE_CAPTURE_GATE
+// INT0 has the higher priority, so an input edge that arrives just before the gate
+// closes is always queued ahead of the gate edge.
+ISR(INT1_vect) {
+    uint8_t pins = PIND;
+    uint32_t t = timebaseNowFromIsr();
+    bool fOpen = ((pins & _BV(PD3)) != 0) == (GATE_ACTIVE_LEVEL == HIGH);
+    queueEdge(t, CAPTURE_GATE | (fOpen ? HIGH : LOW));
+}
+#endif
+
+
+// captureBegin
+//
+// Start capturing edges on D2.  The sense argument is one of the Arduino attachInterrupt
+// constants RISING, FALLING, or CHANGE.  Capturing only the edges that are needed halves
+// the interrupt load.  The timebase must already be running.
+void captureBegin(uint8_t sense) {
+    pinMode(CAPTURE_PIN, INPUT_PULLUP);
+#if USE_CAPTURE_GATE
+    pinMode(GATE_PIN, INPUT_PULLUP);
+#endif
+
+    uint8_t isc;
+    switch (sense) {
+        case RISING:    isc = _BV(ISC01) | _BV(ISC00);  break;
+        case FALLING:   isc = _BV(ISC01);               break;
+        default:        isc = _BV(ISC00);               break;
+    }
+
+    uint8_t oldSREG = SREG;
+    cli();
+    captureHead = captureTail = 0;
+    captureOverruns = 0;
+    EICRA = (EICRA & ~(_BV(ISC01) | _BV(ISC00))) | isc;
+    EIFR = _BV(INTF0);
+    EIMSK |= _BV(INT0);
+#if USE_CAPTURE_GATE
+    EICRA = (EICRA & ~(_BV(ISC11) | _BV(ISC10))) | _BV(ISC10);     // INT1 on any change
+    EIFR = _BV(INTF1);
+    EIMSK |= _BV(INT1);
+#endif
+    SREG = oldSREG;
+}
+
+
+void captureEnd(void) {
+    EIMSK &= ~_BV(INT0);
+#if USE_CAPTURE_GATE
+    EIMSK &= ~_BV(INT1);
+#endif
+}
+
+
+// captureGet
+//
+// Remove the oldest edge from the queue.  Returns false if the queue is empty.
+bool captureGet(CaptureEdge & edge) {
+    uint8_t tail = captureTail;
+    if (tail == captureHead) {
+        return false;
+    }
+
+    // Only the ISR writes the entry and only this function moves the tail, so the
+    // entry is stable until the tail is advanced.
+    edge = captureQueue[tail];
+    captureTail = (tail + 1) & CAPTURE_QUEUE_MASK;
+    return true;
+}
+
+
+// captureTakeOverruns
+//
+// Return the number of edges dropped since the last call, and clear it.  The count is
+// two bytes that the ISR can change between, so it is read and cleared with interrupts
+// off.
+uint16_t captureTakeOverruns(void) {
+    uint8_t oldSREG = SREG;
+    cli();
+    uint16_t overruns = captureOverruns;
+    captureOverruns = 0;
+    SREG = oldSREG;
+    return overruns;
+}
+
+#endif
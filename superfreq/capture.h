@@ -0,0 +1,35 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <Arduino.h>
+
+// Edge capture
+//
+// Each edge on D2 is timestamped with the 0.5us timebase by the INT0 interrupt and
+// queued for the measurement code in loop() to consume.  The queue lets loop() do
+// slow work, like updating the display, without losing the edges that arrive in the
+// meantime.  If loop() falls too far behind, new edges are dropped and counted, and
+// captureTakeOverruns() returns the count since it was last called.
+//
+// The interrupt takes a few microseconds, so this is only suitable for inputs up to
+// roughly 100KHz.  Use the hardware counter for faster signals.
+//
+// When the mode uses the gate input (USE_CAPTURE_GATE), edges on D2 are only captured
+// while D3 is at GATE_ACTIVE_LEVEL.  The INT0 interrupt reads D3 directly, so the gate
+// applies from the very next edge with no software delay.  Changes of the gate are
+// also queued, as edges with CAPTURE_GATE set in the level, so that the measurement
+// code knows where each gated interval starts and ends.
+
+struct CaptureEdge {
+    uint32_t ticks;     // timebase ticks when the edge was seen
+    uint8_t level;      // pin level just after the edge, HIGH for a rising edge
+};
+
+#define CAPTURE_GATE    0x80    // level flag for a gate edge, the rest is the gate state
+
+void captureBegin(uint8_t sense);
+void captureEnd(void);
+bool captureGet(CaptureEdge & edge);
+uint16_t captureTakeOverruns(void);
+
+#endif
@@ -0,0 +1,47 @@
+#include "compositor.h"
+
+Compositor::Compositor(CompositorField fields[], uint8_t count, uint16_t bytesPerFrame)
+    : fields(fields), count(count), bytesPerFrame(bytesPerFrame) {
+}
+
+
+// frame
+//
+// Send one frame.  Call at the frame rate, which sets the fastest that any field can
+// update.  Returns the number of bus bytes sent.
+uint16_t Compositor::frame(void) {
+    unsigned long now = millis();
+    uint16_t budget = bytesPerFrame;
+    uint16_t total = 0;
+
+    for (;;) {
+        CompositorField * best = 0;
+        for (uint8_t ix = 0; ix < count; ix++) {
+            CompositorField & f = fields[ix];
+            uint16_t cost = f.field->dirtyBytes();
+            if ((cost == 0) || (now - f.lastMs < f.intervalMs)) {
+                continue;
+            }
+            if (!best || (f.priority > best->priority) ||
+                ((f.priority == best->priority) && (now - f.lastMs > now - best->lastMs))) {
+                best = &f;
+            }
+        }
+        if (!best) {
+            break;
+        }
+
+        // A field that doesn't fit sends the start of its changes now and the rest in
+        // the next frame, with its interval already passed.
+        uint16_t sent = best->field->flush(budget);
+        if (sent == 0) {
+            break;
+        }
+        if (!best->field->dirty()) {
+            best->lastMs = now;
+        }
+        budget -= sent;
+        total += sent;
+    }
+    return total;
+}
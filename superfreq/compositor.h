@@ -0,0 +1,41 @@
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+
+#include <Arduino.h>
+#include "textfield.h"
+
+// Compositor
+//
+// Decides which text fields are sent to the display in each frame.  Every field has a
+// priority and a minimum interval between redraws, and each frame has a budget of
+// bus bytes, which counts the addressing of each row that a field sends as well as its
+// pixels.  A frame sends the changed part of the most important field
+// that is dirty and whose interval has passed, then the next most important, for as
+// long as the budget lasts.  Fields of the same priority take turns, oldest first.
+//
+// The bus time per frame is bounded by the budget, so a fast field like the frequency
+// can be redrawn every frame while statistics that change every digit are spread over
+// the following frames without delaying it.  When the changes to a field don't fit in
+// what is left of the budget, the leading characters are sent and the rest follow in
+// the next frame, so a large field is never starved by smaller, more important ones.
+
+struct CompositorField {
+    TextField * field;
+    uint8_t priority;           // higher is more important
+    uint16_t intervalMs;        // minimum time between redraws
+    unsigned long lastMs;       // millis() when the field was last sent
+};
+
+class Compositor {
+    public:
+        Compositor(CompositorField fields[], uint8_t count, uint16_t bytesPerFrame);
+
+        uint16_t frame(void);
+
+    private:
+        CompositorField * fields;
+        uint8_t count;
+        uint16_t bytesPerFrame;
+};
+
+#endif
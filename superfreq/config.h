@@ -0,0 +1,384 @@
+// superfreq build configuration
+//
+// The ATmega328P does not have enough RAM or timers to run every measurement mode
+// at the same time, so the mode is selected here when the sketch is compiled.
+// Modules for the other modes compile to nothing.
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+// Measurement modes
+#define MODE_PERIOD         0   // per-edge period and duty cycle, signal on D2
+#define MODE_COUNTER        1   // edge-gated reciprocal counter, signal on D5 (T1)
+#define MODE_BURST          2   // burst analyzer for gated clocks, signal on D2
+#define MODE_DRIFT          3   // long-term drift logger with trend, signal on D5 (T1)
+#define MODE_TRIGGER        4   // triggered single-shot edge capture, signal on D2
+#define MODE_USART          5   // USART shift register sampling capture, signal on D0 (RXD)
+#define MODE_SETTLE         6   // settling time after a frequency step, signal on D2
+#define MODE_DASHBOARD      7   // two panel dashboard, signal on D5 (T1)
+#define MODE_LOGGER         8   // counter readings logged to an SD card, signal on D5 (T1)
+#define MODE_GATED          9   // frequency and duty while a gate input is active, signal on D2
+#define MODE_SYNC           10  // counter readings on a shared sync timeline, signal on D5 (T1)
+#define MODE_RATIO          11  // two hardware counters and their ratio, signals on D4 (T0) and D5 (T1)
+#define MODE_SLAVE          12  // I2C or SPI slave register map of the results, signal on D2
+#define MODE_SWEEP          13  // VCO transfer curve from a PWM control voltage on D9, signal on D2
+#define MODE_PIPELINE       14  // measurement built from compile-time pipeline stages, signal on D2
+#define MODE_FSK            15  // FSK tone decoder with symbol timing recovery, signal on D2
+#define MODE_MAINS          16  // mains frequency monitor with RoCoF and an event log, signal on D2
+#define MODE_TEMPCO         17  // clock error against temperature for the tempco curve, reference on D5 (T1)
+
+// Select the measurement mode for this build.  This can also be set from the
+// compiler command line, for example -DSUPERFREQ_MODE=1
+#ifndef SUPERFREQ_MODE
+#define SUPERFREQ_MODE      MODE_PERIOD
+#endif
+
+
+// Serial port speed for modes that report or export results
+#define SERIAL_BAUD         115200
+
+// Uncomment, or define on the compiler command line, to mirror the display to the
+// serial port for tools/sfmirror.py.  This uses 1KB of RAM for a copy of the screen.
+//#define SUPERFREQ_MIRROR
+
+
+// Period mode
+//
+// Number of completed periods that can be queued between the pin change interrupt
+// and loop().
+#define PERIOD_QUEUE_SIZE   8
+
+// The display is drawn in frames of PERIOD_FRAME_MS, and the frequency is updated
+// every frame.  Each frame sends at most PERIOD_FRAME_BYTES on the display bus, and
+// the high, low and duty cycle fields use what the frequency leaves.  Every field that
+// is sent costs 14 bytes of addressing for its two rows on top of 16 bytes a
+// character, so 160 bytes is one full frequency field or a few shorter changes.  The
+// bus is bit-banged at roughly 100 cycles, or 6us, a byte, so 160 bytes keep each
+// frame to about 1ms of loop() time, 2% of the 50ms frame.
+#define PERIOD_FRAME_MS     50
+#define PERIOD_FRAME_BYTES  160
+
+// Frequency of the 50% square wave on D9 used to calibrate the edge timing, and the
+// number of seconds that it is measured for.
+#define PERIOD_CAL_HZ       1000
+#define PERIOD_CAL_SECONDS  4
+
+
+// Outlier filter
+//
+// Each period is compared with the median of the last MEDIAN_WINDOW periods.  Use an
+// odd size.  Each entry uses 8 bytes of RAM.
+#define MEDIAN_WINDOW       9
+
+// A period is rejected if it is more than HAMPEL_THRESHOLD standard deviations from
+// the median, estimated from the median absolute deviation of the window.
+#define HAMPEL_THRESHOLD    3
+
+// Periods within 1/2^HAMPEL_MIN_SHIFT of the median are never rejected.  This keeps a
+// very clean signal, where every period is the same, from rejecting normal jitter.
+#define HAMPEL_MIN_SHIFT    5
+
+
+// Counter mode
+//
+// Nominal gate time.  The gate opens and closes on input edges, so the actual gate
+// is this long plus up to one input period.  Longer gates give finer resolution.
+#define COUNTER_GATE_MS     1000
+
+// Display "no signal" if no input edge is seen for this long.
+#define COUNTER_TIMEOUT_MS  3000
+
+
+// Edge capture
+//
+// Number of edges that can be queued between the capture interrupt and loop().
+// Must be a power of two.  Each entry uses 5 bytes of RAM.
+#define CAPTURE_QUEUE_SIZE  32
+
+
+// Burst mode
+//
+// An inter-edge gap longer than this ends a burst.  It must be longer than the
+// slowest clock period inside a burst and shorter than the idle time between bursts.
+#define BURST_GAP_US        200
+
+// Burst statistics are averaged and displayed at this interval.
+#define BURST_UPDATE_MS     1000
+
+
+// Drift mode
+//
+// Number of buckets kept at each of the seconds, minutes and hours levels.  Each
+// bucket uses 6 bytes of RAM.  Must divide evenly into the 128 pixel display width.
+#define DRIFT_BUCKETS       32
+
+
+// Trigger mode
+//
+// Number of edges kept in the capture, up to 255.  Each edge uses a little over 4
+// bytes of RAM.  TRIGGER_POST of them are recorded after the trigger and the rest
+// are the edges that led up to it.
+#define TRIGGER_HISTORY     64
+#define TRIGGER_POST        16
+
+// Number of edges either side of the trigger shown in the zoomed timing diagram
+#define TRIGGER_ZOOM        4
+
+// Trigger on a period outside of this range, measured between rising edges.  Set
+// either limit to zero to disable it.  If both are zero, a period that the median
+// outlier filter rejects is the trigger.
+#define TRIGGER_MIN_PERIOD_US   0
+#define TRIGGER_MAX_PERIOD_US   0
+
+// Freeze the capture even if fewer than TRIGGER_POST edges follow the trigger
+#define TRIGGER_TIMEOUT_MS  1000
+
+
+// USART capture mode
+//
+// Sample rate, which must be 16MHz divided by an even number.  The polling loop
+// keeps up at 4MHz.  At 8MHz it depends on the compiler output, and an overrun is
+// shown on the display if it did not keep up.
+#define USART_SAMPLE_HZ     4000000UL
+
+// Capture buffer size.  There are 8 samples per byte.
+#define USART_CAPTURE_BYTES 512
+
+// High or low pulses shorter than this many samples are counted as glitches
+#define USART_GLITCH_SAMPLES 2
+
+// Time between captures
+#define USART_REPEAT_MS     1000
+
+
+// Settle mode
+//
+// A step is detected when SETTLE_CONFIRM periods in a row differ from the median of
+// the recent periods by more than SETTLE_STEP_PPM.  The signal has settled when
+// SETTLE_HOLD periods in a row stay within SETTLE_TOLERANCE_PPM of their mean.  The
+// per-period resolution is 0.5us, so the tolerance must be wider than 0.5us divided
+// by the period being measured.
+#define SETTLE_STEP_PPM         10000
+#define SETTLE_CONFIRM          3
+#define SETTLE_TOLERANCE_PPM    2000
+#define SETTLE_HOLD             32
+
+// Give up and report "not settled" after this long
+#define SETTLE_TIMEOUT_MS       10000
+
+
+// Dashboard mode
+//
+// Counter gate time.  The panels update once per gate.
+#define DASHBOARD_GATE_MS   250
+
+
+// Background display refresh
+//
+// Bus budget for re-sending display content that has not changed, in bytes per second
+// for each display.  The bus is bit-banged at about 6us a byte, so 250 bytes per second
+// refreshes a full panel in about five seconds for 0.15% of the CPU time.  The period
+// and dashboard modes refresh all of their text fields, and the other modes their
+// fixed labels and the display configuration.
+#define REFRESH_BYTES_PER_SEC   250
+
+
+// Logger mode
+//
+// Counter gate time, which is also the interval between log records, and the SD card
+// block where the log starts.  The card is written as raw blocks, so anything on it
+// from that block on is overwritten.
+#define LOGGER_GATE_MS          1000
+#define LOGGER_FIRST_BLOCK      2048
+
+
+// Gated mode
+//
+// Level on D3 that lets edges on D2 be measured, and the time between updates.  D3 has
+// a pullup, so an unconnected gate is open unless the active level is LOW.
+#define GATE_ACTIVE_LEVEL       HIGH
+#define GATED_UPDATE_MS         1000
+
+
+// Sync mode
+//
+// Set SYNC_MASTER to 1 on the one unit that drives the sync line.  SYNC_UNIT_ID is
+// printed with each reading so that a host can tell the units apart.  Both can also
+// be set from the compiler command line.
+#ifndef SYNC_MASTER
+#define SYNC_MASTER             0
+#endif
+#ifndef SYNC_UNIT_ID
+#define SYNC_UNIT_ID            0
+#endif
+
+// Time between sync pulses.  Each pulse edge is placed on a timebase tick by the Timer2
+// compare match, so the period has to be a whole number of timebase overflows, which
+// is a multiple of 16ms.
+#define SYNC_PERIOD_MS          96
+#define SYNC_GATE_MS            1000
+
+
+// Ratio mode
+//
+// Counter gate time, shared by both inputs.
+#define RATIO_GATE_MS           1000
+
+// Spread of the counter compare interrupt latency, in microseconds.  D4 edges in this
+// time can be counted in the wrong gate, which limits the digits shown.
+#define RATIO_JITTER_US         4
+
+
+// Slave mode
+//
+// Bus for the register map, SLAVE_BUS_I2C on A4 and A5 or SLAVE_BUS_SPI on D10 to D13,
+// the I2C address, and the time between updates of the registers.
+#define SLAVE_BUS_I2C           0
+#define SLAVE_BUS_SPI           1
+#ifndef SLAVE_BUS
+#define SLAVE_BUS               SLAVE_BUS_I2C
+#endif
+#define SLAVE_I2C_ADDRESS       0x46
+#define SLAVE_UPDATE_MS         1000
+
+// Set to 0 to run without a display, for example when it can't be moved off of A4
+// and A5.
+#ifndef SLAVE_DISPLAY
+#define SLAVE_DISPLAY           1
+#endif
+
+
+// Sweep mode
+//
+// Control voltage levels, evenly spaced from SWEEP_FROM_V to SWEEP_TO_V, for the PWM
+// output on D9 with a full scale of SWEEP_FULL_SCALE_V.  Each level uses 8 bytes of RAM.
+#define SWEEP_FULL_SCALE_V      5.0
+#define SWEEP_FROM_V            0.5
+#define SWEEP_TO_V              4.5
+#define SWEEP_STEPS             17
+
+// A step is stable when SWEEP_HOLD periods in a row are within SWEEP_TOLERANCE_PPM of
+// their mean.  As in the settle mode, the tolerance must be wider than 0.5us divided by
+// the period being measured.  A step that has not settled after SWEEP_STEP_TIMEOUT_MS
+// is recorded as unstable.
+#define SWEEP_TOLERANCE_PPM     2000
+#define SWEEP_HOLD              32
+#define SWEEP_STEP_TIMEOUT_MS   5000
+
+
+// Pipeline mode
+//
+// Stages of the measurement.  PIPELINE_DEGLITCH_US merges periods shorter than this
+// into the next one, zero to leave out the stage.  PIPELINE_MEDIAN set to 1 adds the
+// median/Hampel outlier filter.  The estimator is PIPELINE_SINGLE, PIPELINE_RECIPROCAL
+// or PIPELINE_REGRESSION and the result is shown as PIPELINE_HZ or PIPELINE_PERIOD.
+#define PIPELINE_SINGLE         0
+#define PIPELINE_RECIPROCAL     1
+#define PIPELINE_REGRESSION     2
+#define PIPELINE_HZ             0
+#define PIPELINE_PERIOD         1
+
+#ifndef PIPELINE_DEGLITCH_US
+#define PIPELINE_DEGLITCH_US    0
+#endif
+#ifndef PIPELINE_MEDIAN
+#define PIPELINE_MEDIAN         1
+#endif
+#ifndef PIPELINE_ESTIMATOR
+#define PIPELINE_ESTIMATOR      PIPELINE_RECIPROCAL
+#endif
+#ifndef PIPELINE_FORMAT
+#define PIPELINE_FORMAT         PIPELINE_HZ
+#endif
+#define PIPELINE_UPDATE_MS      1000
+
+
+// FSK mode
+//
+// Mark and space tones and the symbol rate, Bell 202 by default.  A period more than
+// FSK_TOLERANCE_PCT away from both tones is counted as off-tone.  The statistics on the
+// display are updated every FSK_UPDATE_MS.
+#define FSK_MARK_HZ             1200
+#define FSK_SPACE_HZ            2200
+#define FSK_BAUD                1200
+#define FSK_TOLERANCE_PCT       20
+#define FSK_UPDATE_MS           500
+
+
+// Mains mode
+//
+// Nominal frequency, 50 or 60.  Each reading is a gate of whole cycles up to
+// MAINS_GATE_MS long, and the average is over the last MAINS_WINDOW gates, which use
+// 10 bytes of RAM each.  RoCoF is measured between a gate and the one MAINS_ROCOF_GATES
+// before it, which must be less than MAINS_WINDOW.
+#define MAINS_NOMINAL_HZ        50
+#define MAINS_GATE_MS           1000
+#define MAINS_WINDOW            10
+#define MAINS_ROCOF_GATES       1
+
+// Event limits.  An event ends when the reading is back inside MAINS_HYSTERESIS_PCT of
+// the limit.  The last MAINS_EVENTS events are kept, using 14 bytes of RAM each.
+#define MAINS_DEVIATION_MHZ     200
+#define MAINS_ROCOF_MHZ_S       500
+#define MAINS_HYSTERESIS_PCT    10
+#define MAINS_LOSS_MS           100
+#define MAINS_EVENTS            8
+
+// Error of the 16MHz clock in ppm, positive if it runs fast, to correct the readings.
+// Leave it at zero with TEMPCO_ENABLE, which corrects the clock from its calibration.
+#define MAINS_CLOCK_PPM         0
+
+
+// Temperature compensation
+//
+// Set TEMPCO_ENABLE to 1 to correct the timebase with the clock error curve that the
+// tempco calibration mode saved in EEPROM.  Each temperature reading averages
+// TEMPCO_SAMPLES conversions of the internal sensor, of 104us each.
+#ifndef TEMPCO_ENABLE
+#define TEMPCO_ENABLE           0
+#endif
+#define TEMPCO_SAMPLES          256
+
+// Tempco calibration mode
+//
+// Frequency of the reference on D5, which must be much more stable than the board's
+// clock, such as a GPS 1PPS output, and the gate time of each point.
+#define TEMPCO_REF_HZ           1
+#define TEMPCO_CAL_GATE_MS      10000
+
+
+// Engines used by the selected mode.  These are derived from SUPERFREQ_MODE and
+// should not need to be edited.
+#define USE_COUNTER         ((SUPERFREQ_MODE == MODE_COUNTER) || (SUPERFREQ_MODE == MODE_DRIFT) || \
+                             (SUPERFREQ_MODE == MODE_DASHBOARD) || \
+                             (SUPERFREQ_MODE == MODE_LOGGER) || \
+                             (SUPERFREQ_MODE == MODE_SYNC) || \
+                             (SUPERFREQ_MODE == MODE_RATIO) || \
+                             (SUPERFREQ_MODE == MODE_TEMPCO))
+#define USE_CAPTURE         ((SUPERFREQ_MODE == MODE_BURST) || (SUPERFREQ_MODE == MODE_TRIGGER) || \
+                             (SUPERFREQ_MODE == MODE_SETTLE) || \
+                             (SUPERFREQ_MODE == MODE_GATED) || \
+                             (SUPERFREQ_MODE == MODE_SLAVE) || \
+                             (SUPERFREQ_MODE == MODE_SWEEP) || \
+                             (SUPERFREQ_MODE == MODE_PIPELINE) || \
+                             (SUPERFREQ_MODE == MODE_FSK) || \
+                             (SUPERFREQ_MODE == MODE_MAINS))
+#define USE_COUNTER_AUX     (SUPERFREQ_MODE == MODE_RATIO)
+#define USE_CAPTURE_GATE    (SUPERFREQ_MODE == MODE_GATED)
+#define USE_SYNC            (SUPERFREQ_MODE == MODE_SYNC)
+#define USE_SDCARD          (SUPERFREQ_MODE == MODE_LOGGER)
+#define USE_TEMPCO          ((SUPERFREQ_MODE == MODE_TEMPCO) || TEMPCO_ENABLE)
+#define USE_DISPLAY         ((SUPERFREQ_MODE != MODE_SLAVE) || SLAVE_DISPLAY)
+
+// The display is bit-banged on A5 (SCL) and A4 (SDA), which the I2C slave needs for
+// the hardware TWI, so that configuration moves it to D6 (SCL) and D7 (SDA).
+#if (SUPERFREQ_MODE == MODE_SLAVE) && (SLAVE_BUS == SLAVE_BUS_I2C)
+#define DISPLAY_SCL_PORT    PORTD
+#define DISPLAY_SCL_DDR     DDRD
+#define DISPLAY_SCL_PIN     PD6
+#define DISPLAY_SDA_PORT    PORTD
+#define DISPLAY_SDA_DDR     DDRD
+#define DISPLAY_SDA_PIN     PD7
+#endif
+
+#endif
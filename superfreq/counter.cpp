@@ -0,0 +1,278 @@
+#include "superfreq.h"
+#include "counter.h"
+#include "tempco.h"
+#include "timebase.h"
+#include "bench.h"
+
+#if USE_COUNTER
+
+const byte COUNTER_PIN = 5;     // T1, the Timer1 external clock input
+const byte COUNTER_AUX_PIN = 4; // T0, the Timer0 external clock input
+
+// Written by the compare ISR, read by counterPoll
+volatile uint16_t counterOverflows;     // Timer1 overflows, upper 16 bits of the edge count
+volatile uint32_t captureTicks;
+volatile uint32_t captureCount;
+volatile uint32_t captureAux;
+volatile bool captureReady;
+
+// Gate state, only used outside of the ISRs
+static bool fGateOpen;
+static bool fArmed;
+static uint32_t openTicks;
+static uint32_t openCount;
+static uint32_t openAux;
+
+
+ISR(TIMER1_OVF_vect) {
+    counterOverflows++;
+}
+
+
+#if USE_COUNTER_AUX
+// Timer0 wraps, upper 24 bits of the D4 edge count
+static volatile uint32_t auxWraps;
+
+// The Arduino core owns the Timer0 overflow vector for millis(), so the wraps are
+// counted with a compare match on zero instead, which fires as the count wraps.
+ISR(TIMER0_COMPA_vect) {
+    auxWraps++;
+}
+
+// Read the D4 edge count.  Interrupts must be disabled.  A pending wrap belongs to
+// this read only if the count has already wrapped.
+static inline uint32_t auxNowFromIsr(void) {
+    uint8_t c = TCNT0;
+    uint32_t w = auxWraps;
+    if ((TIFR0 & _BV(OCF0A)) && (c < 0x80)) {
+        w++;
+    }
+    return (w << 8) | c;
+}
+#else
+static inline uint32_t auxNowFromIsr(void) { return 0; }
+#endif
+
+// The compare match fires on the counted edge that was armed.  Read the timebase
+// first so that the time between the edge and the read is as constant as possible.
+// The edge number is the compare value, extended to 32 bits with the overflow count.
+// If an overflow is pending, it belongs to this edge only if the compare value is
+// past the wrap.
+ISR(TIMER1_COMPA_vect) {
+    uint32_t t = timebaseNowFromIsr();
+    uint32_t aux = auxNowFromIsr();
+    BENCH_ON(BENCH_ISR);
+    uint16_t c = OCR1A;
+    uint16_t ov = counterOverflows;
+    if ((TIFR1 & _BV(TOV1)) && (c < 0x8000)) {
+        ov++;
+    }
+    TIMSK1 &= ~_BV(OCIE1A);     // one capture per arm
+    captureTicks = t;
+    captureCount = ((uint32_t)ov << 16) | c;
+    captureAux = aux;
+    captureReady = true;
+    BENCH_OFF(BENCH_ISR);
+}
+
+
+// armEdge
+//
+// Set the compare match to fire on an upcoming input edge.  The compare value must
+// be written before the counter reaches it, which is a race at high input rates.  If
+// the counter has already caught up when it is checked, the margin is doubled and the
+// arm is retried.  At low rates the margin stays at one, so the very next edge is used.
+static void armEdge(void) {
+    uint16_t margin = 1;
+    uint16_t n;
+
+    uint8_t oldSREG = SREG;
+    cli();
+    for (;;) {
+        n = TCNT1;
+        OCR1A = n + margin;
+        TIFR1 = _BV(OCF1A);
+        if ((uint16_t)(TCNT1 - n) < margin)  break;
+        margin <<= 1;
+    }
+    TIMSK1 |= _BV(OCIE1A);
+    SREG = oldSREG;
+}
+
+
+#if USE_COUNTER_AUX
+// counterAuxBegin
+//
+// Take Timer0 from the Arduino core and count rising edges on T0 with it.  Call before
+// counterBegin.  This stops millis(), micros() and delay().
+void counterAuxBegin(void) {
+    pinMode(COUNTER_AUX_PIN, INPUT_PULLUP);
+
+    uint8_t oldSREG = SREG;
+    cli();
+    TIMSK0 = 0;
+    TCCR0A = 0;                                     // normal mode, no PWM outputs
+    TCCR0B = _BV(CS02) | _BV(CS01) | _BV(CS00);     // external clock on T0, rising edge
+    TCNT0 = 0;
+    OCR0A = 0;
+    auxWraps = 0;
+    TIFR0 = _BV(OCF0A) | _BV(TOV0);
+    TIMSK0 = _BV(OCIE0A);
+    SREG = oldSREG;
+}
+#endif
+
+
+// counterBegin
+//
+// Start Timer1 counting rising edges on T1 and arm the first gate.  The timebase
+// must already be running.
+void counterBegin(void) {
+    pinMode(COUNTER_PIN, INPUT_PULLUP);
+
+    uint8_t oldSREG = SREG;
+    cli();
+    TCCR1A = 0;
+    TCCR1B = _BV(CS12) | _BV(CS11) | _BV(CS10);     // external clock on T1, rising edge
+    TCNT1 = 0;
+    counterOverflows = 0;
+    captureReady = false;
+    TIFR1 = _BV(TOV1) | _BV(OCF1A);
+    TIMSK1 = _BV(TOIE1);
+    SREG = oldSREG;
+
+    fGateOpen = false;
+    fArmed = true;
+    armEdge();
+}
+
+
+// counterPoll
+//
+// Call frequently from loop().  Returns true and fills in gate when a gate has
+// closed.  The closing edge opens the next gate, which is armed to close once
+// gateTicks have elapsed.
+//
+// If the input stops while a gate is open, the gate is abandoned after
+// COUNTER_TIMEOUT_MS so that a very long gate can't wrap the timebase.  The
+// next edge then opens a fresh gate.
+bool counterPoll(uint32_t gateTicks, CounterGate & gate) {
+    bool fDone = false;
+
+    if (captureReady) {
+        cli();
+        uint32_t t = captureTicks;
+        uint32_t c = captureCount;
+        uint32_t aux = captureAux;
+        captureReady = false;
+        sei();
+
+        fArmed = false;
+        if (fGateOpen) {
+            gate.edges = c - openCount;
+            gate.ticks = tempcoTicks(t - openTicks);
+            gate.end = t;
+            gate.auxEdges = aux - openAux;
+            fDone = true;
+        }
+        fGateOpen = true;
+        openTicks = t;
+        openCount = c;
+        openAux = aux;
+    }
+
+    if (!fArmed) {
+        if (timebaseNow() - openTicks >= gateTicks) {
+            fArmed = true;
+            armEdge();
+        }
+    } else if (fGateOpen && (timebaseNow() - openTicks > gateTicks + timebaseTicksFromMs(COUNTER_TIMEOUT_MS))) {
+        fGateOpen = false;
+    }
+
+    return fDone;
+}
+
+
+// counterDecimals
+//
+// One timebase tick is the resolution of a gate measurement.  Returns the number of
+// decimal places of the frequency f that the resolution supports, up to three.
+int counterDecimals(float f, const CounterGate & gate) {
+    float res = f / gate.ticks;
+    int prec = 0;
+    for (float step = 0.1; (prec < 3) && (res < step); step /= 10.0) {
+        prec++;
+    }
+    return prec;
+}
+
+#endif
+
+
+#if SUPERFREQ_MODE == MODE_COUNTER
+
+static unsigned long lastGateMs;
+static bool fNoInput;
+
+// The labels and units either side of the readings
+static TextField freqLabel(display, 0, 0, 5, true);
+static TextField gateLabel(display, 2, 0, 5, true);
+static TextField countLabel(display, 4, 0, 5, true);
+static TextField resLabel(display, 6, 0, 5, true);
+static TextField freqUnit(display, 0, 14*8, 2, true);
+static TextField gateUnit(display, 2, 14*8, 2, true);
+static TextField countUnit(display, 4, 14*8, 2, true);
+static TextField resUnit(display, 6, 13*8, 3, true);
+static TextField * const labels[] = {
+    &freqLabel, &gateLabel, &countLabel, &resLabel,
+    &freqUnit, &gateUnit, &countUnit, &resUnit
+};
+
+void counterSetup(void) {
+    freqLabel.set("Freq:");
+    gateLabel.set("Gate:");
+    countLabel.set("Cnt:");
+    resLabel.set("Res:");
+    freqUnit.set("Hz");
+    gateUnit.set(" s");
+    resUnit.set("ppm");
+    flushFields(labels, sizeof(labels) / sizeof(labels[0]));
+    displayRefresh.setFields(labels, sizeof(labels) / sizeof(labels[0]));
+
+    timebaseBegin();
+    counterBegin();
+    lastGateMs = millis();
+}
+
+
+void counterLoop(void) {
+    char buffer[20];
+    CounterGate gate;
+
+    if (counterPoll(timebaseTicksFromMs(COUNTER_GATE_MS), gate)) {
+        lastGateMs = millis();
+        fNoInput = false;
+
+        float seconds = (float)gate.ticks / TIMEBASE_HZ;
+        float f = gate.edges / seconds;
+
+        dtostrf(f, 9, counterDecimals(f, gate), buffer);
+        display.text2x(0, 5*8, buffer);
+
+        dtostrf(seconds, 9, 4, buffer);
+        display.text2x(2, 5*8, buffer);
+
+        snprintf(buffer, sizeof(buffer), "%9lu", (unsigned long)gate.edges);
+        display.text2x(4, 5*8, buffer);
+
+        dtostrf(1000000.0 / gate.ticks, 8, 3, buffer);
+        display.text2x(6, 5*8, buffer);
+
+    } else if (!fNoInput && (millis() - lastGateMs > COUNTER_TIMEOUT_MS)) {
+        fNoInput = true;
+        display.text2x(0, 5*8, " no input");
+    }
+}
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef COUNTER_H
+#define COUNTER_H
+
+#include <Arduino.h>
+
+// Edge-gated reciprocal counter
+//
+// Input edges on D5 (T1) are counted in hardware by Timer1, so there is no per-edge
+// interrupt and the input can run at several MHz.  A plain counter with a fixed gate
+// time is off by plus or minus one count depending on where the gate falls relative
+// to the input edges.  Here the gate is synchronized to the input instead: it opens
+// on an input edge and closes on the first input edge after the nominal gate time.
+// Each gate contains an exact whole number of input periods and only the elapsed
+// time needs to be measured, which is done with the 0.5us timebase.
+//
+// The gate edges are caught with a Timer1 compare match set to fire on the next
+// counted edge.  The timebase is read at the top of the compare ISR, so the fixed
+// interrupt latency cancels between the opening and closing edges.  Only two
+// interrupts are taken per gate, and the closing edge of one gate is the opening
+// edge of the next, so there is no dead time between gates.
+//
+// With USE_COUNTER_AUX, Timer0 also counts rising edges on D4 (T0) and the count is
+// read in the same compare ISR, so both signals are counted over nearly the same gate.
+// The gate is aligned to the D5 edges, so the D5 count is exact.  The D4 count is read
+// when the ISR starts rather than on the D5 edge, and the interrupt latency varies by a
+// few microseconds, more if another interrupt is running, so D4 edges in that time can
+// land in the wrong gate.  The D4 count is within one plus the D4 edges in that spread,
+// which is several counts at MHz rates.  Timer0 is then no longer available to the
+// Arduino core, so millis(), micros() and delay() stop.  The timebase on Timer2 keeps
+// the time instead.
+
+struct CounterGate {
+    uint32_t edges;     // rising input edges counted during the gate
+    uint32_t ticks;     // timebase ticks from the opening edge to the closing edge
+    uint32_t end;       // timebase ticks at the closing edge
+    uint32_t auxEdges;  // rising edges on D4 during the gate, with USE_COUNTER_AUX
+};
+
+void counterAuxBegin(void);
+void counterBegin(void);
+bool counterPoll(uint32_t gateTicks, CounterGate & gate);
+int counterDecimals(float f, const CounterGate & gate);
+
+void counterSetup(void);
+void counterLoop(void);
+
+#endif
@@ -0,0 +1,161 @@
+#include "superfreq.h"
+#include "dashboard.h"
+#include "counter.h"
+#include "refresh.h"
+#include "textfield.h"
+#include "timebase.h"
+
+#if SUPERFREQ_MODE == MODE_DASHBOARD
+
+static SSD1306Display display2(SSD1306Display::ALTERNATE_ADDRESS);
+
+// Panel 1
+static TextField freqLabel(display, 0, 0, 21, false);
+static TextField gateLabel(display, 5, 0, 4, false);
+static TextField resLabel(display, 7, 0, 4, false);
+static TextField freqField(display, 2, 0, 16, true);
+static TextField gateField(display, 5, 6*6, 15, false);
+static TextField resField(display, 7, 6*6, 15, false);
+
+// Panel 2
+static TextField titleLabel(display2, 0, 0, 10, false);
+static TextField countLabel(display2, 1, 0, 5, false);
+static TextField meanLabel(display2, 2, 0, 5, false);
+static TextField minLabel(display2, 3, 0, 5, false);
+static TextField maxLabel(display2, 4, 0, 5, false);
+static TextField sdevLabel(display2, 5, 0, 5, false);
+static TextField spanLabel(display2, 6, 0, 5, false);
+static TextField busLabel(display2, 7, 0, 5, false);
+static TextField countField(display2, 1, 6*6, 15, false);
+static TextField meanField(display2, 2, 6*6, 15, false);
+static TextField minField(display2, 3, 6*6, 15, false);
+static TextField maxField(display2, 4, 6*6, 15, false);
+static TextField sdevField(display2, 5, 6*6, 15, false);
+static TextField spanField(display2, 6, 6*6, 15, false);
+static TextField busField(display2, 7, 6*6, 15, false);
+
+// The labels are fields too, so that the background refresh can repair them.
+static TextField * const fields1[] = {
+    &freqLabel, &gateLabel, &resLabel,
+    &freqField, &gateField, &resField
+};
+static TextField * const fields2[] = {
+    &titleLabel, &countLabel, &meanLabel, &minLabel, &maxLabel, &sdevLabel, &spanLabel, &busLabel,
+    &countField, &meanField, &minField, &maxField, &sdevField, &spanField, &busField
+};
+
+static RefreshScheduler refresh1(display, fields1, sizeof(fields1) / sizeof(fields1[0]),
+                                 REFRESH_BYTES_PER_SEC, TIMEBASE_HZ);
+static RefreshScheduler refresh2(display2, fields2, sizeof(fields2) / sizeof(fields2[0]),
+                                 REFRESH_BYTES_PER_SEC, TIMEBASE_HZ);
+
+// Running statistics.  Readings are kept relative to the first reading so that the
+// float math only has to hold the small differences.
+static uint32_t count;
+static float origin;
+static float mean;
+static float m2;
+static float minValue;
+static float maxValue;
+
+
+static void resetStats(void) {
+    count = 0;
+}
+
+
+// addStat
+//
+// Welford's running mean and variance.
+static void addStat(float f) {
+    if (count == 0) {
+        origin = f;
+        mean = m2 = 0.0;
+        minValue = maxValue = f;
+    }
+    if (f < minValue)  minValue = f;
+    if (f > maxValue)  maxValue = f;
+
+    float x = f - origin;
+    count++;
+    float delta = x - mean;
+    mean += delta / count;
+    m2 += delta * (x - mean);
+}
+
+
+static void setFloat(TextField & field, float f, int prec, const char * units) {
+    char number[16];
+    char buffer[24];
+    dtostrf(f, 11, prec, number);
+    snprintf(buffer, sizeof(buffer), "%s %s", number, units);
+    field.set(buffer);
+}
+
+
+void dashboardSetup(void) {
+    display2.initialize();
+    display2.clear();
+
+    freqLabel.set("Frequency          Hz");
+    gateLabel.set("Gate");
+    resLabel.set("Res");
+    titleLabel.set("Statistics");
+    countLabel.set("Count");
+    meanLabel.set("Mean");
+    minLabel.set("Min");
+    maxLabel.set("Max");
+    sdevLabel.set("SDev");
+    spanLabel.set("Span");
+    busLabel.set("Bus");
+    flushFields(fields1, sizeof(fields1) / sizeof(fields1[0]));
+    flushFields(fields2, sizeof(fields2) / sizeof(fields2[0]));
+
+    resetStats();
+    timebaseBegin();
+    counterBegin();
+}
+
+
+void dashboardLoop(void) {
+    if (Serial.read() == 'r') {
+        resetStats();
+    }
+
+    CounterGate gate;
+    if (!counterPoll(timebaseTicksFromMs(DASHBOARD_GATE_MS), gate) || (gate.edges == 0)) {
+        uint32_t now = timebaseNow();
+        refresh1.idle(now);
+        refresh2.idle(now);
+        return;
+    }
+
+    char buffer[24];
+    float seconds = (float)gate.ticks / TIMEBASE_HZ;
+    float f = gate.edges / seconds;
+    int prec = counterDecimals(f, gate);
+    addStat(f);
+
+    dtostrf(f, 16, prec, buffer);
+    freqField.set(buffer);
+    setFloat(gateField, seconds, 4, "s");
+    setFloat(resField, 1000000.0 / gate.ticks, 3, "ppm");
+
+    snprintf(buffer, sizeof(buffer), "%11lu", (unsigned long)count);
+    countField.set(buffer);
+    setFloat(meanField, origin + mean, prec, "Hz");
+    setFloat(minField, minValue, prec, "Hz");
+    setFloat(maxField, maxValue, prec, "Hz");
+    setFloat(sdevField, (count > 1) ? sqrt(m2 / (count - 1)) : 0.0, prec, "Hz");
+    setFloat(spanField, maxValue - minValue, prec, "Hz");
+
+    // The bus field shows the bytes sent for the previous update, so it changes at
+    // most once and does not feed back into its own count.
+    static uint16_t lastBytes;
+    snprintf(buffer, sizeof(buffer), "%11u B", lastBytes);
+    busField.set(buffer);
+    lastBytes = flushFields(fields1, sizeof(fields1) / sizeof(fields1[0])) +
+                flushFields(fields2, sizeof(fields2) / sizeof(fields2[0]));
+}
+
+#endif
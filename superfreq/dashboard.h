@@ -0,0 +1,25 @@
+#ifndef DASHBOARD_H
+#define DASHBOARD_H
+
+#include <Arduino.h>
+
+// Two panel dashboard
+//
+// Drives two SSD1306 displays on the same SCL and SDA pins, one at the default
+// address 0x3c and one at 0x3d.  The first panel shows the frequency from the
+// reciprocal counter on D5 and the second shows running statistics of the readings.
+//
+// Every value on both panels is a TextField.  The fields are all set first and then
+// flushed together, and each field only sends the characters that changed, so updating
+// both panels usually takes less bus time than a full redraw of one panel did.  The
+// number of bus bytes sent for the last update is shown on the second panel.
+// Between gates each panel slowly re-sends its fields and configuration, see
+// RefreshScheduler, so a missed I2C transfer or a panel reset repairs itself.
+//
+// Serial commands:
+//   r    reset the statistics
+
+void dashboardSetup(void);
+void dashboardLoop(void);
+
+#endif
@@ -0,0 +1,276 @@
+#include "superfreq.h"
+#include "drift.h"
+#include "counter.h"
+#include "timebase.h"
+
+#if SUPERFREQ_MODE == MODE_DRIFT
+
+// Number of buckets of one level that make up a bucket of the next level
+static const uint8_t DECIMATION = 60;
+static const uint16_t bucketSeconds[DRIFT_LEVELS] = { 1, 60, 3600 };
+
+struct DriftLevel {
+    DriftBucket ring[DRIFT_BUCKETS];
+    uint8_t next;           // ring index of the next bucket to be written
+    uint8_t count;          // number of valid buckets, up to DRIFT_BUCKETS
+
+    // Buckets of this level accumulated toward the next bucket of the level above
+    int16_t accMin;
+    int16_t accMax;
+    int32_t accSum;
+    uint8_t accCount;
+};
+
+static DriftLevel levels[DRIFT_LEVELS];
+
+
+void driftReset(void) {
+    memset(levels, 0, sizeof(levels));
+}
+
+
+// addBucket
+//
+// Store a completed bucket in a level and fold it into the accumulator for the next
+// level up.  When the accumulator is full it becomes a bucket of the next level.
+static void addBucket(uint8_t ixLevel, const DriftBucket & b) {
+    DriftLevel & level = levels[ixLevel];
+
+    level.ring[level.next] = b;
+    if (++level.next >= DRIFT_BUCKETS)  level.next = 0;
+    if (level.count < DRIFT_BUCKETS)  level.count++;
+
+    if (ixLevel + 1 >= DRIFT_LEVELS)  return;
+
+    if (level.accCount == 0) {
+        level.accMin = b.min;
+        level.accMax = b.max;
+        level.accSum = 0;
+    } else {
+        if (b.min < level.accMin)  level.accMin = b.min;
+        if (b.max > level.accMax)  level.accMax = b.max;
+    }
+    level.accSum += b.mean;
+
+    if (++level.accCount >= DECIMATION) {
+        DriftBucket up;
+        up.min = level.accMin;
+        up.max = level.accMax;
+        up.mean = level.accSum / DECIMATION;
+        level.accCount = 0;
+        addBucket(ixLevel + 1, up);
+    }
+}
+
+
+// driftAdd
+//
+// Log one reading.  Each reading is a bucket of the seconds level.
+void driftAdd(int16_t deviation) {
+    DriftBucket b;
+    b.min = b.max = b.mean = deviation;
+    addBucket(DRIFT_SECONDS, b);
+}
+
+
+uint8_t driftCount(uint8_t level) {
+    return levels[level].count;
+}
+
+
+// driftBucket
+//
+// Return a bucket of a level, where index zero is the oldest.
+const DriftBucket & driftBucket(uint8_t level, uint8_t ix) {
+    const DriftLevel & l = levels[level];
+    uint8_t first = (l.count < DRIFT_BUCKETS) ? 0 : l.next;
+    uint8_t n = first + ix;
+    if (n >= DRIFT_BUCKETS)  n -= DRIFT_BUCKETS;
+    return l.ring[n];
+}
+
+
+// driftSlope
+//
+// Least squares slope of the bucket means of a level, converted to ppm per minute.
+// Returns zero until the level has a few buckets.
+float driftSlope(uint8_t level) {
+    uint8_t n = driftCount(level);
+    if (n < 3)  return 0.0;
+
+    float sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (uint8_t ix = 0; ix < n; ix++) {
+        float y = driftBucket(level, ix).mean;
+        sx += ix;
+        sy += y;
+        sxx += (float)ix * ix;
+        sxy += ix * y;
+    }
+    float perBucket = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+
+    // Deviations are in 0.1ppm
+    return perBucket / 10.0 * 60.0 / bucketSeconds[level];
+}
+
+
+// driftExport
+//
+// Write every level to the serial port as CSV with deviations in ppm, oldest bucket
+// first.
+void driftExport(void) {
+    Serial.println(F("level,seconds,index,min_ppm,max_ppm,mean_ppm"));
+    for (uint8_t level = 0; level < DRIFT_LEVELS; level++) {
+        for (uint8_t ix = 0; ix < driftCount(level); ix++) {
+            const DriftBucket & b = driftBucket(level, ix);
+            Serial.print(level);
+            Serial.print(',');
+            Serial.print(bucketSeconds[level]);
+            Serial.print(',');
+            Serial.print(ix);
+            Serial.print(',');
+            Serial.print(b.min / 10.0, 1);
+            Serial.print(',');
+            Serial.print(b.max / 10.0, 1);
+            Serial.print(',');
+            Serial.println(b.mean / 10.0, 1);
+        }
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Drift mode display
+//
+// Rows 0..1 show the frequency, rows 2..3 show the drift rate and the range of the
+// plotted level in the small font, and rows 4..7 hold the sparkline.
+
+enum {
+    SPARK_ROW = 4,
+    SPARK_ROWS = 4,
+    SPARK_HEIGHT = SPARK_ROWS * 8,
+    SPARK_WIDTH = 128 / DRIFT_BUCKETS,
+    BAR_WIDTH = (SPARK_WIDTH > 1) ? SPARK_WIDTH - 1 : 1     // leave a gap between bars
+};
+
+static const char levelNames[DRIFT_LEVELS] = { 's', 'm', 'h' };
+
+static bool fHaveRef;
+static uint32_t refEdges;
+static uint32_t refTicks;
+static uint8_t plotLevel;
+
+
+// drawSparkline
+//
+// Draw each bucket of the plotted level as a vertical bar from its min to its max,
+// scaled to the range of the whole level.  The plot is built one display row at a
+// time so that only one row of pixels needs to be buffered.
+static void drawSparkline(int16_t lo, int16_t hi) {
+    uint8_t n = driftCount(plotLevel);
+    int32_t span = (hi > lo) ? hi - lo : 1;
+    uint8_t pixels[128];
+
+    for (uint8_t row = 0; row < SPARK_ROWS; row++) {
+        memset(pixels, 0, sizeof(pixels));
+        for (uint8_t ix = 0; ix < n; ix++) {
+            const DriftBucket & b = driftBucket(plotLevel, ix);
+            // Pixel zero is the top of the plot
+            int8_t yTop = (SPARK_HEIGHT - 1) - (int32_t)(b.max - lo) * (SPARK_HEIGHT - 1) / span;
+            int8_t yBottom = (SPARK_HEIGHT - 1) - (int32_t)(b.min - lo) * (SPARK_HEIGHT - 1) / span;
+            uint8_t bits = 0;
+            for (int8_t y = yTop; y <= yBottom; y++) {
+                if ((y >> 3) == row)  bits |= 1 << (y & 7);
+            }
+            for (uint8_t col = 0; col < BAR_WIDTH; col++) {
+                pixels[ix * SPARK_WIDTH + col] = bits;
+            }
+        }
+        display.fillAreaWithBytes(SPARK_ROW + row, 0, 1, 128, pixels, sizeof(pixels));
+    }
+}
+
+
+static void drawTrend(void) {
+    char buffer[24];
+    char number[12];
+    uint8_t n = driftCount(plotLevel);
+    int16_t lo = 0;
+    int16_t hi = 0;
+
+    for (uint8_t ix = 0; ix < n; ix++) {
+        const DriftBucket & b = driftBucket(plotLevel, ix);
+        if ((ix == 0) || (b.min < lo))  lo = b.min;
+        if ((ix == 0) || (b.max > hi))  hi = b.max;
+    }
+
+    dtostrf(driftSlope(plotLevel), 8, 3, number);
+    snprintf(buffer, sizeof(buffer), "Drift%s ppm/m", number);
+    display.text(2, 0, buffer);
+
+    char loText[8];
+    char hiText[8];
+    dtostrf(lo / 10.0, 6, 1, loText);
+    dtostrf(hi / 10.0, 6, 1, hiText);
+    snprintf(buffer, sizeof(buffer), "%c%s ..%s ppm", levelNames[plotLevel], loText, hiText);
+    display.text(3, 0, buffer);
+
+    drawSparkline(lo, hi);
+}
+
+
+// The label and units either side of the frequency
+static TextField freqLabel(display, 0, 0, 5, true);
+static TextField freqUnit(display, 0, 14*8, 2, true);
+static TextField * const labels[] = { &freqLabel, &freqUnit };
+
+void driftSetup(void) {
+    freqLabel.set("Freq:");
+    freqUnit.set("Hz");
+    flushFields(labels, sizeof(labels) / sizeof(labels[0]));
+    displayRefresh.setFields(labels, sizeof(labels) / sizeof(labels[0]));
+
+    driftReset();
+    fHaveRef = false;
+    plotLevel = DRIFT_SECONDS;
+    timebaseBegin();
+    counterBegin();
+}
+
+
+void driftLoop(void) {
+    switch (Serial.read()) {
+        case 's':   plotLevel = DRIFT_SECONDS;  drawTrend();  break;
+        case 'm':   plotLevel = DRIFT_MINUTES;  drawTrend();  break;
+        case 'h':   plotLevel = DRIFT_HOURS;    drawTrend();  break;
+        case 'd':   driftExport();                            break;
+    }
+
+    CounterGate gate;
+    if (!counterPoll(timebaseTicksFromMs(1000), gate) || (gate.edges == 0)) {
+        return;
+    }
+
+    char buffer[20];
+    float f = (float)gate.edges * TIMEBASE_HZ / gate.ticks;
+    dtostrf(f, 9, counterDecimals(f, gate), buffer);
+    display.text2x(0, 5*8, buffer);
+
+    // The first reading is the reference.  The deviation f/fref - 1 is computed as
+    // a difference of exact integer cross products so that the float conversion only
+    // sees the small difference and not two nearly equal large numbers.
+    if (!fHaveRef) {
+        fHaveRef = true;
+        refEdges = gate.edges;
+        refTicks = gate.ticks;
+    }
+    int64_t num = (int64_t)gate.edges * refTicks - (int64_t)refEdges * gate.ticks;
+    float den = (float)refEdges * gate.ticks;
+    float dev = num / den * 1.0e7;      // 0.1ppm units
+    if (dev > INT16_MAX)  dev = INT16_MAX;
+    if (dev < -INT16_MAX)  dev = -INT16_MAX;
+
+    driftAdd((int16_t)dev);
+    drawTrend();
+}
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef DRIFT_H
+#define DRIFT_H
+
+#include <Arduino.h>
+
+// Drift logger
+//
+// Long-term frequency log for oscillator warm-up and temperature testing.  Each one
+// second counter gate is converted to a deviation from the first reading, in units
+// of 0.1ppm, and logged at three resolutions: seconds, minutes and hours.  Each level
+// is a fixed ring of DRIFT_BUCKETS buckets holding the min, max and mean of the
+// deviation over the bucket.  Every full set of 60 buckets at one level is decimated
+// into one bucket of the next level, so the log covers DRIFT_BUCKETS hours in a few
+// hundred bytes of RAM.
+//
+// The drift rate in ppm per minute is the slope of a least squares line through the
+// bucket means of the displayed level.  The displayed level is drawn as a min/max
+// sparkline under the readings.
+//
+// Serial commands:
+//   s, m, h    show the seconds, minutes or hours level
+//   d          dump all levels as CSV
+
+enum {
+    DRIFT_SECONDS,
+    DRIFT_MINUTES,
+    DRIFT_HOURS,
+    DRIFT_LEVELS
+};
+
+struct DriftBucket {
+    int16_t min;        // deviations in units of 0.1ppm
+    int16_t max;
+    int16_t mean;
+};
+
+void driftReset(void);
+void driftAdd(int16_t deviation);
+uint8_t driftCount(uint8_t level);
+const DriftBucket & driftBucket(uint8_t level, uint8_t ix);
+float driftSlope(uint8_t level);
+void driftExport(void);
+
+void driftSetup(void);
+void driftLoop(void);
+
+#endif
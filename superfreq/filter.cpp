@@ -0,0 +1,106 @@
+#include "filter.h"
+
+MedianFilter::MedianFilter(void) {
+    reset();
+}
+
+
+void MedianFilter::reset(void) {
+    next = 0;
+    count = 0;
+    nRejected = 0;
+}
+
+
+// add
+//
+// Add a sample to the window.  Returns true if the sample is accepted or false if it
+// is an outlier.  The MAD of a very steady signal can be zero, so deviations smaller
+// than 1/2^HAMPEL_MIN_SHIFT of the median are always accepted.  The factor of 1.5
+// approximates the 1.4826 that scales the MAD to a standard deviation.
+bool MedianFilter::add(uint32_t x) {
+    bool fAccept = true;
+
+    if (count >= MIN_SAMPLES) {
+        uint32_t med = median();
+        uint32_t limit = mad() * HAMPEL_THRESHOLD * 3 / 2;
+        uint32_t minLimit = med >> HAMPEL_MIN_SHIFT;
+        if (limit < minLimit) {
+            limit = minLimit;
+        }
+        uint32_t dev = (x > med) ? x - med : med - x;
+        if (dev > limit) {
+            fAccept = false;
+            nRejected++;
+        }
+    }
+
+    insert(x);
+    return fAccept;
+}
+
+
+// median
+//
+// Median of the samples in the window.  For an even number of samples this is the
+// upper of the two middle values.
+uint32_t MedianFilter::median(void) const {
+    return count ? sorted[count / 2] : 0;
+}
+
+
+// mad
+//
+// Median absolute deviation from the median.  The deviations of the samples below the
+// median grow moving down the sorted window and the deviations above grow moving up,
+// so the two sides are merged outwards from the median until the middle deviation is
+// reached.  The median itself is the first, zero, deviation.
+uint32_t MedianFilter::mad(void) const {
+    if (count == 0)  return 0;
+
+    int8_t m = count / 2;
+    uint32_t med = sorted[m];
+    int8_t lo = m - 1;
+    int8_t hi = m + 1;
+    uint32_t dev = 0;
+
+    for (uint8_t k = 0; k < count / 2; k++) {
+        if ((lo >= 0) && ((hi >= count) || (med - sorted[lo] <= sorted[hi] - med))) {
+            dev = med - sorted[lo--];
+        } else {
+            dev = sorted[hi++] - med;
+        }
+    }
+    return dev;
+}
+
+
+// insert
+//
+// Replace the oldest sample with x.  The oldest value is removed from the sorted copy
+// by shifting the values above it down, then x is inserted by shifting the larger values
+// up, as in one step of an insertion sort.
+void MedianFilter::insert(uint32_t x) {
+    uint8_t ix;
+
+    if (count == SIZE) {
+        uint32_t old = ring[next];
+        for (ix = 0; sorted[ix] != old; ix++)
+            ;
+        for (; ix < count - 1; ix++) {
+            sorted[ix] = sorted[ix + 1];
+        }
+        count--;
+    }
+
+    for (ix = count; (ix > 0) && (sorted[ix - 1] > x); ix--) {
+        sorted[ix] = sorted[ix - 1];
+    }
+    sorted[ix] = x;
+    count++;
+
+    ring[next] = x;
+    if (++next >= SIZE) {
+        next = 0;
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// MedianFilter
+//
+// Streaming median and Hampel outlier filter for period samples.  A single missed or
+// doubled edge produces a period that is twice or half of the true value, which would
+// pull an average far off.  Each new sample is compared with the median of the last
+// MEDIAN_WINDOW samples and rejected if it is further from the median than
+// HAMPEL_THRESHOLD times the scaled median absolute deviation (MAD) of the window.
+//
+// The window is kept both in arrival order and in sorted order.  Adding a sample
+// removes the oldest value from the sorted copy and inserts the new one, so the cost
+// per sample is a fixed number of compares and moves proportional to the window size,
+// with no sorting.  The MAD is found from the sorted copy by walking outwards from the
+// median, which is also linear in the window size.
+//
+// All samples, including rejected ones, enter the window, so that a real change in
+// frequency is followed after about half a window of samples.
+
+class MedianFilter {
+    enum {
+        SIZE = MEDIAN_WINDOW,
+        MIN_SAMPLES = 3         // accept everything until the window has this many
+    };
+
+    public:
+        MedianFilter(void);
+        void reset(void);
+
+        bool add(uint32_t x);
+        uint32_t median(void) const;
+        uint32_t mad(void) const;
+
+        uint32_t rejected(void) const { return nRejected; }
+        void clearRejected(void) { nRejected = 0; }
+
+    private:
+        uint32_t ring[SIZE];    // samples in arrival order
+        uint32_t sorted[SIZE];  // the same samples in ascending order
+        uint8_t next;           // ring index of the oldest sample once the window is full
+        uint8_t count;
+        uint32_t nRejected;
+
+        void insert(uint32_t x);
+};
+
+#endif
@@ -0,0 +1,224 @@
+#include "superfreq.h"
+#include "fsk.h"
+#include "capture.h"
+#include "tempco.h"
+#include "timebase.h"
+
+#if SUPERFREQ_MODE == MODE_FSK
+
+// Times in the PLL are in 1/256 timebase ticks, so that the symbol time keeps its
+// fraction.  They wrap every 8 seconds, so they are only ever compared by subtraction.
+#define SYMBOL_TICKS8   ((uint32_t)((256.0 * TIMEBASE_HZ) / FSK_BAUD + 0.5))
+#define MARK_TICKS      ((uint32_t)TIMEBASE_HZ / FSK_MARK_HZ)
+#define SPACE_TICKS     ((uint32_t)TIMEBASE_HZ / FSK_SPACE_HZ)
+#define SLICE_TICKS     ((uint32_t)(2.0 * TIMEBASE_HZ / (FSK_MARK_HZ + FSK_SPACE_HZ)))
+#define GAP_TICKS       (2 * SYMBOL_TICKS8 / 256)
+#define BITS_PER_LINE   64
+
+static bool fHaveRise;
+static uint32_t lastRise;
+static uint8_t level;               // sliced level of the last period, 1 for mark
+static bool fLocked;
+static uint32_t nextSample8;        // next sampling point
+static uint32_t lastBoundary8;
+static uint8_t lineBits;
+
+// Statistics since the last reset
+static uint32_t bits;
+static uint32_t offTone;
+static uint32_t glitches;
+static uint32_t boundaries;
+static float sumSquareError;        // in symbols squared
+static float peakError;
+static uint32_t markTicks;
+static uint32_t markPeriods;
+static uint32_t spaceTicks;
+static uint32_t spacePeriods;
+
+static unsigned long lastUpdateMs;
+
+
+static void resetStats(void) {
+    bits = 0;
+    offTone = 0;
+    glitches = 0;
+    boundaries = 0;
+    sumSquareError = 0.0;
+    peakError = 0.0;
+    markTicks = markPeriods = 0;
+    spaceTicks = spacePeriods = 0;
+}
+
+
+static void loseLock(void) {
+    if (lineBits) {
+        Serial.println();
+        lineBits = 0;
+    }
+    fLocked = false;
+}
+
+
+static bool nearTone(uint32_t period, uint32_t tone) {
+    uint32_t diff = (period > tone) ? period - tone : tone - period;
+    return diff <= tone * FSK_TOLERANCE_PCT / 100;
+}
+
+
+// boundary
+//
+// A change of tone was seen at t.  Move the sampling point a quarter of the way
+// towards half a symbol after it, or set it there if the PLL is not locked yet.
+static void boundary(uint32_t t8) {
+    if (!fLocked) {
+        nextSample8 = t8 + SYMBOL_TICKS8 / 2;
+        lastBoundary8 = t8;
+        fLocked = true;
+        return;
+    }
+
+    if (t8 - lastBoundary8 < SYMBOL_TICKS8 / 2) {
+        glitches++;
+    }
+    lastBoundary8 = t8;
+
+    // The expected boundary is half a symbol before the next sampling point, give or
+    // take whole symbols.  The error is wrapped into -1/2..1/2 symbol.
+    int32_t error = (int32_t)(t8 + SYMBOL_TICKS8 / 2 - nextSample8) % (int32_t)SYMBOL_TICKS8;
+    if (error >= (int32_t)SYMBOL_TICKS8 / 2)  error -= SYMBOL_TICKS8;
+    if (error < -(int32_t)SYMBOL_TICKS8 / 2)  error += SYMBOL_TICKS8;
+    nextSample8 += error / 4;
+
+    float e = (float)error / SYMBOL_TICKS8;
+    sumSquareError += e * e;
+    if (fabs(e) > peakError)  peakError = fabs(e);
+    boundaries++;
+}
+
+
+static void emitBit(uint8_t bit) {
+    Serial.write(bit ? '1' : '0');
+    bits++;
+    if (++lineBits >= BITS_PER_LINE) {
+        Serial.println();
+        lineBits = 0;
+    }
+}
+
+
+// addPeriod
+//
+// Slice a period that ran from lastRise to t and emit every sampling point in it.
+static void addPeriod(uint32_t t) {
+    uint32_t period = t - lastRise;
+    if (period > GAP_TICKS) {
+        loseLock();
+        return;
+    }
+
+    bool fLow = period > SLICE_TICKS;
+    uint8_t newLevel = (fLow == (FSK_MARK_HZ < FSK_SPACE_HZ)) ? 1 : 0;
+    if (newLevel) {
+        markTicks += period;
+        markPeriods++;
+    } else {
+        spaceTicks += period;
+        spacePeriods++;
+    }
+    if (!nearTone(period, MARK_TICKS) && !nearTone(period, SPACE_TICKS)) {
+        offTone++;
+    }
+
+    // The new tone started at about the beginning of this period
+    if (!fLocked || (newLevel != level)) {
+        boundary(lastRise << 8);
+    }
+    level = newLevel;
+
+    uint32_t t8 = t << 8;
+    while ((int32_t)(t8 - nextSample8) >= 0) {
+        emitBit(level);
+        nextSample8 += SYMBOL_TICKS8;
+    }
+}
+
+
+static void showStats(void) {
+    char buffer[24];
+    char number[12];
+
+    snprintf(buffer, sizeof(buffer), "Bits %10lu %s", (unsigned long)bits, fLocked ? "lock" : "    ");
+    display.text(1, 0, buffer);
+    snprintf(buffer, sizeof(buffer), "Off-tone %11lu", (unsigned long)offTone);
+    display.text(2, 0, buffer);
+    snprintf(buffer, sizeof(buffer), "Glitch %13lu", (unsigned long)glitches);
+    display.text(3, 0, buffer);
+
+    float rms = boundaries ? sqrt(sumSquareError / boundaries) * 100.0 : 0.0;
+    dtostrf(rms, 8, 1, number);
+    snprintf(buffer, sizeof(buffer), "Jitter rms %s %%", number);
+    display.text(4, 0, buffer);
+    dtostrf(peakError * 100.0, 8, 1, number);
+    snprintf(buffer, sizeof(buffer), "Jitter pk  %s %%", number);
+    display.text(5, 0, buffer);
+
+    char space[12];
+    dtostrf(markPeriods ? (float)markPeriods * TIMEBASE_HZ / tempcoTicks(markTicks) : 0.0, 7, 1, number);
+    dtostrf(spacePeriods ? (float)spacePeriods * TIMEBASE_HZ / tempcoTicks(spaceTicks) : 0.0, 7, 1, space);
+    snprintf(buffer, sizeof(buffer), "M %s S %s", number, space);
+    display.text(7, 0, buffer);
+}
+
+
+// The title, with the tones and baud rate
+static TextField titleLabel(display, 0, 0, 21, false);
+static TextField * const labels[] = { &titleLabel };
+
+void fskSetup(void) {
+    char buffer[24];
+    display.clear();
+    snprintf(buffer, sizeof(buffer), "FSK %u/%u @%u", FSK_MARK_HZ, FSK_SPACE_HZ, FSK_BAUD);
+    titleLabel.set(buffer);
+    titleLabel.flush();
+    displayRefresh.setFields(labels, sizeof(labels) / sizeof(labels[0]));
+
+    resetStats();
+    timebaseBegin();
+    captureBegin(RISING);
+    lastUpdateMs = millis();
+}
+
+
+void fskLoop(void) {
+    if (Serial.read() == 'r') {
+        resetStats();
+    }
+
+    CaptureEdge edge;
+    while (captureGet(edge)) {
+        if (fHaveRise) {
+            addPeriod(edge.ticks);
+        }
+        fHaveRise = true;
+        lastRise = edge.ticks;
+    }
+
+    if (captureTakeOverruns()) {
+        // A lost edge loses bits too, so start again from the next tone change
+        fHaveRise = false;
+        loseLock();
+    }
+
+    // The last period only ends with the next edge, so a carrier that stops is only
+    // seen here.
+    if (fLocked && (timebaseNow() - lastRise > GAP_TICKS)) {
+        loseLock();
+    }
+
+    if (millis() - lastUpdateMs >= FSK_UPDATE_MS) {
+        lastUpdateMs += FSK_UPDATE_MS;
+        showStats();
+    }
+}
+
+#endif
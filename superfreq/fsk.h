@@ -0,0 +1,36 @@
+#ifndef FSK_H
+#define FSK_H
+
+#include <Arduino.h>
+
+// FSK decoder
+//
+// Decodes a two tone FSK signal on D2, such as a Bell 202 modem or a tone signalling
+// line, one input period at a time as the capture engine delivers them.  Each period is
+// sliced against the frequency halfway between FSK_MARK_HZ and FSK_SPACE_HZ, so a
+// period is a mark (1) or a space (0) as soon as it ends.
+//
+// Symbol timing is recovered with a digital PLL at FSK_BAUD.  Every change between mark
+// and space is a symbol boundary, and the PLL moves its sampling point a quarter of the
+// way towards the middle of the symbols.  The start of the carrier sets the timing
+// directly.  Each sampling point takes the level of the input period it falls in, and
+// the bits are printed on the serial port as 0 and 1 characters, 64 to a line.  A gap
+// of more than two symbols with no input ends the line and drops lock.
+//
+// A change is only known to within one period of the tone, so the timing error of each
+// boundary is the jitter of the signal plus up to a tone period.  The display shows:
+//
+//   Bits       bits decoded
+//   Off-tone   periods further than FSK_TOLERANCE_PCT from both tones, which includes
+//              some of the periods that straddle a change of tone
+//   Glitch     boundaries less than half a symbol after the previous one
+//   Jitter     RMS and peak boundary timing error, as a percentage of a symbol
+//   M and S    the measured mark and space frequencies
+//
+// Serial commands:
+//   r    reset the statistics
+
+void fskSetup(void);
+void fskLoop(void);
+
+#endif
@@ -0,0 +1,181 @@
+#include "superfreq.h"
+#include "gated.h"
+#include "capture.h"
+#include "tempco.h"
+#include "timebase.h"
+
+#if SUPERFREQ_MODE == MODE_GATED
+
+// State of the current gated interval
+static bool fGateOpen;
+static uint32_t openTicks;      // start of the gate time not yet added to the total
+static bool fHaveRise;          // a rising edge has been seen in this interval
+static bool fHaveFall;          // a falling edge has been seen since that rising edge
+static uint32_t lastRise;
+static uint32_t lastFall;
+
+// Whole periods since the last update
+static uint32_t periods;
+static uint32_t periodTicks;
+static uint32_t highTicks;
+
+// Totals since the last reset
+static uint64_t gatedTicks;     // total gate time, kept in ticks so that none is rounded away
+static uint32_t intervals;
+
+static unsigned long lastUpdateMs;
+
+
+static void resetTotals(void) {
+    gatedTicks = 0;
+    intervals = 0;
+}
+
+
+// addGateTime
+//
+// Move the open gate time up to t into the total, so that the total stays up to date
+// while a long interval is still open.
+static void addGateTime(uint32_t t) {
+    gatedTicks += tempcoTicks(t - openTicks);
+    openTicks = t;
+}
+
+
+// formatGateTime
+//
+// The total gate time in seconds with four decimals, at least 9 characters.
+static void formatGateTime(char * buffer, uint8_t size) {
+    uint32_t seconds = gatedTicks / TIMEBASE_HZ;
+    uint16_t fraction = (gatedTicks % TIMEBASE_HZ) / (TIMEBASE_HZ / 10000);
+    snprintf(buffer, size, "%4lu.%04u", (unsigned long)seconds, fraction);
+}
+
+
+static void addEdge(const CaptureEdge & edge) {
+    if (edge.level & CAPTURE_GATE) {
+        bool fOpen = (edge.level & ~CAPTURE_GATE) == HIGH;
+        if (fOpen && !fGateOpen) {
+            openTicks = edge.ticks;
+            intervals++;
+        } else if (!fOpen && fGateOpen) {
+            addGateTime(edge.ticks);
+        }
+        fGateOpen = fOpen;
+
+        // The partial period at the end of the interval is not used, and the next
+        // interval starts from its own first rising edge.  An input edge just after the
+        // gate opens can be queued ahead of the opening edge, so only the close resets.
+        if (!fOpen)  fHaveRise = false;
+        return;
+    }
+
+    if (edge.level == HIGH) {
+        if (fHaveRise && fHaveFall) {
+            periods++;
+            periodTicks += edge.ticks - lastRise;
+            highTicks += lastFall - lastRise;
+        }
+        fHaveRise = true;
+        fHaveFall = false;
+        lastRise = edge.ticks;
+    } else if (fHaveRise) {
+        fHaveFall = true;
+        lastFall = edge.ticks;
+    }
+}
+
+
+// The labels and units either side of the readings
+static TextField freqLabel(display, 0, 0, 5, true);
+static TextField dutyLabel(display, 2, 0, 5, true);
+static TextField gateLabel(display, 4, 0, 5, true);
+static TextField countLabel(display, 6, 0, 5, true);
+static TextField freqUnit(display, 0, 14*8, 2, true);
+static TextField dutyUnit(display, 2, 14*8, 2, true);
+static TextField gateUnit(display, 4, 14*8, 2, true);
+static TextField countUnit(display, 6, 14*8, 2, true);
+static TextField * const labels[] = {
+    &freqLabel, &dutyLabel, &gateLabel, &countLabel,
+    &freqUnit, &dutyUnit, &gateUnit, &countUnit
+};
+
+void gatedSetup(void) {
+    freqLabel.set("Freq:");
+    dutyLabel.set("Duty:");
+    gateLabel.set("Gate:");
+    countLabel.set("Cnt:");
+    freqUnit.set("Hz");
+    dutyUnit.set(" %");
+    gateUnit.set(" s");
+    flushFields(labels, sizeof(labels) / sizeof(labels[0]));
+    displayRefresh.setFields(labels, sizeof(labels) / sizeof(labels[0]));
+
+    timebaseBegin();
+    resetTotals();
+    captureBegin(CHANGE);
+
+    // The gate may already be open, in which case there will be no opening edge
+    fGateOpen = (digitalRead(3) == GATE_ACTIVE_LEVEL);
+    if (fGateOpen) {
+        openTicks = timebaseNow();
+        intervals = 1;
+    }
+    lastUpdateMs = millis();
+}
+
+
+void gatedLoop(void) {
+    if (Serial.read() == 'r') {
+        resetTotals();
+        if (fGateOpen)  openTicks = timebaseNow();
+    }
+
+    CaptureEdge edge;
+    while (captureGet(edge)) {
+        addEdge(edge);
+    }
+
+    if (millis() - lastUpdateMs < GATED_UPDATE_MS) {
+        return;
+    }
+    lastUpdateMs += GATED_UPDATE_MS;
+
+    // Gate edges in the queue are older than now, so only take the open time up to
+    // now once the queue has been emptied above.
+    if (fGateOpen)  addGateTime(timebaseNow());
+
+    char buffer[20];
+    if (captureTakeOverruns()) {
+        // A lost edge could be a gate edge, so the current interval can't be trusted
+        fHaveRise = false;
+        display.text2x(0, 5*8, "  overrun");
+        display.text2x(2, 5*8, "        -");
+    } else if (periods) {
+        float hz = (float)periods * TIMEBASE_HZ / tempcoTicks(periodTicks);
+        dtostrf(hz, 9, 1, buffer);
+        display.text2x(0, 5*8, buffer);
+        dtostrf(100.0 * highTicks / periodTicks, 9, 2, buffer);
+        display.text2x(2, 5*8, buffer);
+
+        Serial.print(hz, 1);
+        Serial.print(',');
+        Serial.print(100.0 * highTicks / periodTicks, 2);
+        Serial.print(',');
+        formatGateTime(buffer, sizeof(buffer));
+        Serial.println(buffer + strspn(buffer, " "));
+    } else {
+        display.text2x(0, 5*8, fGateOpen ? " no input" : "   closed");
+        display.text2x(2, 5*8, "        -");
+    }
+    periods = 0;
+    periodTicks = 0;
+    highTicks = 0;
+
+    formatGateTime(buffer, sizeof(buffer));
+    display.text2x(4, 5*8, buffer);
+    snprintf(buffer, sizeof(buffer), "%9lu", (unsigned long)intervals);
+    display.text2x(6, 5*8, buffer);
+}
+
+#endif
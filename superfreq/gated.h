@@ -0,0 +1,25 @@
+#ifndef GATED_H
+#define GATED_H
+
+#include <Arduino.h>
+
+// Gated measurement
+//
+// Measures the signal on D2 only while the gate input on D3 is active, so that a DUT
+// clock can be measured during a particular condition, such as while a CPU's RUN line
+// is high, without an external AND gate.  The capture engine drops edges while the
+// gate is closed and queues the gate edges, see capture.h.
+//
+// Only whole input periods that lie inside one gated interval are used.  The period
+// that the gate cuts off at each end is discarded, so short intervals do not bias the
+// result.  Each update shows the frequency and duty cycle over the periods completed
+// since the last update, the total time the gate has been open, and the number of gated
+// intervals.
+//
+// Serial commands:
+//   r    reset the gate time and interval totals
+
+void gatedSetup(void);
+void gatedLoop(void);
+
+#endif
@@ -0,0 +1,45 @@
+#include "latency.h"
+
+LatencyProbe::LatencyProbe(void) {
+    reset();
+}
+
+
+void LatencyProbe::reset(void) {
+    n = 0;
+    for (uint8_t ix = 0; ix <= TOTAL; ix++) {
+        minUs[ix] = UINT32_MAX;
+        maxUs[ix] = 0;
+        sumUs[ix] = 0;
+    }
+}
+
+
+// mark
+//
+// Record the end of a stage.  The stages must be marked in order after start, and
+// marking DISPLAY completes the update and adds it to the statistics.  If the count
+// would overflow, the statistics start over.
+void LatencyProbe::mark(Stage stage) {
+    stageUs[stage] = micros();
+    if (stage != DISPLAY) {
+        return;
+    }
+
+    if (n == UINT16_MAX)  reset();
+    n++;
+
+    uint32_t prev = edgeUs;
+    for (uint8_t ix = 0; ix <= TOTAL; ix++) {
+        uint32_t us;
+        if (ix < TOTAL) {
+            us = stageUs[ix] - prev;
+            prev = stageUs[ix];
+        } else {
+            us = stageUs[DISPLAY] - edgeUs;
+        }
+        if (us < minUs[ix])  minUs[ix] = us;
+        if (us > maxUs[ix])  maxUs[ix] = us;
+        sumUs[ix] += us;
+    }
+}
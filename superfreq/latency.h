@@ -0,0 +1,52 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <Arduino.h>
+
+// LatencyProbe
+//
+// Measures how stale a displayed result is.  Each update is timed from the last input
+// edge that went into the result, through the stages of the update, to the last byte
+// of the display write.  The stages are:
+//
+//   WAIT       from the final edge until loop() starts the update
+//   COMPUTE    turning the accumulated samples into results
+//   FORMAT     converting the results to text
+//   DISPLAY    sending the text to the display
+//
+// The minimum, mean and maximum time of each stage and of the whole update are kept
+// in microseconds.  With SUPERFREQ_BENCH the bench markers show the same stages on
+// pins for a scope: BENCH_COMPUTE, then a gap while formatting, then BENCH_DISPLAY.
+
+class LatencyProbe {
+    public:
+        enum Stage {
+            WAIT,
+            COMPUTE,
+            FORMAT,
+            DISPLAY,
+            TOTAL,          // edge to last display byte, only for the statistics
+            STAGES = TOTAL
+        };
+
+        LatencyProbe(void);
+        void reset(void);
+
+        void start(uint32_t edgeUs)     { this->edgeUs = edgeUs; }
+        void mark(Stage stage);
+
+        uint16_t count(void) const      { return n; }
+        uint32_t minimum(uint8_t ix) const { return minUs[ix]; }
+        uint32_t maximum(uint8_t ix) const { return maxUs[ix]; }
+        uint32_t mean(uint8_t ix) const    { return n ? sumUs[ix] / n : 0; }
+
+    private:
+        uint32_t edgeUs;                // micros() at the final edge
+        uint32_t stageUs[STAGES];       // micros() at the end of each stage
+        uint16_t n;
+        uint32_t minUs[TOTAL + 1];
+        uint32_t maxUs[TOTAL + 1];
+        uint64_t sumUs[TOTAL + 1];
+};
+
+#endif
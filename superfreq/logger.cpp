@@ -0,0 +1,109 @@
+#include "superfreq.h"
+#include "logger.h"
+#include "blocklog.h"
+#include "counter.h"
+#include "sdcard.h"
+#include "timebase.h"
+
+#if SUPERFREQ_MODE == MODE_LOGGER
+
+static SdCard card;
+static BlockLog sdLog(card, sizeof(LoggerRecord));
+static bool fCardOk;
+static int8_t shownStatus = -1;
+
+
+// openLog
+//
+// (Re)initialize the card and continue or restart the log on it.  Any block that is
+// still being written is finished first.
+static void openLog(bool fNew) {
+    while ((sdLog.state() == BlockLog::SENDING) || (sdLog.state() == BlockLog::PROGRAMMING)) {
+        sdLog.poll();
+    }
+    fCardOk = card.begin() && sdLog.begin(LOGGER_FIRST_BLOCK, fNew);
+
+    Serial.print(F("log "));
+    if (fCardOk) {
+        Serial.print(sdLog.session());
+        Serial.print(F(" at block "));
+        Serial.println(sdLog.blocks());
+    } else {
+        Serial.println(F("no card"));
+    }
+}
+
+
+static void showStatus(void) {
+    int8_t status = !fCardOk ? 0 : (sdLog.state() == BlockLog::FAILED) ? 1 : 2;
+    if (status != shownStatus) {
+        static const char * const text[] = { "  no card", "   failed", "       ok" };
+        display.text2x(6, 5*8, text[status]);
+        shownStatus = status;
+    }
+}
+
+
+// The labels and units either side of the readings
+static TextField freqLabel(display, 0, 0, 5, true);
+static TextField blockLabel(display, 2, 0, 5, true);
+static TextField dropLabel(display, 4, 0, 5, true);
+static TextField cardLabel(display, 6, 0, 5, true);
+static TextField freqUnit(display, 0, 14*8, 2, true);
+static TextField blockUnit(display, 2, 14*8, 2, true);
+static TextField dropUnit(display, 4, 14*8, 2, true);
+static TextField cardUnit(display, 6, 14*8, 2, true);
+static TextField * const labels[] = {
+    &freqLabel, &blockLabel, &dropLabel, &cardLabel,
+    &freqUnit, &blockUnit, &dropUnit, &cardUnit
+};
+
+void loggerSetup(void) {
+    freqLabel.set("Freq:");
+    blockLabel.set("Blk:");
+    dropLabel.set("Drop:");
+    cardLabel.set("Card:");
+    freqUnit.set("Hz");
+    flushFields(labels, sizeof(labels) / sizeof(labels[0]));
+    displayRefresh.setFields(labels, sizeof(labels) / sizeof(labels[0]));
+
+    openLog(false);
+    timebaseBegin();
+    counterBegin();
+}
+
+
+void loggerLoop(void) {
+    char buffer[20];
+    CounterGate gate;
+
+    sdLog.poll();
+
+    switch (Serial.read()) {
+        case 'f':
+            sdLog.flush();
+            break;
+        case 'n':
+            openLog(true);
+            break;
+    }
+
+    if (counterPoll(timebaseTicksFromMs(LOGGER_GATE_MS), gate)) {
+        LoggerRecord record = { (uint32_t)millis(), gate.edges, gate.ticks };
+        sdLog.append(&record);
+
+        float f = gate.edges / ((float)gate.ticks / TIMEBASE_HZ);
+        dtostrf(f, 9, counterDecimals(f, gate), buffer);
+        display.text2x(0, 5*8, buffer);
+
+        snprintf(buffer, sizeof(buffer), "%9lu", (unsigned long)sdLog.blocks());
+        display.text2x(2, 5*8, buffer);
+
+        snprintf(buffer, sizeof(buffer), "%9lu", (unsigned long)sdLog.dropped());
+        display.text2x(4, 5*8, buffer);
+    }
+
+    showStatus();
+}
+
+#endif
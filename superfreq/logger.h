@@ -0,0 +1,33 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdint.h>
+
+// SD card logger
+//
+// Logs every gate of the reciprocal counter on D5 to an SD card, for runs that are too
+// long for the drift mode's RAM or for EEPROM.  The card is written with BlockLog as
+// raw 512 byte blocks starting at LOGGER_FIRST_BLOCK, 41 records per block, so a 1s
+// gate fills a 4GB card in years.  A block is written in small chunks between polls of
+// the counter, and the counter gates themselves are timed by interrupts, so a write
+// never changes a measurement.
+//
+// Records are counts rather than frequencies so that nothing is lost to rounding.  The
+// ticks are the gate length as the counter gives it, which is after the temperature
+// correction when TEMPCO_ENABLE is set, so the frequency is edges * 2000000 / ticks
+// either way.  tools/sflog2csv converts an image of the card to CSV.
+//
+// Serial commands:
+//   f    write the current block now, even though it isn't full
+//   n    start a new log at LOGGER_FIRST_BLOCK
+
+struct LoggerRecord {
+    uint32_t ms;            // millis() at the end of the gate
+    uint32_t edges;         // input edges in the gate
+    uint32_t ticks;         // gate length in 0.5us ticks, temperature corrected
+};
+
+void loggerSetup(void);
+void loggerLoop(void);
+
+#endif
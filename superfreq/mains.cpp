@@ -0,0 +1,391 @@
+#include "superfreq.h"
+#include "mains.h"
+#include "capture.h"
+#include "tempco.h"
+#include "timebase.h"
+
+#if SUPERFREQ_MODE == MODE_MAINS
+
+#define NOMINAL_MHZ     (MAINS_NOMINAL_HZ * 1000L)
+#define LOCKOUT_TICKS   ((uint32_t)TIMEBASE_HZ / MAINS_NOMINAL_HZ / 2)
+#define CLOCK_SCALE     (1.0 + MAINS_CLOCK_PPM * 1.0e-6)
+
+enum {
+    EVENT_UNDER,
+    EVENT_OVER,
+    EVENT_ROCOF,
+    EVENT_LOSS,
+    EVENT_TYPES
+};
+
+static const char * const eventNames[EVENT_TYPES] = { "under", "over", "rocof", "loss" };
+static const char * const eventAbbrevs[EVENT_TYPES] = { "und", "ovr", "roc", "los" };
+
+struct MainsGate {
+    uint16_t cycles;
+    uint32_t ticks;
+    uint32_t end;           // timebase time of the edge that closed the gate
+};
+
+struct MainsEvent {
+    uint32_t start;         // uptime in seconds
+    uint32_t seconds;       // duration, so far if it is still active
+    int32_t value;          // furthest frequency in mHz or RoCoF in mHz/s
+    uint8_t type;
+    bool fActive;
+};
+
+static MainsGate gates[MAINS_WINDOW];
+static uint8_t nextGate;
+static uint8_t gateCount;
+
+static MainsEvent events[MAINS_EVENTS];
+static uint8_t nextEvent;
+static uint8_t eventCount;
+static int8_t activeEvent[EVENT_TYPES];     // index of the active event of each type, or -1
+
+static bool fHaveEdge;
+static uint32_t lastEdge;
+static uint32_t gateStart;
+static uint16_t gateCycles;
+
+static bool fHaveRange;
+static float minHz;
+static float maxHz;
+
+static uint32_t uptime;                     // seconds
+static unsigned long lastSecondMs;
+
+
+static float gateHz(const MainsGate & g) {
+    return (float)g.cycles * TIMEBASE_HZ / g.ticks * CLOCK_SCALE;
+}
+
+
+// The gate ago gates before the latest one
+static const MainsGate & pastGate(uint8_t ago) {
+    return gates[(nextGate + 2 * MAINS_WINDOW - 1 - ago) % MAINS_WINDOW];
+}
+
+
+static void printTime(uint32_t seconds) {
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%lu:%02u:%02u", (unsigned long)(seconds / 3600),
+             (unsigned)(seconds / 60 % 60), (unsigned)(seconds % 60));
+    Serial.print(buffer);
+}
+
+
+static void printValue(const MainsEvent & e) {
+    if (e.type == EVENT_ROCOF) {
+        Serial.print(e.value / 1000.0, 3);
+        Serial.print(F(" Hz/s"));
+    } else if (e.type != EVENT_LOSS) {
+        Serial.print(e.value / 1000.0, 3);
+        Serial.print(F(" Hz"));
+    }
+}
+
+
+// How far past nominal a reading is in the direction of the event type
+static int32_t magnitude(uint8_t type, int32_t value) {
+    switch (type) {
+        case EVENT_UNDER:   return NOMINAL_MHZ - value;
+        case EVENT_OVER:    return value - NOMINAL_MHZ;
+        default:            return labs(value);
+    }
+}
+
+
+static void startEvent(uint8_t type, int32_t value) {
+    int8_t ix = nextEvent;
+    for (uint8_t t = 0; t < EVENT_TYPES; t++) {
+        if (activeEvent[t] == ix)  activeEvent[t] = -1;
+    }
+    if (++nextEvent >= MAINS_EVENTS)  nextEvent = 0;
+    if (eventCount < MAINS_EVENTS)  eventCount++;
+
+    MainsEvent & e = events[ix];
+    e.start = uptime;
+    e.seconds = 0;
+    e.value = value;
+    e.type = type;
+    e.fActive = true;
+    activeEvent[type] = ix;
+
+    Serial.print(F("# "));
+    printTime(e.start);
+    Serial.print(' ');
+    Serial.print(eventNames[type]);
+    Serial.print(F(" start"));
+    if (type != EVENT_LOSS) {
+        Serial.print(' ');
+        printValue(e);
+    }
+    Serial.println();
+}
+
+
+static void endEvent(uint8_t type) {
+    if (activeEvent[type] < 0)  return;
+    MainsEvent & e = events[activeEvent[type]];
+    activeEvent[type] = -1;
+    e.fActive = false;
+    e.seconds = uptime - e.start;
+
+    Serial.print(F("# "));
+    printTime(uptime);
+    Serial.print(' ');
+    Serial.print(eventNames[type]);
+    Serial.print(F(" end, "));
+    Serial.print(e.seconds);
+    Serial.print(F(" s"));
+    if (type != EVENT_LOSS) {
+        Serial.print(F(", peak "));
+        printValue(e);
+    }
+    Serial.println();
+}
+
+
+// watch
+//
+// Start, extend or end the event of one type from a new reading.  The event starts when
+// the reading is past the limit and ends when it is back inside the hysteresis.
+static void watch(uint8_t type, int32_t value, int32_t limit) {
+    int32_t m = magnitude(type, value);
+    if (activeEvent[type] < 0) {
+        if (m > limit)  startEvent(type, value);
+        return;
+    }
+
+    MainsEvent & e = events[activeEvent[type]];
+    if (m > magnitude(type, e.value))  e.value = value;
+    e.seconds = uptime - e.start;
+    if (m <= limit - limit * MAINS_HYSTERESIS_PCT / 100) {
+        endEvent(type);
+    }
+}
+
+
+static void resetLog(void) {
+    for (uint8_t t = 0; t < EVENT_TYPES; t++) {
+        activeEvent[t] = -1;
+    }
+    nextEvent = 0;
+    eventCount = 0;
+    fHaveRange = false;
+}
+
+
+static void listEvents(void) {
+    Serial.println(F("# start,event,seconds,peak"));
+    for (uint8_t n = eventCount; n > 0; n--) {
+        const MainsEvent & e = events[(nextEvent + MAINS_EVENTS - n) % MAINS_EVENTS];
+        Serial.print(F("# "));
+        printTime(e.start);
+        Serial.print(',');
+        Serial.print(eventNames[e.type]);
+        Serial.print(',');
+        Serial.print(e.seconds);
+        if (e.fActive)  Serial.print('+');
+        Serial.print(',');
+        printValue(e);
+        Serial.println();
+    }
+}
+
+
+static void showEvents(void) {
+    char buffer[24];
+    char number[12];
+    for (uint8_t n = 0; n < 3; n++) {
+        if (n >= eventCount) {
+            display.text(5 + n, 0, "                     ");
+            continue;
+        }
+        const MainsEvent & e = events[(nextEvent + MAINS_EVENTS - 1 - n) % MAINS_EVENTS];
+        if (e.type == EVENT_LOSS) {
+            snprintf(number, sizeof(number), "%5lus", (unsigned long)e.seconds);
+        } else {
+            dtostrf(e.value / 1000.0, 6, 3, number);
+        }
+        snprintf(buffer, sizeof(buffer), "%3lu:%02u:%02u %s %s%c", (unsigned long)(e.start / 3600),
+                 (unsigned)(e.start / 60 % 60), (unsigned)(e.start % 60), eventAbbrevs[e.type],
+                 number, e.fActive ? '*' : ' ');
+        display.text(5 + n, 0, buffer);
+    }
+}
+
+
+// update
+//
+// Show and log the gate that just closed, with the average over the window and the
+// RoCoF, and check them against the event limits.
+static void update(void) {
+    char buffer[24];
+    char number[12];
+
+    const MainsGate & latest = pastGate(0);
+    float hz = gateHz(latest);
+
+    uint16_t cycles = 0;
+    uint32_t ticks = 0;
+    for (uint8_t ix = 0; ix < gateCount; ix++) {
+        cycles += gates[ix].cycles;
+        ticks += gates[ix].ticks;
+    }
+    float average = (float)cycles * TIMEBASE_HZ / ticks * CLOCK_SCALE;
+
+    bool fRocof = gateCount > MAINS_ROCOF_GATES;
+    float rocof = 0.0;
+    if (fRocof) {
+        const MainsGate & before = pastGate(MAINS_ROCOF_GATES);
+        // The gate lengths are corrected already, the time between their ends is not
+        uint32_t span = tempcoTicks(latest.end - before.end) - latest.ticks / 2 + before.ticks / 2;
+        rocof = (hz - gateHz(before)) * TIMEBASE_HZ / span;
+    }
+
+    if (!fHaveRange || (hz < minHz))  minHz = hz;
+    if (!fHaveRange || (hz > maxHz))  maxHz = hz;
+    fHaveRange = true;
+
+    int32_t mHz = lround(hz * 1000.0);
+    watch(EVENT_UNDER, mHz, MAINS_DEVIATION_MHZ);
+    watch(EVENT_OVER, mHz, MAINS_DEVIATION_MHZ);
+    if (fRocof)  watch(EVENT_ROCOF, lround(rocof * 1000.0), MAINS_ROCOF_MHZ_S);
+
+    dtostrf(hz, 8, 4, number);
+    snprintf(buffer, sizeof(buffer), "%s Hz", number);
+    display.text2x(0, 0, buffer);
+    dtostrf(average, 9, 5, number);
+    snprintf(buffer, sizeof(buffer), "Avg%2u  %s Hz", gateCount, number);
+    display.text(2, 0, buffer);
+    if (fRocof) {
+        dtostrf(rocof, 7, 3, number);
+        snprintf(buffer, sizeof(buffer), "RoCoF    %s Hz/s", number);
+    } else {
+        snprintf(buffer, sizeof(buffer), "%-21s", "RoCoF");
+    }
+    display.text(3, 0, buffer);
+    char high[12];
+    dtostrf(minHz, 6, 3, number);
+    dtostrf(maxHz, 6, 3, high);
+    snprintf(buffer, sizeof(buffer), "Min %s Max %s", number, high);
+    display.text(4, 0, buffer);
+    showEvents();
+
+    Serial.print(uptime);
+    Serial.print(',');
+    Serial.print(hz, 4);
+    Serial.print(',');
+    Serial.print(average, 5);
+    Serial.print(',');
+    if (fRocof)  Serial.print(rocof, 3);
+    Serial.println();
+}
+
+
+static void closeGate(uint32_t end) {
+    MainsGate & g = gates[nextGate];
+    g.cycles = gateCycles;
+    g.ticks = tempcoTicks(end - gateStart);
+    g.end = end;
+    if (++nextGate >= MAINS_WINDOW)  nextGate = 0;
+    if (gateCount < MAINS_WINDOW)  gateCount++;
+
+    gateStart = end;
+    gateCycles = 0;
+    update();
+}
+
+
+static void addEdge(uint32_t t) {
+    if (!fHaveEdge) {
+        fHaveEdge = true;
+        lastEdge = gateStart = t;
+        gateCycles = 0;
+        return;
+    }
+
+    uint32_t period = t - lastEdge;
+    if (period < LOCKOUT_TICKS) {
+        return;
+    }
+    lastEdge = t;
+    gateCycles++;
+
+    // A whole cycle ends a loss of signal, a lone edge does not
+    if (activeEvent[EVENT_LOSS] >= 0) {
+        endEvent(EVENT_LOSS);
+        showEvents();
+    }
+
+    // Close the gate now if waiting for one more cycle would make it too long
+    if (t - gateStart + period > timebaseTicksFromMs(MAINS_GATE_MS)) {
+        closeGate(t);
+    }
+}
+
+
+// Start measuring again from the next edge.  The window is cleared too, because the
+// gates in it would no longer be back to back.
+static void restart(void) {
+    fHaveEdge = false;
+    nextGate = 0;
+    gateCount = 0;
+}
+
+
+void mainsSetup(void) {
+    display.clear();
+    display.text2x(0, 0, " no signal ");
+
+    resetLog();
+    restart();
+    uptime = 0;
+    lastSecondMs = millis();
+    Serial.println(F("seconds,hz,avg_hz,rocof_hz_s"));
+
+    timebaseBegin();
+    captureBegin(RISING);
+}
+
+
+void mainsLoop(void) {
+    switch (Serial.read()) {
+        case 'e':
+            listEvents();
+            break;
+        case 'r':
+            resetLog();
+            showEvents();
+            break;
+    }
+
+    while (millis() - lastSecondMs >= 1000) {
+        lastSecondMs += 1000;
+        uptime++;
+    }
+
+    CaptureEdge edge;
+    while (captureGet(edge)) {
+        addEdge(edge.ticks);
+    }
+
+    if (captureTakeOverruns()) {
+        // A lost edge would be a missing cycle
+        restart();
+    }
+
+    if (fHaveEdge && (timebaseNow() - lastEdge > timebaseTicksFromMs(MAINS_LOSS_MS))) {
+        restart();
+        if (activeEvent[EVENT_LOSS] < 0) {
+            startEvent(EVENT_LOSS, 0);
+            display.text2x(0, 0, " no signal ");
+            showEvents();
+        }
+    }
+}
+
+#endif
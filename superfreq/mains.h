@@ -0,0 +1,44 @@
+#ifndef MAINS_H
+#define MAINS_H
+
+#include <Arduino.h>
+
+// Mains frequency monitor
+//
+// Measures the 50 or 60Hz mains frequency on D2 from a safely isolated source, such as
+// a low voltage transformer winding or an optocoupler zero crossing detector, followed
+// by a Schmitt trigger.  Never connect the mains itself.
+//
+// Every rising edge is a cycle, and an edge less than half a nominal cycle after the
+// last one is ignored, so that noise on a slow crossing counts once.  The cycles are
+// grouped into reciprocal gates of whole cycles up to MAINS_GATE_MS long: the number of
+// cycles over the time between the first and last edge.  A 1s gate has a resolution of
+// about 25uHz, far finer than the mHz shown, and every update is a gate, so the
+// display changes at least every MAINS_GATE_MS.  The last MAINS_WINDOW gates are also
+// combined into one long gate for the average.
+//
+// The rate of change of frequency (RoCoF) is the difference between the latest gate and
+// the one MAINS_ROCOF_GATES before it over the time between their midpoints.
+//
+// The resolution is not the accuracy, which is that of the 16MHz clock.  A crystal is
+// good to about 50ppm, or 2.5mHz at 50Hz, and MAINS_CLOCK_PPM corrects for a known
+// error.  Boards with a ceramic resonator can be off by much more.
+//
+// Events are logged when the frequency is more than MAINS_DEVIATION_MHZ under or over
+// nominal, when the RoCoF is more than MAINS_ROCOF_MHZ_S, or when no cycle is seen for
+// MAINS_LOSS_MS.  An event ends once the reading is back inside MAINS_HYSTERESIS_PCT of
+// its limit, and records its start time, duration and furthest reading.  Times are the
+// uptime in hours, minutes and seconds.  The last MAINS_EVENTS events are kept, and the
+// display shows the latest three, with a * on the ones still going on.
+//
+// Each gate is printed on the serial port as the uptime in seconds, frequency, average
+// frequency and RoCoF, and each event as a comment line when it starts and ends.
+//
+// Serial commands:
+//   e    list the event log
+//   r    reset the minimum, maximum and event log
+
+void mainsSetup(void);
+void mainsLoop(void);
+
+#endif
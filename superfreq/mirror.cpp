@@ -0,0 +1,80 @@
+#include "mirror.h"
+
+#ifdef SUPERFREQ_MIRROR
+
+#define MIRROR_ROWS         8
+#define MIRROR_COLUMNS      128
+#define MIRROR_LITERALS     16      // longest literal token, limited by the buffer
+
+#define MIRROR_PACKET       0xfe
+#define MIRROR_END          0x00
+#define MIRROR_ZEROS        0x80
+
+static uint8_t shadow[MIRROR_ROWS][MIRROR_COLUMNS];     // the display RAM as last sent
+static uint8_t mirrorRow;
+static uint8_t mirrorColumn;
+static uint8_t zeroRun;
+static uint8_t literals[MIRROR_LITERALS];
+static uint8_t nLiterals;
+
+
+static void flushZeros(void) {
+    if (zeroRun) {
+        Serial.write(MIRROR_ZEROS | (zeroRun - 1));
+        zeroRun = 0;
+    }
+}
+
+
+static void flushLiterals(void) {
+    if (nLiterals) {
+        Serial.write(nLiterals);
+        Serial.write(literals, nLiterals);
+        nLiterals = 0;
+    }
+}
+
+
+void mirrorPosition(uint8_t row, uint8_t column) {
+    mirrorRow = row;
+    mirrorColumn = column;
+}
+
+
+void mirrorBegin(void) {
+    Serial.write(MIRROR_PACKET);
+    Serial.write(mirrorRow);
+    Serial.write(mirrorColumn);
+    zeroRun = 0;
+    nLiterals = 0;
+}
+
+
+// mirrorByte
+//
+// Called with each byte as it is sent to the display, after any inversion.  In page
+// addressing mode the column wraps within the row.
+void mirrorByte(uint8_t b) {
+    uint8_t & old = shadow[mirrorRow][mirrorColumn];
+    uint8_t delta = b ^ old;
+    old = b;
+    mirrorColumn = (mirrorColumn + 1) & (MIRROR_COLUMNS - 1);
+
+    if (delta == 0) {
+        flushLiterals();
+        if (++zeroRun == 0x80)  flushZeros();
+    } else {
+        flushZeros();
+        literals[nLiterals++] = delta;
+        if (nLiterals == MIRROR_LITERALS)  flushLiterals();
+    }
+}
+
+
+void mirrorEnd(void) {
+    flushZeros();
+    flushLiterals();
+    Serial.write(MIRROR_END);
+}
+
+#endif
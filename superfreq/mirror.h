@@ -0,0 +1,43 @@
+#ifndef MIRROR_H
+#define MIRROR_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Display mirror
+//
+// When the sketch is built with SUPERFREQ_MIRROR defined, every byte written to the
+// display RAM of the primary display is also sent to the serial port, so that
+// tools/sfmirror.py can rebuild the screen on a host and save it as a PNG.
+//
+// The mirror is fed from the display's own data path, one byte at a time as each byte
+// goes out on the I2C bus, so there is no second pass over the screen.  A 1KB copy of
+// the display RAM is kept, and each byte is sent as the XOR with what the display held
+// before.  Redrawing text that didn't change gives runs of zeros, which are run length
+// encoded, so most updates cost a few serial bytes.  The serial port is interrupt
+// driven, so sending those bytes overlaps with the bit-banged I2C.
+//
+// Each display data transfer becomes one packet:
+//
+//   0xfe row column tokens... 0x00
+//
+// where each token is either 0x80 | (n - 1) for n zero bytes, or n (1..127) followed
+// by n XOR bytes.  The column advances with each byte as it does on the display.
+// Packets are mixed with the normal text output of the mode, which never contains
+// 0xfe, so the viewer passes everything outside of a packet through as text.
+//
+// The markers compile to nothing in a normal build.
+
+#ifdef SUPERFREQ_MIRROR
+void mirrorPosition(uint8_t row, uint8_t column);
+void mirrorBegin(void);
+void mirrorByte(uint8_t b);
+void mirrorEnd(void);
+#else
+inline void mirrorPosition(uint8_t row, uint8_t column) {}
+inline void mirrorBegin(void) {}
+inline void mirrorByte(uint8_t b) {}
+inline void mirrorEnd(void) {}
+#endif
+
+#endif
@@ -0,0 +1,69 @@
+#include "superfreq.h"
+#include "pipeline.h"
+
+#if SUPERFREQ_MODE == MODE_PIPELINE
+
+uint16_t CycleCost::overhead;
+
+// The stages named in config.h
+#if PIPELINE_DEGLITCH_US && PIPELINE_MEDIAN
+typedef FilterChain<DeglitchFilter<PIPELINE_DEGLITCH_US * (TIMEBASE_HZ / 1000000)>, MedianStage> PipelineFilter;
+#elif PIPELINE_DEGLITCH_US
+typedef DeglitchFilter<PIPELINE_DEGLITCH_US * (TIMEBASE_HZ / 1000000)> PipelineFilter;
+#elif PIPELINE_MEDIAN
+typedef MedianStage PipelineFilter;
+#else
+typedef NoFilter PipelineFilter;
+#endif
+
+#if PIPELINE_ESTIMATOR == PIPELINE_SINGLE
+typedef SinglePeriodEstimator PipelineEstimator;
+#elif PIPELINE_ESTIMATOR == PIPELINE_REGRESSION
+typedef RegressionEstimator PipelineEstimator;
+#else
+typedef ReciprocalEstimator PipelineEstimator;
+#endif
+
+#if PIPELINE_FORMAT == PIPELINE_PERIOD
+typedef PeriodFormatter PipelineFormatter;
+#else
+typedef HzFormatter PipelineFormatter;
+#endif
+
+static Pipeline<CaptureSource, PipelineFilter, PipelineEstimator, PipelineFormatter> pipeline(PIPELINE_UPDATE_MS);
+
+// The labels and units either side of the readings
+static TextField resultLabel(display, 0, 0, 5, true);
+static TextField countLabel(display, 2, 0, 5, true);
+static TextField edgeLabel(display, 4, 0, 5, true);
+static TextField updateLabel(display, 6, 0, 5, true);
+static TextField resultUnit(display, 0, 14*8, 2, true);
+static TextField countUnit(display, 2, 14*8, 2, true);
+static TextField edgeUnit(display, 4, 14*8, 2, true);
+static TextField updateUnit(display, 6, 14*8, 2, true);
+static TextField * const labels[] = {
+    &resultLabel, &countLabel, &edgeLabel, &updateLabel,
+    &resultUnit, &countUnit, &edgeUnit, &updateUnit
+};
+
+
+void pipelineSetup(void) {
+    resultLabel.set(PipelineFormatter::label());
+    countLabel.set("Cnt:");
+    edgeLabel.set("Edge:");
+    updateLabel.set("Upd:");
+    resultUnit.set(PipelineFormatter::units());
+    edgeUnit.set("cy");
+    updateUnit.set("cy");
+    flushFields(labels, sizeof(labels) / sizeof(labels[0]));
+    displayRefresh.setFields(labels, sizeof(labels) / sizeof(labels[0]));
+
+    pipeline.begin();
+}
+
+
+void pipelineLoop(void) {
+    pipeline.poll();
+}
+
+#endif
@@ -0,0 +1,416 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <Arduino.h>
+#include "superfreq.h"
+#include "capture.h"
+#include "filter.h"
+#include "tempco.h"
+#include "timebase.h"
+
+// Measurement pipeline
+//
+// A measurement is put together at compile time from four policy types instead of
+// being written out by hand in loop() and an ISR:
+//
+//   Source     where the edge timestamps come from
+//   Filter     which periods are used, chained with FilterChain
+//   Estimator  how the periods in an update become a frequency
+//   Formatter  how the frequency is shown
+//
+// Every policy member is inline and the stages are members of the Pipeline, not
+// pointers, so the compiler sees the whole chain at once.  A stage that does nothing,
+// like NoFilter, compiles to nothing, and a build only contains the stages it names.
+// A new analysis is a new policy class, with no change to the rest of the pipeline.
+//
+// Each pipeline counts the CPU cycles it spends per edge (filter and estimator) and per
+// update (estimator result and formatting) with Timer1, so build variants can be
+// compared directly.  An interrupt that arrives during a stage is counted too, so the
+// minimum is the cost of the stage itself and the mean and maximum include the load
+// from the capture interrupt.
+
+
+// CycleCost
+//
+// Minimum, mean and maximum of a code section in CPU cycles, counted by Timer1 running
+// at the full clock.  A section must be shorter than 65536 cycles (4ms).  The cost of
+// the start() and stop() calls themselves is measured by begin() and subtracted.
+class CycleCost {
+    public:
+        static void begin(void) {
+            TCCR1A = 0;
+            TCCR1B = _BV(CS10);
+            CycleCost empty;
+            empty.reset();
+            empty.start();
+            empty.stop();
+            overhead = empty.minimum();
+        }
+
+        void reset(void)    { n = 0; sum = 0; }
+        void start(void)    { t0 = TCNT1; }
+        void stop(void) {
+            if (n == 0xffff)  return;
+            uint16_t cycles = TCNT1 - t0 - overhead;
+            if (!n || (cycles < minCycles))  minCycles = cycles;
+            if (!n || (cycles > maxCycles))  maxCycles = cycles;
+            sum += cycles;
+            n++;
+        }
+
+        uint16_t count(void) const      { return n; }
+        uint16_t minimum(void) const    { return n ? minCycles : 0; }
+        uint16_t maximum(void) const    { return n ? maxCycles : 0; }
+        uint16_t mean(void) const       { return n ? sum / n : 0; }
+
+    private:
+        static uint16_t overhead;
+        uint16_t t0;
+        uint16_t n;
+        uint16_t minCycles;
+        uint16_t maxCycles;
+        uint32_t sum;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Sources
+//
+// begin() starts the source and get() returns the next edge timestamp in timebase
+// ticks, or false if there are none waiting.  lost() returns true if edges were lost
+// since the last call.
+
+// Rising edges on D2 from the capture engine
+struct CaptureSource {
+    static const char * name(void)  { return "capture"; }
+    static void begin(void) {
+        timebaseBegin();
+        captureBegin(RISING);
+    }
+    static bool get(uint32_t & ticks) {
+        CaptureEdge edge;
+        if (!captureGet(edge))  return false;
+        ticks = edge.ticks;
+        return true;
+    }
+    static bool lost(void) {
+        return captureTakeOverruns() != 0;
+    }
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Filters
+//
+// process() is given each period and returns false to drop it.  It may also change the
+// period.  reset() is called when edges were lost.
+
+struct NoFilter {
+    static const char * name(void)  { return ""; }
+    void reset(void)                {}
+    bool process(uint32_t &)        { return true; }
+};
+
+
+// Periods shorter than minTicks are glitches.  The glitch is added to the next period
+// rather than dropped, so the time it took is not lost from the timeline.
+template <uint32_t minTicks>
+class DeglitchFilter {
+    public:
+        static const char * name(void)  { return ">deglitch"; }
+        void reset(void)                { carry = 0; }
+        bool process(uint32_t & period) {
+            period += carry;
+            carry = 0;
+            if (period < minTicks) {
+                carry = period;
+                return false;
+            }
+            return true;
+        }
+
+    private:
+        uint32_t carry;
+};
+
+
+// The median/Hampel outlier filter, see filter.h
+class MedianStage {
+    public:
+        static const char * name(void)  { return ">median"; }
+        void reset(void)                { median.reset(); }
+        bool process(uint32_t & period) { return median.add(period); }
+
+    private:
+        MedianFilter median;
+};
+
+
+// Two filters in a row.  Chains nest, so any number of filters can be joined.
+template <class First, class Second>
+class FilterChain {
+    public:
+        void reset(void) {
+            first.reset();
+            second.reset();
+        }
+        bool process(uint32_t & period) {
+            return first.process(period) && second.process(period);
+        }
+
+    private:
+        First first;
+        Second second;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Estimators
+//
+// add() is given each period that passed the filters and result() gives the frequency
+// over the update, or false if there weren't enough periods.  reset() starts the next
+// update.
+
+// The last period only, as the original period mode did before it averaged.
+class SinglePeriodEstimator {
+    public:
+        static const char * name(void)  { return ">single"; }
+        void reset(void)                { last = 0; }
+        void add(uint32_t period)       { last = period; }
+        bool result(float & hz) const {
+            if (!last)  return false;
+            hz = (float)TIMEBASE_HZ / last;
+            return true;
+        }
+
+    private:
+        uint32_t last;
+};
+
+
+// The number of periods over their total time, which is the reciprocal counter
+// estimate.  Only the first and last edges matter, so jitter on the edges in between
+// cancels.
+class ReciprocalEstimator {
+    public:
+        static const char * name(void)  { return ">reciprocal"; }
+        void reset(void)                { n = 0; sum = 0; }
+        void add(uint32_t period) {
+            n++;
+            sum += period;
+        }
+        bool result(float & hz) const {
+            if (!n)  return false;
+            hz = (float)n * TIMEBASE_HZ / sum;
+            return true;
+        }
+
+    private:
+        uint32_t n;
+        uint32_t sum;
+};
+
+
+// Least squares fit of a line to the edge times against edge number.  The slope is the
+// period.  Every edge counts equally, so random jitter on the edges averages down
+// faster than with the reciprocal estimate, which only uses the first and last edges.
+//
+// The sums are 64 bit integers so that nothing is lost to rounding.  The slope is
+// worked out about the middle edge, k / 2, which keeps every product below twice sumKT,
+// so the sums are good for 100KHz over a 10s update.  An update with more than that is
+// rejected rather than wrapped into a wrong answer.
+class RegressionEstimator {
+    public:
+        static const char * name(void)  { return ">regression"; }
+        void reset(void) {
+            k = 0;
+            t = 0;
+            sumT = 0;
+            sumKT = 0;
+            fOverflow = false;
+        }
+        void add(uint32_t period) {
+            if (fOverflow)  return;
+            k++;
+            t += period;
+            uint64_t kt = (uint64_t)k * t;
+            if ((kt >= SUM_LIMIT) || (sumKT >= SUM_LIMIT - kt)) {
+                fOverflow = true;
+                return;
+            }
+            sumT += t;
+            sumKT += kt;
+        }
+        bool result(float & hz) const {
+            if ((k < 2) || fOverflow)  return false;
+
+            // The points are (0, 0) to (k, t), so the sums of the edge numbers have a
+            // closed form.  With n = k + 1 points, the slope is
+            //   12 (sumKT - k/2 sumT) / (n (n^2 - 1))
+            // The times only increase, so k sumT is at most 2 sumKT and the difference
+            // is never negative.
+            uint64_t num = 2 * sumKT - (uint64_t)k * sumT;
+            if (!num)  return false;
+            float nf = k + 1;
+            hz = TIMEBASE_HZ * (nf * (nf * nf - 1) / 6) / num;
+            return true;
+        }
+
+    private:
+        static const uint64_t SUM_LIMIT = 1ULL << 63;
+
+        uint32_t k;                 // edge number of the last edge
+        uint32_t t;                 // time of the last edge from the first
+        uint64_t sumT;
+        uint64_t sumKT;
+        bool fOverflow;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Formatters
+//
+// label() and units() go either side of the result on the display, which is written
+// at column 5.  format() writes the result right aligned in 9 characters.
+
+struct HzFormatter {
+    static const char * name(void)  { return ">hz"; }
+    static const char * label(void) { return "Freq:"; }
+    static const char * units(void) { return "Hz"; }
+    static void format(float hz, char * buffer) {
+        dtostrf(hz, 9, (hz < 10000.0) ? 3 : 1, buffer);
+    }
+};
+
+
+struct PeriodFormatter {
+    static const char * name(void)  { return ">period"; }
+    static const char * label(void) { return "Per:"; }
+    static const char * units(void) { return "us"; }
+    static void format(float hz, char * buffer) {
+        float us = 1000000.0 / hz;
+        dtostrf(us, 9, (us < 10000.0) ? 3 : 1, buffer);
+    }
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Pipeline
+//
+// Joins the stages.  poll() is called from loop() and handles all of the edges that
+// are waiting, and makes an update every updateMs.  The display shows the result, the
+// number of periods used, and the mean cycles per edge and per update, at column 5 of
+// rows 0, 2, 4 and 6 between the labels that the mode draws.  Each update is printed on
+// the serial port as the result, the number of periods, and the minimum, mean and
+// maximum cycles per edge over the update and per update since startup.
+
+template <class Source, class Filter, class Estimator, class Formatter>
+class Pipeline {
+    public:
+        Pipeline(uint16_t updateMs) {
+            this->updateMs = updateMs;
+        }
+
+        void begin(void) {
+            Serial.print(F("pipeline "));
+            Serial.print(Source::name());
+            printFilterName((Filter *)0);
+            Serial.print(Estimator::name());
+            Serial.println(Formatter::name());
+
+            CycleCost::begin();
+            Source::begin();
+            filter.reset();
+            estimator.reset();
+            periods = 0;
+            fHaveEdge = false;
+            lastUpdateMs = millis();
+        }
+
+        void poll(void) {
+            uint32_t ticks;
+            while (Source::get(ticks)) {
+                edgeCost.start();
+                uint32_t period = ticks - lastTicks;
+                if (fHaveEdge && filter.process(period)) {
+                    estimator.add(period);
+                    periods++;
+                }
+                edgeCost.stop();
+                fHaveEdge = true;
+                lastTicks = ticks;
+            }
+            if (Source::lost()) {
+                // A lost edge makes a long period, so start again from the next edge
+                fHaveEdge = false;
+                filter.reset();
+            }
+
+            if (millis() - lastUpdateMs >= updateMs) {
+                lastUpdateMs += updateMs;
+                update();
+            }
+        }
+
+    private:
+        Filter filter;
+        Estimator estimator;
+        CycleCost edgeCost;
+        CycleCost updateCost;
+        uint32_t periods;
+        bool fHaveEdge;
+        uint32_t lastTicks;
+        uint16_t updateMs;
+        unsigned long lastUpdateMs;
+
+        template <class F>
+        static void printFilterName(F *)            { Serial.print(F::name()); }
+        template <class A, class B>
+        static void printFilterName(FilterChain<A, B> *) {
+            printFilterName((A *)0);
+            printFilterName((B *)0);
+        }
+
+        void update(void) {
+            char buffer[20];
+            float hz;
+
+            updateCost.start();
+            bool fOk = estimator.result(hz);
+            if (fOk)  Formatter::format(tempcoHz(hz), buffer);
+            updateCost.stop();
+            estimator.reset();
+
+            if (!fOk)  strcpy(buffer, (periods > 1) ? "overrange" : " no input");
+            display.text2x(0, 5*8, buffer);
+            if (fOk)  Serial.print(buffer + strspn(buffer, " "));
+            Serial.print(',');
+            Serial.print(periods);
+            printCost(edgeCost);
+            printCost(updateCost);
+            Serial.println();
+
+            snprintf(buffer, sizeof(buffer), "%9lu", (unsigned long)periods);
+            periods = 0;
+            display.text2x(2, 5*8, buffer);
+            snprintf(buffer, sizeof(buffer), "%8u", edgeCost.mean());
+            display.text2x(4, 5*8, buffer);
+            snprintf(buffer, sizeof(buffer), "%8u", updateCost.mean());
+            display.text2x(6, 5*8, buffer);
+            edgeCost.reset();
+        }
+
+        static void printCost(const CycleCost & cost) {
+            Serial.print(',');
+            Serial.print(cost.minimum());
+            Serial.print(',');
+            Serial.print(cost.mean());
+            Serial.print(',');
+            Serial.print(cost.maximum());
+        }
+};
+
+void pipelineSetup(void);
+void pipelineLoop(void);
+
+#endif
@@ -0,0 +1,142 @@
+#include "superfreq.h"
+#include "ratio.h"
+#include "counter.h"
+#include "timebase.h"
+
+#if SUPERFREQ_MODE == MODE_RATIO
+
+static uint32_t lastGateTicks;
+static bool fNoInput;
+
+
+// formatRatio
+//
+// Write a / b right aligned in width characters, with the given number of decimals,
+// by long division.  The last digit is truncated rather than rounded.  There must be
+// room for width + 1 characters.
+static void formatRatio(char * buffer, uint8_t width, uint32_t a, uint32_t b, uint8_t decimals) {
+    char digits[24];
+    uint8_t n = snprintf(digits, sizeof(digits), "%lu", (unsigned long)(a / b));
+    uint32_t r = a % b;
+    if (decimals) {
+        digits[n++] = '.';
+        while (decimals-- && (n < sizeof(digits) - 1)) {
+            // r < b, so r * 10 fits as long as b is under 429 million
+            r *= 10;
+            digits[n++] = '0' + r / b;
+            r %= b;
+        }
+    }
+    digits[n] = '\0';
+
+    uint8_t pad = (n < width) ? width - n : 0;
+    memset(buffer, ' ', pad);
+    strcpy(buffer + pad, digits);
+}
+
+
+// auxError
+//
+// The uncertainty of the D4 count in counts: one, plus the D4 edges that can arrive in
+// the spread of the compare ISR latency.
+static uint32_t auxError(const CounterGate & gate) {
+    return 1 + (uint64_t)gate.auxEdges * (RATIO_JITTER_US * (TIMEBASE_HZ / 1000000)) / gate.ticks;
+}
+
+
+// auxDecimals
+//
+// Decimals of the D4 frequency f, as counterDecimals but also limited by the error of
+// the count.
+static int auxDecimals(float f, const CounterGate & gate, uint32_t error) {
+    int prec = counterDecimals(f, gate);
+    float res = gate.auxEdges ? f * error / gate.auxEdges : 1.0;
+    for (int n = 0; n < prec; n++) {
+        if (res >= 0.1) {
+            return n;
+        }
+        res *= 10.0;
+    }
+    return prec;
+}
+
+
+// ratioDecimals
+//
+// The ratio is uncertain by error / b, so give it as many decimals as b / error has
+// digits after the first, limited to what fits in width with the integer part.
+static uint8_t ratioDecimals(uint32_t a, uint32_t b, uint32_t error, uint8_t width) {
+    uint8_t decimals = 0;
+    for (uint32_t x = b / error; x >= 10; x /= 10) {
+        decimals++;
+    }
+    uint8_t whole = 1;
+    for (uint32_t x = a / b; x >= 10; x /= 10) {
+        whole++;
+    }
+    uint8_t room = (width > whole + 1) ? width - whole - 1 : 0;
+    return (decimals < room) ? decimals : room;
+}
+
+
+// The labels and units either side of the readings, and the title of the ratio
+static TextField auxLabel(display, 0, 0, 5, true);
+static TextField freqLabel(display, 2, 0, 5, true);
+static TextField auxUnit(display, 0, 14*8, 2, true);
+static TextField freqUnit(display, 2, 14*8, 2, true);
+static TextField ratioLabel(display, 4, 0, 16, true);
+static TextField * const labels[] = {
+    &auxLabel, &freqLabel, &auxUnit, &freqUnit, &ratioLabel
+};
+
+void ratioSetup(void) {
+    auxLabel.set("D4:");
+    freqLabel.set("D5:");
+    auxUnit.set("Hz");
+    freqUnit.set("Hz");
+    ratioLabel.set("Ratio D4/D5");
+    flushFields(labels, sizeof(labels) / sizeof(labels[0]));
+    displayRefresh.setFields(labels, sizeof(labels) / sizeof(labels[0]));
+
+    timebaseBegin();
+    counterAuxBegin();
+    counterBegin();
+    lastGateTicks = timebaseNow();
+}
+
+
+void ratioLoop(void) {
+    char buffer[20];
+    CounterGate gate;
+
+    if (!counterPoll(timebaseTicksFromMs(RATIO_GATE_MS), gate)) {
+        if (!fNoInput && (timebaseNow() - lastGateTicks > timebaseTicksFromMs(COUNTER_TIMEOUT_MS))) {
+            fNoInput = true;
+            display.text2x(2, 5*8, " no input");
+        }
+        return;
+    }
+    lastGateTicks = gate.end;
+    fNoInput = false;
+
+    float seconds = (float)gate.ticks / TIMEBASE_HZ;
+    float fAux = gate.auxEdges / seconds;
+    float f = gate.edges / seconds;
+
+    uint32_t error = auxError(gate);
+    dtostrf(fAux, 9, auxDecimals(fAux, gate, error), buffer);
+    display.text2x(0, 5*8, buffer);
+    Serial.print(buffer);
+    Serial.print(',');
+
+    dtostrf(f, 9, counterDecimals(f, gate), buffer);
+    display.text2x(2, 5*8, buffer);
+    Serial.print(buffer);
+    Serial.print(',');
+
+    formatRatio(buffer, 16, gate.auxEdges, gate.edges, ratioDecimals(gate.auxEdges, gate.edges, error, 16));
+    display.text2x(6, 0, buffer);
+    Serial.println(buffer);
+}
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef RATIO_H
+#define RATIO_H
+
+#include <Arduino.h>
+
+// Frequency ratio
+//
+// Counts two signals in hardware at the same time, D5 with Timer1 as in the counter
+// mode and D4 with Timer0, over a shared gate that opens and closes on D5 edges.  Both
+// frequencies are shown, along with the ratio D4/D5.  The gate holds an exact number
+// of D5 periods, so the ratio is only uncertain by the D4 count, which is one count
+// plus the D4 edges in the spread of the interrupt latency, taken as RATIO_JITTER_US.
+// The D4 frequency and the ratio are shown to the digits that supports.  The ratio is
+// worked out by integer long division rather than in float, which would lose digits.
+//
+// There is no per-edge interrupt for either signal, so two clocks of several MHz can
+// be compared.  Timer0 no longer drives millis() in this mode, so everything is timed
+// with the timebase.
+//
+// Each gate is printed on the serial port as D4 frequency, D5 frequency and ratio.
+
+void ratioSetup(void);
+void ratioLoop(void);
+
+#endif
@@ -0,0 +1,40 @@
+#include "refresh.h"
+
+RefreshScheduler::RefreshScheduler(SSD1306Display & display, TextField * const fields[], uint8_t count,
+                                   uint16_t bytesPerSecond, uint32_t clockHz)
+    : display(display), fields(fields), count(count) {
+    ticksPerByte = clockHz / bytesPerSecond;
+    next = 0;
+    lastSent = 0;
+}
+
+
+// setFields
+//
+// Change the fields that are refreshed, for a scheduler that is shared by modes with
+// different screens.  The round starts again from the first field.
+void RefreshScheduler::setFields(TextField * const fields[], uint8_t count) {
+    this->fields = fields;
+    this->count = count;
+    next = 0;
+}
+
+
+// idle
+//
+// Call when loop() has nothing else to do, with the current time.  The next item is
+// sent once the time since the last one has paid for it.  A long busy period only pays
+// for the one item, so it doesn't turn into a burst of refreshes afterwards.
+void RefreshScheduler::idle(uint32_t now) {
+    uint16_t cost = (next < count) ? fields[next]->size() : (uint16_t)CONFIG_BYTES;
+    if (now - lastSent < cost * ticksPerByte)  return;
+    lastSent = now;
+
+    if (next < count) {
+        fields[next]->refresh();
+        next++;
+    } else {
+        display.refreshConfig();
+        next = 0;
+    }
+}
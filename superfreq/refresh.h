@@ -0,0 +1,46 @@
+#ifndef REFRESH_H
+#define REFRESH_H
+
+#include <Arduino.h>
+#include "ssd1306lite.h"
+#include "textfield.h"
+
+// RefreshScheduler
+//
+// The I2C code never reads an ACK, so a corrupted transfer or a display brownout
+// leaves bad pixels or a blank screen until that area happens to be drawn again.
+// Fields that don't change, like labels, would never be fixed.
+//
+// The scheduler slowly re-sends everything that should be on the screen.  Each call to
+// idle() redraws at most one text field, in round robin order, and after each full
+// round the display configuration is re-sent.  The redraws are paid for from a byte
+// budget that fills at a fixed rate, so the bus time spent on refreshing is bounded
+// no matter how often idle() is called.  A field is redrawn in place, so there is no
+// full-screen clear or flash.
+//
+// The caller passes the time to idle(), in ticks of clockHz, because not every mode
+// has the same clocks running.  The ratio mode takes Timer0 away from millis(), and
+// the period mode doesn't start the timebase.
+
+class RefreshScheduler {
+    public:
+        RefreshScheduler(SSD1306Display & display, TextField * const fields[], uint8_t count,
+                         uint16_t bytesPerSecond, uint32_t clockHz);
+
+        void setFields(TextField * const fields[], uint8_t count);
+        void idle(uint32_t now);
+
+    private:
+        enum {
+            CONFIG_BYTES = 30       // approximate size of the configuration commands
+        };
+
+        SSD1306Display & display;
+        TextField * const * fields;
+        uint8_t count;
+        uint32_t ticksPerByte;      // clock ticks of bus budget earned by each byte
+        uint8_t next;               // field to refresh next, or count for the configuration
+        uint32_t lastSent;          // time of the last refresh
+};
+
+#endif
@@ -0,0 +1,226 @@
+#include "superfreq.h"
+#include "sdcard.h"
+
+#if USE_SDCARD
+
+const byte SD_CS_PIN = 10;
+const byte SD_MOSI_PIN = 11;
+const byte SD_MISO_PIN = 12;
+const byte SD_SCK_PIN = 13;
+
+// Commands, sent as 0x40 | number
+#define CMD_GO_IDLE_STATE       0
+#define CMD_SEND_IF_COND        8
+#define CMD_SET_BLOCKLEN        16
+#define CMD_READ_BLOCK          17
+#define CMD_WRITE_BLOCK         24
+#define CMD_APP_CMD             55
+#define CMD_READ_OCR            58
+#define ACMD_SEND_OP_COND       41
+
+// R1 response bits
+#define R1_READY                0x00
+#define R1_IDLE                 0x01
+#define R1_ILLEGAL_COMMAND      0x04
+
+#define TOKEN_START_BLOCK       0xfe
+#define DATA_ACCEPTED           0x05
+
+#define SD_INIT_TIMEOUT_MS      1000
+#define SD_READ_TIMEOUT_MS      300
+#define SD_READY_TIMEOUT_MS     300
+
+
+static uint8_t spiTransfer(uint8_t b) {
+    SPDR = b;
+    while (!(SPSR & _BV(SPIF)))
+        ;
+    return SPDR;
+}
+
+
+static inline void select(void) {
+    digitalWrite(SD_CS_PIN, LOW);
+}
+
+
+// The card only releases MISO on the clock after chip select goes high.
+static void deselect(void) {
+    digitalWrite(SD_CS_PIN, HIGH);
+    spiTransfer(0xff);
+}
+
+
+SdCard::SdCard(void) {
+    fHighCapacity = false;
+}
+
+
+// begin
+//
+// Put the card into SPI mode and initialize it.  Version 2 cards are asked whether they
+// are high capacity, and version 1 cards are set to 512 byte blocks.  Returns false if
+// there is no card or it doesn't finish initializing.
+bool SdCard::begin(void) {
+    pinMode(SD_CS_PIN, OUTPUT);
+    pinMode(SD_MOSI_PIN, OUTPUT);
+    pinMode(SD_SCK_PIN, OUTPUT);
+    pinMode(SD_MISO_PIN, INPUT_PULLUP);
+    digitalWrite(SD_CS_PIN, HIGH);
+
+    SPCR = _BV(SPE) | _BV(MSTR) | _BV(SPR1) | _BV(SPR0);    // 16MHz / 128 = 125kHz
+    SPSR = 0;
+
+    // At least 74 clocks with chip select high to enter SPI mode
+    for (uint8_t ix = 0; ix < 10; ix++) {
+        spiTransfer(0xff);
+    }
+
+    bool fOk = false;
+    fHighCapacity = false;
+    if (command(CMD_GO_IDLE_STATE, 0) == R1_IDLE) {
+        uint32_t hcs = 0;
+        uint8_t r = command(CMD_SEND_IF_COND, 0x1aa);
+        bool fVersion2 = !(r & R1_ILLEGAL_COMMAND);
+        if (fVersion2) {
+            uint8_t echo = 0;
+            for (uint8_t ix = 0; ix < 4; ix++) {
+                echo = spiTransfer(0xff);
+            }
+            hcs = 0x40000000UL;
+            fOk = (echo == 0xaa);
+        } else {
+            fOk = true;
+        }
+
+        unsigned long start = millis();
+        while (fOk && (appCommand(ACMD_SEND_OP_COND, hcs) != R1_READY)) {
+            fOk = (millis() - start < SD_INIT_TIMEOUT_MS);
+        }
+
+        if (fOk && fVersion2 && (command(CMD_READ_OCR, 0) == R1_READY)) {
+            fHighCapacity = (spiTransfer(0xff) & 0x40) != 0;
+            for (uint8_t ix = 0; ix < 3; ix++) {
+                spiTransfer(0xff);
+            }
+        }
+        if (fOk && !fHighCapacity) {
+            fOk = (command(CMD_SET_BLOCKLEN, BLOCK_SIZE) == R1_READY);
+        }
+    }
+    deselect();
+
+    SPCR = _BV(SPE) | _BV(MSTR);    // 16MHz / 2 = 8MHz
+    SPSR = _BV(SPI2X);
+    return fOk;
+}
+
+
+// readBlock
+//
+// Read one block, waiting for the data.  Only used when a log is opened, so the wait
+// doesn't matter.
+bool SdCard::readBlock(uint32_t block, uint8_t * data) {
+    bool fOk = false;
+    if (command(CMD_READ_BLOCK, address(block)) == R1_READY) {
+        unsigned long start = millis();
+        uint8_t token;
+        while (((token = spiTransfer(0xff)) == 0xff) && (millis() - start < SD_READ_TIMEOUT_MS))
+            ;
+        if (token == TOKEN_START_BLOCK) {
+            for (uint16_t ix = 0; ix < BLOCK_SIZE; ix++) {
+                data[ix] = spiTransfer(0xff);
+            }
+            spiTransfer(0xff);      // CRC, not checked
+            spiTransfer(0xff);
+            fOk = true;
+        }
+    }
+    deselect();
+    return fOk;
+}
+
+
+// writeBegin
+//
+// Send the write command and the start token, and leave the card selected for the data.
+bool SdCard::writeBegin(uint32_t block) {
+    if (command(CMD_WRITE_BLOCK, address(block)) != R1_READY) {
+        deselect();
+        return false;
+    }
+    spiTransfer(TOKEN_START_BLOCK);
+    return true;
+}
+
+
+void SdCard::writeBytes(const uint8_t * data, uint16_t count) {
+    while (count--) {
+        spiTransfer(*data++);
+    }
+}
+
+
+// writeEnd
+//
+// Send the CRC, which SPI mode ignores, and read the data response.  The card then
+// holds MISO low until the block is programmed.
+bool SdCard::writeEnd(void) {
+    spiTransfer(0xff);
+    spiTransfer(0xff);
+    bool fOk = ((spiTransfer(0xff) & 0x1f) == DATA_ACCEPTED);
+    deselect();
+    return fOk;
+}
+
+
+bool SdCard::busy(void) {
+    select();
+    bool fBusy = (spiTransfer(0xff) != 0xff);
+    deselect();
+    return fBusy;
+}
+
+
+// command
+//
+// Select the card and send a command.  Returns the R1 response, and leaves the card
+// selected so that the caller can read the rest of the response or data.  Only CMD0
+// and CMD8 are checked for a valid CRC in SPI mode.
+uint8_t SdCard::command(uint8_t cmd, uint32_t arg) {
+    select();
+    waitReady(SD_READY_TIMEOUT_MS);
+
+    spiTransfer(0x40 | cmd);
+    spiTransfer(arg >> 24);
+    spiTransfer(arg >> 16);
+    spiTransfer(arg >> 8);
+    spiTransfer(arg);
+    spiTransfer((cmd == CMD_GO_IDLE_STATE) ? 0x95 : (cmd == CMD_SEND_IF_COND) ? 0x87 : 0x01);
+
+    uint8_t r = 0xff;
+    for (uint8_t ix = 0; (ix < 10) && (r & 0x80); ix++) {
+        r = spiTransfer(0xff);
+    }
+    return r;
+}
+
+
+uint8_t SdCard::appCommand(uint8_t cmd, uint32_t arg) {
+    command(CMD_APP_CMD, 0);
+    deselect();
+    uint8_t r = command(cmd, arg);
+    deselect();
+    return r;
+}
+
+
+bool SdCard::waitReady(uint16_t timeoutMs) {
+    unsigned long start = millis();
+    while (spiTransfer(0xff) != 0xff) {
+        if (millis() - start >= timeoutMs)  return false;
+    }
+    return true;
+}
+
+#endif
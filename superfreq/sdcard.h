@@ -0,0 +1,38 @@
+#ifndef SDCARD_H
+#define SDCARD_H
+
+#include <Arduino.h>
+#include "blockdev.h"
+
+// SdCard
+//
+// An SD or SDHC card in SPI mode on the hardware SPI pins: D10 (chip select), D11
+// (MOSI), D12 (MISO) and D13 (SCK).  The card is initialized at 125kHz as the spec
+// requires and then run at 8MHz, where one block takes about 0.6ms to send.
+//
+// The card is used as raw blocks with no file system.  writeEnd returns as soon as the
+// card has accepted the data, and the chip select is released while the card programs
+// the block, which can take up to a few hundred ms.  busy checks if that is finished.
+
+class SdCard : public BlockDevice {
+    public:
+        SdCard(void);
+
+        bool begin(void);
+
+        virtual bool readBlock(uint32_t block, uint8_t * data);
+        virtual bool writeBegin(uint32_t block);
+        virtual void writeBytes(const uint8_t * data, uint16_t count);
+        virtual bool writeEnd(void);
+        virtual bool busy(void);
+
+    private:
+        uint8_t command(uint8_t cmd, uint32_t arg);
+        uint8_t appCommand(uint8_t cmd, uint32_t arg);
+        bool waitReady(uint16_t timeoutMs);
+        uint32_t address(uint32_t block) const { return fHighCapacity ? block : block << 9; }
+
+        bool fHighCapacity;     // SDHC cards are addressed in blocks, older cards in bytes
+};
+
+#endif
@@ -0,0 +1,247 @@
+#include "superfreq.h"
+#include "settle.h"
+#include "capture.h"
+#include "filter.h"
+#include "stable.h"
+#include "tempco.h"
+#include "timebase.h"
+
+#if SUPERFREQ_MODE == MODE_SETTLE
+
+enum {
+    STATE_STABLE,       // tracking the baseline, looking for a step
+    STATE_SETTLING,     // recording the trajectory after a step
+    TRAJECTORY_POINTS = 128
+};
+
+static uint8_t state;
+static MedianFilter baseline;
+static bool fHaveRise;
+static uint32_t lastRise;
+static uint8_t confirmCount;
+static uint32_t confirmStart;       // edge that started the possible step
+
+// Step in progress
+static uint32_t initialPeriod;
+static uint32_t stepStart;
+static bool fStepUp;                // up in frequency, so down in period
+static uint32_t extremePeriod;      // furthest period in the direction of the step
+
+// Run of periods inside the tolerance band
+static StabilityDetector run(SETTLE_TOLERANCE_PPM, SETTLE_HOLD);
+
+// Trajectory, each point the mean of decimation periods
+static uint32_t trajectory[TRAJECTORY_POINTS];
+static uint8_t points;
+static uint16_t decimation;
+static uint32_t pointSum;
+static uint16_t pointCount;
+
+
+static uint32_t ppmOf(uint32_t period, uint32_t ppm) {
+    return (uint32_t)(((uint64_t)period * ppm) / 1000000UL);
+}
+
+static uint32_t absDiff(uint32_t a, uint32_t b) {
+    return (a > b) ? a - b : b - a;
+}
+
+
+static void addPoint(uint32_t period) {
+    pointSum += period;
+    if (++pointCount < decimation)  return;
+
+    if (points >= TRAJECTORY_POINTS) {
+        for (uint8_t ix = 0; ix < TRAJECTORY_POINTS / 2; ix++) {
+            trajectory[ix] = (trajectory[2 * ix] + trajectory[2 * ix + 1]) / 2;
+        }
+        points = TRAJECTORY_POINTS / 2;
+        decimation *= 2;
+        // The sum so far is for the old decimation and becomes the first half of the new point
+        return;
+    }
+    trajectory[points++] = pointSum / pointCount;
+    pointSum = 0;
+    pointCount = 0;
+}
+
+
+// startStep
+//
+// The direction of the step is fixed here, from the period that confirmed it against
+// the baseline, so that ringing the other way early on can't be taken for the
+// overshoot.
+static void startStep(uint32_t start, uint32_t period) {
+    state = STATE_SETTLING;
+    initialPeriod = baseline.median();
+    stepStart = start;
+    fStepUp = (period < initialPeriod);
+    extremePeriod = initialPeriod;
+    run.reset(start);
+    points = 0;
+    decimation = 1;
+    pointSum = 0;
+    pointCount = 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Display
+//
+// Rows 0..3 show the results in the small font and rows 4..7 plot the trajectory in
+// frequency, with the final value as a dotted line.
+
+enum {
+    PLOT_ROW = 4,
+    PLOT_ROWS = 4,
+    PLOT_HEIGHT = PLOT_ROWS * 8
+};
+
+static void drawPlot(float finalFreq) {
+    float timebaseHz = tempcoHz(TIMEBASE_HZ);
+    float lo = finalFreq;
+    float hi = finalFreq;
+    for (uint8_t ix = 0; ix < points; ix++) {
+        float f = timebaseHz / trajectory[ix];
+        if (f < lo)  lo = f;
+        if (f > hi)  hi = f;
+    }
+    float scale = (hi > lo) ? (PLOT_HEIGHT - 1) / (hi - lo) : 0;
+    uint8_t yFinal = (PLOT_HEIGHT - 1) - (uint8_t)((finalFreq - lo) * scale);
+
+    uint8_t pixels[128];
+    for (uint8_t row = 0; row < PLOT_ROWS; row++) {
+        for (uint8_t col = 0; col < 128; col++) {
+            uint8_t bits = 0;
+            if (((yFinal >> 3) == row) && ((col & 3) == 0)) {
+                bits |= 1 << (yFinal & 7);
+            }
+            if (col < points) {
+                float f = timebaseHz / trajectory[col];
+                uint8_t y = (PLOT_HEIGHT - 1) - (uint8_t)((f - lo) * scale);
+                if ((y >> 3) == row)  bits |= 1 << (y & 7);
+            }
+            pixels[col] = bits;
+        }
+        display.fillAreaWithBytes(PLOT_ROW + row, 0, 1, 128, pixels, sizeof(pixels));
+    }
+}
+
+
+static void showResult(bool fSettled, uint32_t finalPeriod, uint32_t settleTicks) {
+    char buffer[24];
+    char number[12];
+
+    float initialFreq = tempcoHz(TIMEBASE_HZ) / initialPeriod;
+    float finalFreq = tempcoHz(TIMEBASE_HZ) / finalPeriod;
+    float extremeFreq = tempcoHz(TIMEBASE_HZ) / extremePeriod;
+
+    if (fSettled) {
+        dtostrf((float)tempcoTicks(settleTicks) / (TIMEBASE_HZ / 1000), 10, 3, number);
+        snprintf(buffer, sizeof(buffer), "Settle%s ms", number);
+    } else {
+        strcpy(buffer, "Settle   not settled");
+    }
+    display.text(0, 0, buffer);
+
+    // Overshoot is the part of the excursion that went beyond the final value
+    float step = finalFreq - initialFreq;
+    float over = (step != 0.0) ? (extremeFreq - finalFreq) / step * 100.0 : 0.0;
+    if (over < 0.0)  over = 0.0;
+    dtostrf(over, 10, 1, number);
+    snprintf(buffer, sizeof(buffer), "Over  %s %%", number);
+    display.text(1, 0, buffer);
+
+    dtostrf(finalFreq, 11, 2, number);
+    snprintf(buffer, sizeof(buffer), "Final%s Hz", number);
+    display.text(2, 0, buffer);
+    dtostrf(initialFreq, 11, 2, number);
+    snprintf(buffer, sizeof(buffer), "From %s Hz", number);
+    display.text(3, 0, buffer);
+
+    drawPlot(finalFreq);
+}
+
+
+// endStep
+//
+// Report the step and go back to looking for the next one with the final value as
+// the new baseline.
+static void endStep(bool fSettled) {
+    uint32_t finalPeriod = run.mean();
+    if (pointCount && (points < TRAJECTORY_POINTS)) {
+        trajectory[points++] = pointSum / pointCount;
+    }
+    showResult(fSettled, finalPeriod, run.start() - stepStart);
+
+    state = STATE_STABLE;
+    baseline.reset();
+    confirmCount = 0;
+}
+
+
+static void addPeriod(uint32_t start, uint32_t period) {
+    if (state == STATE_STABLE) {
+        uint32_t med = baseline.median();
+        bool fOutside = (med != 0) && (absDiff(period, med) > ppmOf(med, SETTLE_STEP_PPM));
+        baseline.add(period);
+        if (!fOutside) {
+            confirmCount = 0;
+            return;
+        }
+        if (confirmCount++ == 0)  confirmStart = start;
+        if (confirmCount < SETTLE_CONFIRM) {
+            return;
+        }
+        startStep(confirmStart, period);
+    }
+
+    addPoint(period);
+
+    // Track the furthest excursion in the direction of the step only
+    if (fStepUp ? (period < extremePeriod) : (period > extremePeriod)) {
+        extremePeriod = period;
+    }
+
+    if (run.add(start, period)) {
+        endStep(true);
+    } else if (start - stepStart > timebaseTicksFromMs(SETTLE_TIMEOUT_MS)) {
+        endStep(false);
+    }
+}
+
+
+void settleSetup(void) {
+    display.clear();
+    display.text(0, 0, "Settle  waiting");
+
+    timebaseBegin();
+    state = STATE_STABLE;
+    captureBegin(RISING);
+}
+
+
+void settleLoop(void) {
+    CaptureEdge edge;
+    while (captureGet(edge)) {
+        if (fHaveRise) {
+            addPeriod(lastRise, edge.ticks - lastRise);
+        }
+        fHaveRise = true;
+        lastRise = edge.ticks;
+    }
+
+    if (captureTakeOverruns()) {
+        // A lost edge merges two periods into one that looks like a step, so drop the
+        // step in progress and the baseline and start again from the next edge
+        fHaveRise = false;
+        if (state == STATE_SETTLING) {
+            display.text(0, 0, "Settle  overrun     ");
+        }
+        state = STATE_STABLE;
+        baseline.reset();
+        confirmCount = 0;
+    }
+}
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef SETTLE_H
+#define SETTLE_H
+
+#include <Arduino.h>
+
+// Settling time analyzer
+//
+// Measures how long a retuned oscillator or PLL takes to settle after a frequency step.
+// Every period on D2 is checked against the median of the recent periods.  A step is
+// detected when SETTLE_CONFIRM periods in a row are more than SETTLE_STEP_PPM away from
+// that median.  From then on, each period is added to a trajectory until the signal
+// stays inside a band of SETTLE_TOLERANCE_PPM for SETTLE_HOLD periods in a row.
+//
+// The settling time is measured from the first period of the step to the start of the
+// run of periods that stayed in the band.  The final value is the mean of that run, and
+// the overshoot is the furthest the frequency went past the final value, as a percentage
+// of the step size.
+//
+// The trajectory is kept in a fixed buffer of 128 points, one per display column.  When
+// it fills, pairs of points are averaged together and each point then covers twice as
+// many periods, so a step of any length fits on the display.
+//
+// If the capture engine loses edges, the step in progress is dropped and the baseline
+// starts again, because the merged period would look like a step or an overshoot.
+
+void settleSetup(void);
+void settleLoop(void);
+
+#endif
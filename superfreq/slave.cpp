@@ -0,0 +1,324 @@
+#include "superfreq.h"
+#include "slave.h"
+#include "capture.h"
+#include "tempco.h"
+#include "timebase.h"
+
+#if SUPERFREQ_MODE == MODE_SLAVE
+
+#if SLAVE_BUS == SLAVE_BUS_I2C
+#include <util/twi.h>
+#endif
+
+#define NO_BANK     0xff
+
+// The register banks.  loop() is the only writer of frontBank, and the bus interrupt
+// is the only writer of busBank, the bank that the current transaction is reading.
+static SlaveRegisters banks[2];
+static volatile uint8_t frontBank;
+static volatile uint8_t busBank = NO_BANK;
+static volatile uint8_t busPointer;
+static volatile bool fBusAddress;       // the next byte written is the register address
+static volatile uint16_t busReads;
+
+// Whole periods since the last update
+static bool fHaveRise;
+static bool fHaveFall;
+static uint32_t lastRise;
+static uint32_t lastFall;
+static uint32_t periods;
+static uint32_t periodTicks;
+static uint32_t highTicks;
+static uint32_t minTicks;
+static uint32_t maxTicks;
+
+static uint8_t sequence;
+static uint16_t newOverruns;            // edges lost since the last update
+static uint16_t totalOverruns;
+static bool fUpdateDue;
+static unsigned long lastUpdateMs;
+
+
+// busByte
+//
+// The register at the pointer in the bank being read, and move the pointer on.
+static inline uint8_t busByte(void) {
+    uint8_t ix = busPointer++;
+    return (ix < sizeof(SlaveRegisters)) ? ((const uint8_t *)&banks[busBank])[ix] : 0xff;
+}
+
+
+#if SLAVE_BUS == SLAVE_BUS_I2C
+const byte SLAVE_SDA_PIN = A4;
+const byte SLAVE_SCL_PIN = A5;
+
+#define TWCR_ACK    (_BV(TWEN) | _BV(TWIE) | _BV(TWINT) | _BV(TWEA))
+
+ISR(TWI_vect) {
+    switch (TW_STATUS) {
+        case TW_SR_SLA_ACK:
+        case TW_SR_ARB_LOST_SLA_ACK:
+            fBusAddress = true;
+            break;
+        case TW_SR_DATA_ACK:
+            if (fBusAddress) {
+                busPointer = TWDR;
+                fBusAddress = false;
+            }
+            break;
+        case TW_ST_SLA_ACK:
+        case TW_ST_ARB_LOST_SLA_ACK:
+            busBank = frontBank;
+            busReads++;
+            TWDR = busByte();
+            break;
+        case TW_ST_DATA_ACK:
+            TWDR = busByte();
+            break;
+        case TW_BUS_ERROR:
+            // Release the bus and wait to be addressed again
+            busBank = NO_BANK;
+            TWCR = TWCR_ACK | _BV(TWSTO);
+            return;
+        default:
+            // Stop, or the master has finished reading
+            busBank = NO_BANK;
+            break;
+    }
+    TWCR = TWCR_ACK;
+}
+
+
+static void busBegin(void) {
+    pinMode(SLAVE_SDA_PIN, INPUT_PULLUP);
+    pinMode(SLAVE_SCL_PIN, INPUT_PULLUP);
+    TWAR = SLAVE_I2C_ADDRESS << 1;
+    TWCR = TWCR_ACK;
+}
+
+#else
+const byte SLAVE_SS_PIN = 10;
+const byte SLAVE_MOSI_PIN = 11;
+const byte SLAVE_MISO_PIN = 12;
+const byte SLAVE_SCK_PIN = 13;
+
+// SS framing.  The first byte out is STATUS, loaded before the master starts clocking.
+ISR(PCINT0_vect) {
+    if (PINB & _BV(PB2)) {
+        DDRB &= ~_BV(PB4);
+        busBank = NO_BANK;
+    } else {
+        busBank = frontBank;
+        busReads++;
+        fBusAddress = true;
+        SPDR = banks[busBank].status;
+        DDRB |= _BV(PB4);
+    }
+}
+
+
+ISR(SPI_STC_vect) {
+    uint8_t b = SPDR;
+    if (busBank == NO_BANK) {
+        return;
+    }
+    if (fBusAddress) {
+        busPointer = b;
+        fBusAddress = false;
+    }
+    SPDR = busByte();
+}
+
+
+static void busBegin(void) {
+    pinMode(SLAVE_SS_PIN, INPUT_PULLUP);
+    pinMode(SLAVE_MOSI_PIN, INPUT);
+    pinMode(SLAVE_MISO_PIN, INPUT);
+    pinMode(SLAVE_SCK_PIN, INPUT);
+    SPCR = _BV(SPE) | _BV(SPIE);        // slave, mode 0, MSB first
+    PCMSK0 |= _BV(PCINT2);
+    PCIFR = _BV(PCIF0);
+    PCICR |= _BV(PCIE0);
+}
+#endif
+
+
+static void addEdge(const CaptureEdge & edge) {
+    if (edge.level == HIGH) {
+        if (fHaveRise && fHaveFall) {
+            uint32_t period = edge.ticks - lastRise;
+            if (!periods || (period < minTicks))  minTicks = period;
+            if (!periods || (period > maxTicks))  maxTicks = period;
+            periods++;
+            periodTicks += period;
+            highTicks += lastFall - lastRise;
+        }
+        fHaveRise = true;
+        fHaveFall = false;
+        lastRise = edge.ticks;
+    } else if (fHaveRise) {
+        fHaveFall = true;
+        lastFall = edge.ticks;
+    }
+}
+
+
+// ticksToNs
+//
+// Timebase ticks to nanoseconds, saturating at the largest register value.
+static uint32_t ticksToNs(uint32_t ticks) {
+    const uint32_t NS_PER_TICK = 1000000000UL / TIMEBASE_HZ;
+    ticks = tempcoTicks(ticks);
+    return (ticks > 0xffffffffUL / NS_PER_TICK) ? 0xffffffffUL : ticks * NS_PER_TICK;
+}
+
+
+// publish
+//
+// Write the results into the back bank and make it the front bank.  New transactions
+// only ever start on the front bank, so once the bus is not reading the back bank it
+// can be written without turning interrupts off.  Returns false if a transaction that
+// started before the last swap is still reading it.
+static bool publish(void) {
+    uint8_t back = frontBank ^ 1;
+    if (busBank == back) {
+        return false;
+    }
+
+    SlaveRegisters & r = banks[back];
+    r.id = SLAVE_ID;
+    r.version = SLAVE_VERSION;
+    r.status = SLAVE_STATUS_VALID;
+    r.sequence = ++sequence;
+    r.periods = periods;
+    r.overruns = ((uint32_t)totalOverruns + newOverruns > 0xffff) ? 0xffff : totalOverruns + newOverruns;
+    r.updateMs = SLAVE_UPDATE_MS;
+    r.reserved = 0;
+    if (newOverruns) {
+        r.status |= SLAVE_STATUS_OVERRUN;
+    }
+    if (periods) {
+        r.frequency = (uint32_t)((float)periods * TIMEBASE_HZ * 1000.0 / tempcoTicks(periodTicks) + 0.5);
+        r.period = ticksToNs((periodTicks + periods / 2) / periods);
+        r.periodMin = ticksToNs(minTicks);
+        r.periodMax = ticksToNs(maxTicks);
+        r.duty = (uint16_t)(10000.0 * highTicks / periodTicks + 0.5);
+    } else {
+        r.status |= SLAVE_STATUS_NO_INPUT;
+        r.frequency = 0;
+        r.period = r.periodMin = r.periodMax = 0;
+        r.duty = 0;
+    }
+
+    frontBank = back;
+    return true;
+}
+
+
+#if USE_DISPLAY
+static void showResults(void) {
+    const SlaveRegisters & r = banks[frontBank];
+    char buffer[20];
+    if (r.status & SLAVE_STATUS_OVERRUN) {
+        display.text2x(0, 5*8, "  overrun");
+        display.text2x(2, 5*8, "        -");
+        display.text2x(4, 5*8, "        -");
+    } else if (r.status & SLAVE_STATUS_NO_INPUT) {
+        display.text2x(0, 5*8, " no input");
+        display.text2x(2, 5*8, "        -");
+        display.text2x(4, 5*8, "        -");
+    } else {
+        dtostrf(r.frequency / 1000.0, 9, 1, buffer);
+        display.text2x(0, 5*8, buffer);
+        dtostrf(r.duty / 100.0, 9, 2, buffer);
+        display.text2x(2, 5*8, buffer);
+        dtostrf(r.period / 1000.0, 9, 1, buffer);
+        display.text2x(4, 5*8, buffer);
+    }
+
+    uint16_t reads;
+    noInterrupts();
+    reads = busReads;
+    interrupts();
+    snprintf(buffer, sizeof(buffer), "%9u", reads);
+    display.text2x(6, 5*8, buffer);
+}
+#endif
+
+
+#if USE_DISPLAY
+// The labels and units either side of the readings
+static TextField freqLabel(display, 0, 0, 5, true);
+static TextField dutyLabel(display, 2, 0, 5, true);
+static TextField periodLabel(display, 4, 0, 5, true);
+static TextField busLabel(display, 6, 0, 5, true);
+static TextField freqUnit(display, 0, 14*8, 2, true);
+static TextField dutyUnit(display, 2, 14*8, 2, true);
+static TextField periodUnit(display, 4, 14*8, 2, true);
+static TextField busUnit(display, 6, 14*8, 2, true);
+static TextField * const labels[] = {
+    &freqLabel, &dutyLabel, &periodLabel, &busLabel,
+    &freqUnit, &dutyUnit, &periodUnit, &busUnit
+};
+#endif
+
+void slaveSetup(void) {
+#if USE_DISPLAY
+    freqLabel.set("Freq:");
+    dutyLabel.set("Duty:");
+    periodLabel.set("Per:");
+    busLabel.set("Bus:");
+    freqUnit.set("Hz");
+    dutyUnit.set(" %");
+    periodUnit.set("us");
+    flushFields(labels, sizeof(labels) / sizeof(labels[0]));
+    displayRefresh.setFields(labels, sizeof(labels) / sizeof(labels[0]));
+#endif
+
+    banks[0].id = banks[1].id = SLAVE_ID;
+    banks[0].version = banks[1].version = SLAVE_VERSION;
+    banks[0].updateMs = banks[1].updateMs = SLAVE_UPDATE_MS;
+    busBegin();
+
+    timebaseBegin();
+    captureBegin(CHANGE);
+    lastUpdateMs = millis();
+}
+
+
+void slaveLoop(void) {
+    CaptureEdge edge;
+    while (captureGet(edge)) {
+        addEdge(edge);
+    }
+
+    if (!fUpdateDue && (millis() - lastUpdateMs >= SLAVE_UPDATE_MS)) {
+        lastUpdateMs += SLAVE_UPDATE_MS;
+        fUpdateDue = true;
+    }
+    if (!fUpdateDue) {
+        return;
+    }
+
+    newOverruns += captureTakeOverruns();
+    if (!publish()) {
+        return;
+    }
+    fUpdateDue = false;
+
+    if (newOverruns) {
+        // A lost edge could leave a period with two rises in it, so start again
+        totalOverruns = banks[frontBank].overruns;
+        newOverruns = 0;
+        fHaveRise = false;
+    }
+    periods = 0;
+    periodTicks = 0;
+    highTicks = 0;
+
+#if USE_DISPLAY
+    showResults();
+#endif
+}
+
+#endif
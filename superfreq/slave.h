@@ -0,0 +1,83 @@
+#ifndef SLAVE_H
+#define SLAVE_H
+
+#include <Arduino.h>
+
+// Measurement peripheral
+//
+// Measures the signal on D2 with the capture engine, as in the gated mode without the
+// gate, and makes the results available to another microcontroller as a register map
+// on an I2C or SPI slave interface, selected with SLAVE_BUS.  superfreq can then be
+// built into a larger rig as a frequency measuring peripheral.
+//
+// The register map is double buffered.  The bus interrupt reads from the front bank,
+// chosen when each transaction starts, while loop() writes the next results into the
+// back bank and then swaps them.  A transaction therefore always returns one
+// consistent set of results, even if it spans an update, and neither side ever waits
+// for the other.  If a long transaction is still reading the old bank when the next
+// update is due, that update is held back until the transaction ends.
+//
+// All multi-byte registers are little endian.
+//
+//   0x00  ID           u8   0x53 ('S')
+//   0x01  VERSION      u8   register map version, 1
+//   0x02  STATUS       u8   SLAVE_STATUS_ bits below
+//   0x03  SEQUENCE     u8   incremented by every update
+//   0x04  FREQUENCY    u32  mean frequency in mHz
+//   0x08  PERIOD       u32  mean period in ns
+//   0x0c  PERIOD_MIN   u32  shortest period in ns
+//   0x10  PERIOD_MAX   u32  longest period in ns
+//   0x14  PERIODS      u32  number of periods in the update
+//   0x18  DUTY         u16  duty cycle in units of 0.01%
+//   0x1a  OVERRUNS     u16  edges lost by the capture engine since startup, saturating
+//   0x1c  UPDATE_MS    u16  time between updates, SLAVE_UPDATE_MS
+//   0x1e  reserved     u16  reads as 0
+//
+// Registers past the end read as 0xff and writes to the map are ignored.
+//
+// I2C (SLAVE_BUS_I2C) uses the hardware TWI on A4 (SDA) and A5 (SCL) at address
+// SLAVE_I2C_ADDRESS.  A write sets the register pointer from its first data byte, and
+// a read returns registers from the pointer on, so the usual write-pointer, repeated
+// start, read sequence works.  A read without a pointer write carries on from where the
+// last one stopped.  The display normally uses A4 and A5, so it is moved to D7 (SDA) and
+// D6 (SCL) in this configuration.
+//
+// SPI (SLAVE_BUS_SPI) uses D10 (SS), D11 (MOSI), D12 (MISO) and D13 (SCK) in mode 0.
+// The first byte of each transaction, framed by SS, is the register address and
+// returns STATUS.  The following bytes return registers from that address on.  Each
+// byte is loaded by an interrupt, so the master must leave at least 10us after SS goes
+// low and between bytes.  MISO is only driven while SS is low.
+//
+// The bus interrupts take a few microseconds, and an edge that arrives during one is
+// timestamped that much late, which shows up in PERIOD_MIN and PERIOD_MAX.
+//
+// Set SLAVE_DISPLAY to 0 to run without a display.  Otherwise the results are also
+// shown on the display, along with the number of bus reads on the bottom line.
+
+struct SlaveRegisters {
+    uint8_t id;
+    uint8_t version;
+    uint8_t status;
+    uint8_t sequence;
+    uint32_t frequency;
+    uint32_t period;
+    uint32_t periodMin;
+    uint32_t periodMax;
+    uint32_t periods;
+    uint16_t duty;
+    uint16_t overruns;
+    uint16_t updateMs;
+    uint16_t reserved;
+};
+
+#define SLAVE_ID                0x53
+#define SLAVE_VERSION           1
+
+#define SLAVE_STATUS_VALID      0x01    // at least one update has been made
+#define SLAVE_STATUS_NO_INPUT   0x02    // no whole period in the last update
+#define SLAVE_STATUS_OVERRUN    0x04    // edges were lost in the last update
+
+void slaveSetup(void);
+void slaveLoop(void);
+
+#endif
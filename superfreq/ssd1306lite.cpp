@@ -20,35 +20,43 @@
 // by Neven Boyanov https://bitbucket.org/tinusaur/ssd1306xled 
 // which was itself inspired by IIC_wtihout_ACK http://www.14blog.com/archives/1358.
 
+#include "config.h"
 #include "ssd1306lite.h"
 #include "font6x8.h"
 #include "font8x16.h"
+#include "mirror.h"
 
 // The slave address of an SSD1306 is seven bits and should be either 0x3c or 0x3d.
 // The bit following the seven address bits is the read/write bit and it is always
 // set to zero to indicate that the microcontroller is writing to the display.
-// 
-// The address and R/W bit are combined below so that the sendByte code can send the
-// adddress and R/W bit as a single byte.
 //
-// Change the SSD1306_ADDR to match the i2C slave address of the display.
-// Some displays may already be marked Addr=78 rather than Addr=3C, but the
-// code below should always be 0x78 or 0x79 two cover the two possible
-// addresses used by the controller.
-#define SSD1306_ADDR    0x78    // Slave address of the display (0x3c << 1) | 0
-//#define SSD1306_ADDR    0x79    // Slave address of the display (0x3d << 1) | 0
+// The address is passed to the constructor, so two displays with different addresses
+// can share the same SCL and SDA pins.  The constructor combines the address and R/W
+// bit so that the sendByte code can send them as a single byte.  Some displays may
+// be marked Addr=78 rather than Addr=3C.  This is the combined value, so use 0x3c for
+// these displays and 0x3d for displays marked Addr=7A.
 
 // Communication pin definitions.  
 // The default communication pins for an Arduino Uno or Nano are A5 for SCL and A4
 // for SDA.  To use different pins on these Arduinos or to use a different Arduino
 // type, lookup the mapping of the Arduino pins to hardware ports and change the
-// PORT, DDR, and PIN definitions below to match.
+// PORT, DDR, and PIN definitions below to match.  The build configuration can also
+// move them by defining DISPLAY_SCL_PORT and the rest in config.h.
+#ifdef DISPLAY_SCL_PORT
+#define SCL_PORT        DISPLAY_SCL_PORT
+#define SCL_DDR         DISPLAY_SCL_DDR
+#define SCL_PIN         DISPLAY_SCL_PIN
+#define SDA_PORT        DISPLAY_SDA_PORT
+#define SDA_DDR         DISPLAY_SDA_DDR
+#define SDA_PIN         DISPLAY_SDA_PIN
+#else
 #define SCL_PORT        PORTC
 #define SCL_DDR         DDRC
 #define SCL_PIN         PC5     // Arduino A5 - connect to SCL on SSD1306 display
 #define SDA_PORT        PORTC
 #define SDA_DDR         DDRC
 #define SDA_PIN         PC4     // Arduino A4 - connect to SDA on SSD1306 display
+#endif
 
 
 // Functions to set the SCL and SDA bits as output and to set the bits high and low.
@@ -67,6 +75,8 @@ enum {
     CMD_SET_COLUMN_LO =         0x00,   // commands 00..0f set low nibble of column start
     CMD_SET_COLUMN_HI =         0x10,   // commands 10..1f set high nibble of start address
     CMD_ADDRESS_MODE =          0x20,   // one byte argument 0=horiz, 1=vert, 2=page (default)
+    CMD_COLUMN_RANGE =          0x21,   // two byte argument start and end column for horiz/vert mode
+    CMD_PAGE_RANGE =            0x22,   // two byte argument start and end page for horiz/vert mode
     CMD_SET_START_LINE =        0x40,   // commands 40..7f set start line from 0..63
     CMD_SET_CONTRAST =          0x81,   // one byte argument sets contrast level 0..255
     CMD_CHARGE_PUMP =           0x8d,   // one byte argument 0x10=disable, 0x14=enable
@@ -111,8 +121,10 @@ static const uint8_t initCommands[] PROGMEM = {
 };
 
 
-SSD1306Display::SSD1306Display(void) {
+SSD1306Display::SSD1306Display(uint8_t address) {
     fInvertData = false;
+    fPortrait = false;
+    i2cAddress = address << 1;      // R/W bit = 0 for write
 }
 
 
@@ -132,6 +144,22 @@ void SSD1306Display::initialize(void) {
 }
 
 
+// refreshConfig
+//
+// Re-send the configuration commands from the init table, without the initial
+// display off command, so that the screen does not blink.  The I2C code can't tell
+// if the display missed a command or was reset by a brownout, so this can be called
+// periodically to put the controller back into the expected state.  This restores
+// the default contrast and the normal (not inverted) screen.
+void SSD1306Display::refreshConfig(void) {
+    ssd1306CmdBegin();
+    for (uint8_t ix = 1; (ix < sizeof(initCommands)); ix++) {
+        i2cSendByte(pgm_read_byte(&initCommands[ix]));
+    }
+    ssd1306CmdEnd();
+}
+
+
 // setPosition
 //
 // Note that the row argument is 0..8, specifying a display line of 8 vertical pixels.
@@ -141,7 +169,8 @@ void SSD1306Display::initialize(void) {
 // character position, the r,c value would be {2, 6*5} rather than {2, 5}.
 void SSD1306Display::setPosition(uint8_t row, uint8_t column) {
     if ((row >= NUM_ROWS) || (column >= NUM_COLUMNS))  return;
-    
+    if (isMirrored())  mirrorPosition(row, column);
+
     ssd1306CmdBegin();
     i2cSendByte(CMD_SET_ROW | row);
     i2cSendByte(CMD_SET_COLUMN_HI | ((column >> 4) & 0x0f));
@@ -164,11 +193,19 @@ void SSD1306Display::invertData(bool b) { fInvertData = b; }
 // rows 0, 3, 6 with rows 2 and 5 empty for spacing.
 //
 // Any text that would extend past the end of a screen row is clipped.
+//
+// With setPortrait(true), both text methods draw the text for a display mounted on its
+// side.  See the portrait text section below.
 
 // text
 //
-// Draw text using the 6x8 font.  Maximun text on screen is 8 line of 21 characters.
+// Draw text using the 6x8 font.  Maximun text on screen is 8 line of 21 characters,
+// or 16 lines of 10 characters in portrait.
 void SSD1306Display::text(uint8_t row, uint8_t column, const char * str) {
+    if (fPortrait) {
+        portraitText(row, column, str, false);
+        return;
+    }
     if (row > NUM_ROWS - 1)  return;
 
     setPosition(row, column);
@@ -185,8 +222,13 @@ void SSD1306Display::text(uint8_t row, uint8_t column, const char * str) {
 
 // text2x
 //
-// Draw text using the 8x16 font.  Maximum text on screen is 4 lines of 16 characters.
+// Draw text using the 8x16 font.  Maximum text on screen is 4 lines of 16 characters,
+// or 8 lines of 8 characters in portrait.
 void SSD1306Display::text2x(uint8_t row, uint8_t column, const char * str) {
+    if (fPortrait) {
+        portraitText(row, column, str, true);
+        return;
+    }
     if (row > NUM_ROWS - 2)  return;
 
     setPosition(row, column);
@@ -336,6 +378,166 @@ void SSD1306Display::sleep(bool b) {
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+// Portrait text
+//
+// Text is drawn a quarter turn clockwise, so that it reads upright when the display is
+// turned a quarter turn counterclockwise.  The screen is then 64 pixels wide and 128
+// high, and the row and column arguments of text and text2x are in that frame: rows
+// 0..15 of 8 pixels and columns 0..63.  For a display that is turned the other way,
+// also flip it with the remap commands in initCommands, as for an upside down display.
+// The other drawing methods are not rotated.
+//
+// A byte of display RAM is 8 vertical pixels, so a rotated glyph is the transpose of
+// the landscape one.  Each row of text is drawn into a 64 byte strip in the landscape
+// layout, and then each 8x8 pixel block of the strip is transposed and sent.  The
+// display's horizontal addressing mode is used with a window around the text, so the
+// whole row is one data transfer with no repositioning between blocks.
+//
+// The text is sent in whole 8 pixel blocks, so anything else in the blocks that it
+// touches is cleared.
+
+// swapBits
+//
+// Exchange the bits of b selected by mask with the bits of a selected by mask << shift.
+static inline void swapBits(uint8_t & a, uint8_t & b, uint8_t shift, uint8_t mask) {
+    uint8_t t = ((a >> shift) ^ b) & mask;
+    a ^= t << shift;
+    b ^= t;
+}
+
+
+// transpose8x8
+//
+// Transpose an 8x8 bit matrix in place, so that bit j of m[i] becomes bit i of m[j].
+// The two off-diagonal 4x4 blocks are exchanged, then the off-diagonal 2x2 blocks
+// inside each 4x4 block, and then the off-diagonal bits inside each 2x2 block.  Each
+// step moves four bits at once with a shift and a mask, so the whole transpose is 12
+// byte exchanges with no loop over the bits.
+static void transpose8x8(uint8_t m[8]) {
+    swapBits(m[0], m[4], 4, 0x0f);
+    swapBits(m[1], m[5], 4, 0x0f);
+    swapBits(m[2], m[6], 4, 0x0f);
+    swapBits(m[3], m[7], 4, 0x0f);
+
+    swapBits(m[0], m[2], 2, 0x33);
+    swapBits(m[1], m[3], 2, 0x33);
+    swapBits(m[4], m[6], 2, 0x33);
+    swapBits(m[5], m[7], 2, 0x33);
+
+    swapBits(m[0], m[1], 1, 0x55);
+    swapBits(m[2], m[3], 1, 0x55);
+    swapBits(m[4], m[5], 1, 0x55);
+    swapBits(m[6], m[7], 1, 0x55);
+}
+
+
+// portraitText
+//
+// Draw each row of the text into a strip with the 6x8 or 8x16 font and send it.  The
+// 8x16 font is two rows, the top halves of the glyphs and then the bottom halves.
+void SSD1306Display::portraitText(uint8_t row, uint8_t column, const char * str, bool f2x) {
+    uint8_t rows = f2x ? 2 : 1;
+    if ((row > PORTRAIT_ROWS - rows) || (column >= PORTRAIT_COLUMNS))  return;
+
+    uint8_t strip[PORTRAIT_COLUMNS];
+    for (uint8_t half = 0; half < rows; half++) {
+        memset(strip, 0, sizeof(strip));
+        uint8_t col = column;
+        for (const char * s = str; *s; s++) {
+            if (f2x) {
+                if (col > PORTRAIT_COLUMNS - 8)  break;
+                uint8_t c = *s > '}' ? 0 : *s - 32;
+                for (uint8_t ix = 0; ix < 8; ix++) {
+                    strip[col++] = pgm_read_byte(&font8x16[c * 16 + half * 8 + ix]);
+                }
+            } else {
+                if (col > PORTRAIT_COLUMNS - 6)  break;
+                uint8_t c = (*s > '{') ? 0 : *s - 32;
+                for (uint8_t ix = 0; ix < 6; ix++) {
+                    strip[col++] = pgm_read_byte(&font6x8[c * 6 + ix]);
+                }
+            }
+        }
+        portraitStrip(row + half, column, col, strip);
+    }
+}
+
+
+// portraitStrip
+//
+// Send the blocks of a strip that hold columns startColumn up to endColumn as a row of
+// portrait text.  Bit r of the strip goes to display column 127 - 8 * row - r and
+// strip column x to display pixel line x, so each block is transposed and then sent
+// from its last byte to its first.
+void SSD1306Display::portraitStrip(uint8_t row, uint8_t startColumn, uint8_t endColumn, const uint8_t strip[]) {
+    if (endColumn <= startColumn)  return;
+
+    uint8_t firstBlock = startColumn / 8;
+    uint8_t lastBlock = (endColumn - 1) / 8;
+    uint8_t left = NUM_COLUMNS - 8 - 8 * row;
+
+    windowBegin(left, left + 7, firstBlock, lastBlock);
+    if (isMirrored())  mirrorPosition(firstBlock, left);
+    ssd1306DataBegin();
+    for (uint8_t block = firstBlock; block <= lastBlock; block++) {
+        uint8_t m[8];
+        memcpy(m, &strip[block * 8], sizeof(m));
+        transpose8x8(m);
+
+        // The mirror only knows page addressing, so each page of the window is a new
+        // transfer for it.
+        if (isMirrored() && (block != firstBlock)) {
+            mirrorEnd();
+            mirrorPosition(block, left);
+            mirrorBegin();
+        }
+        for (uint8_t ix = 8; ix-- > 0; ) {
+            ssd1306DataPutByte(m[ix]);
+        }
+    }
+    ssd1306DataEnd();
+    windowEnd();
+}
+
+
+// windowBegin
+//
+// Switch to horizontal addressing inside a window of the display RAM.  Data fills the
+// window's columns on its first row and then wraps to the start of the next row.
+void SSD1306Display::windowBegin(uint8_t startColumn, uint8_t endColumn, uint8_t startRow, uint8_t endRow) {
+    ssd1306CmdBegin();
+    i2cSendByte(CMD_ADDRESS_MODE);
+    i2cSendByte(0);
+    i2cSendByte(CMD_COLUMN_RANGE);
+    i2cSendByte(startColumn);
+    i2cSendByte(endColumn);
+    i2cSendByte(CMD_PAGE_RANGE);
+    i2cSendByte(startRow);
+    i2cSendByte(endRow);
+    ssd1306CmdEnd();
+}
+
+
+// windowEnd
+//
+// Go back to the whole screen and to the page addressing that the rest of the driver
+// uses.  Page addressing also wraps at the end of the column range, so that is reset
+// too.
+void SSD1306Display::windowEnd(void) {
+    ssd1306CmdBegin();
+    i2cSendByte(CMD_COLUMN_RANGE);
+    i2cSendByte(0);
+    i2cSendByte(NUM_COLUMNS - 1);
+    i2cSendByte(CMD_PAGE_RANGE);
+    i2cSendByte(0);
+    i2cSendByte(NUM_ROWS - 1);
+    i2cSendByte(CMD_ADDRESS_MODE);
+    i2cSendByte(2);
+    ssd1306CmdEnd();
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Private methods to manage the I2C communication and 
@@ -362,8 +564,9 @@ enum {
 // display as data for the Display RAM until ssdDataEnd is called. 
 void SSD1306Display::ssd1306DataBegin(void) {
     i2cSendBegin();
-    i2cSendByte(SSD1306_ADDR);          // address and R/W bit
+    i2cSendByte(i2cAddress);            // address and R/W bit
     i2cSendByte(SSD1306_CTL_DATA);      // D/C bit = data
+    if (isMirrored())  mirrorBegin();
 }
 
 
@@ -375,6 +578,7 @@ void SSD1306Display::ssd1306DataBegin(void) {
 // DataBegin/DataEnd instead of the more confusing DataBegin/i2cSendEnd.
 void SSD1306Display::ssd1306DataEnd(void) {
     i2cSendEnd();
+    if (isMirrored())  mirrorEnd();
 }
 
 
@@ -384,7 +588,9 @@ void SSD1306Display::ssd1306DataEnd(void) {
 // If fDataInverted is true, the byte is inverted, meaning that all ones are
 // changed to zeroes and zeroes to ones.
 void SSD1306Display::ssd1306DataPutByte(uint8_t b) {
-    i2cSendByte(fInvertData ? ~b : b);
+    if (fInvertData)  b = ~b;
+    i2cSendByte(b);
+    if (isMirrored())  mirrorByte(b);
 }
 
 
@@ -396,7 +602,7 @@ void SSD1306Display::ssd1306DataPutByte(uint8_t b) {
 // commands until ssdCmdEnd is called. 
 void SSD1306Display::ssd1306CmdBegin(void) {
     i2cSendBegin();
-    i2cSendByte(SSD1306_ADDR);          // address and R/W bit
+    i2cSendByte(i2cAddress);            // address and R/W bit
     i2cSendByte(SSD1306_CTL_COMMAND);   // D/C bit = command
 }
 
@@ -11,15 +11,29 @@ class SSD1306Display {
         NUM_COLUMNS = 128,
 
         MAX_TEXT = 21,      // NUM_COLUMNS / 6,
-        MAX_TEXT2X = 16     // NUM_COLUMNS / 8
+        MAX_TEXT2X = 16,    // NUM_COLUMNS / 8
+
+        PORTRAIT_ROWS = 16, // NUM_COLUMNS / 8
+        PORTRAIT_COLUMNS = 64
     };
 
     public:
-        SSD1306Display(void);
+        enum {
+            DEFAULT_ADDRESS = 0x3c,
+            ALTERNATE_ADDRESS = 0x3d
+        };
+
+        enum {
+            ROW_OVERHEAD = 7    // bytes sent ahead of the data for a row: position and data header
+        };
+
+        SSD1306Display(uint8_t address = DEFAULT_ADDRESS);
         void initialize(void);
+        void refreshConfig(void);
 
         void setPosition(uint8_t row, uint8_t column);
         void invertData(bool b);
+        void setPortrait(bool b) { fPortrait = b; }
         void clear(void) { fillScreen(0x00); }
 
         void text(uint8_t row, uint8_t column, const char * str);
@@ -36,6 +50,16 @@ class SSD1306Display {
 
     private:
         bool fInvertData;
+        bool fPortrait;
+        uint8_t i2cAddress;     // 7-bit slave address shifted left, with R/W bit clear
+
+        // Only the display at the default address is sent to the serial mirror
+        bool isMirrored(void) const { return i2cAddress == (DEFAULT_ADDRESS << 1); }
+
+        void portraitText(uint8_t row, uint8_t column, const char * str, bool f2x);
+        void portraitStrip(uint8_t row, uint8_t startColumn, uint8_t endColumn, const uint8_t strip[]);
+        void windowBegin(uint8_t startColumn, uint8_t endColumn, uint8_t startRow, uint8_t endRow);
+        void windowEnd(void);
 
         void ssd1306DataBegin(void);
         void ssd1306DataPutByte(uint8_t b);
@@ -0,0 +1,35 @@
+#include "stable.h"
+
+StabilityDetector::StabilityDetector(uint32_t tolerancePpm, uint16_t hold) {
+    this->tolerancePpm = tolerancePpm;
+    this->hold = hold;
+    reset(0);
+}
+
+
+// reset
+//
+// Start looking for a new run.  The start is reported as the start of the run until
+// the first period is added.
+void StabilityDetector::reset(uint32_t start) {
+    runStart = start;
+    runSum = 0;
+    runCount = 0;
+}
+
+
+// add
+//
+// Add a period that began at start.  Returns true once the current run is long enough
+// to be stable.  The run is kept as a 32 bit sum of timebase ticks, so hold periods
+// must add up to less than about 35 minutes.
+bool StabilityDetector::add(uint32_t start, uint32_t period) {
+    uint32_t runMean = runCount ? runSum / runCount : period;
+    uint32_t diff = (period > runMean) ? period - runMean : runMean - period;
+    if (diff > (uint32_t)(((uint64_t)runMean * tolerancePpm) / 1000000UL)) {
+        reset(start);
+    }
+    runSum += period;
+    runCount++;
+    return stable();
+}
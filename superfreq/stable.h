@@ -0,0 +1,37 @@
+#ifndef STABLE_H
+#define STABLE_H
+
+#include <Arduino.h>
+
+// StabilityDetector
+//
+// Decides when a series of periods has settled.  Periods are collected into a run, and
+// a period that is more than tolerancePpm away from the mean of the run so far starts a
+// new run.  The signal is stable once a run reaches hold periods, and the mean of that
+// run is the settled value.
+//
+// Comparing with the mean of the run rather than the previous period means a slow
+// drift, such as an RC filter still charging, keeps restarting the run instead of
+// creeping through the band one small step at a time.
+
+class StabilityDetector {
+    public:
+        StabilityDetector(uint32_t tolerancePpm, uint16_t hold);
+        void reset(uint32_t start);
+
+        bool add(uint32_t start, uint32_t period);
+
+        bool stable(void) const { return runCount >= hold; }
+        uint32_t mean(void) const { return runCount ? runSum / runCount : 0; }
+        uint32_t start(void) const { return runStart; }
+        uint16_t count(void) const { return runCount; }
+
+    private:
+        uint32_t tolerancePpm;
+        uint16_t hold;
+        uint32_t runStart;      // start of the first period of the run
+        uint32_t runSum;
+        uint16_t runCount;
+};
+
+#endif
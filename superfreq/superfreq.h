@@ -0,0 +1,16 @@
+#ifndef SUPERFREQ_H
+#define SUPERFREQ_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "ssd1306lite.h"
+#include "refresh.h"
+
+// The display is declared in superfreq.ino and shared by all of the mode modules.
+extern SSD1306Display display;
+
+// So is the background refresh for the modes that draw straight to the display.  Each
+// of them registers the fixed labels of its screen as text fields with setFields().
+extern RefreshScheduler displayRefresh;
+
+#endif
@@ -1,65 +1,525 @@
-#include "ssd1306lite.h"
+#include <avr/eeprom.h>
+#include "superfreq.h"
+#include "bench.h"
+#include "counter.h"
+#include "burst.h"
+#include "drift.h"
+#include "filter.h"
+#include "latency.h"
+#include "compositor.h"
+#include "refresh.h"
+#include "trigger.h"
+#include "usartcap.h"
+#include "settle.h"
+#include "dashboard.h"
+#include "logger.h"
+#include "gated.h"
+#include "sync.h"
+#include "ratio.h"
+#include "slave.h"
+#include "sweep.h"
+#include "pipeline.h"
+#include "fsk.h"
+#include "mains.h"
+#include "tempco.h"
+#include "timebase.h"
 
 // Declare the global instance of the display
 SSD1306Display display;
 
+#if USE_DISPLAY && (SUPERFREQ_MODE != MODE_PERIOD) && (SUPERFREQ_MODE != MODE_DASHBOARD)
+// The other modes draw their readings straight to the display, and redraw them at each
+// update.  The fixed labels around them are text fields that each mode registers here,
+// and the background refresh repairs those and re-sends the display configuration.
+// The trigger, USART, settle, sweep and mains modes have no fixed labels, so only the
+// configuration is refreshed for them.  The USART mode doesn't start the timebase, and
+// the ratio mode stops millis(), so each is timed by the clock that it has.
+#if SUPERFREQ_MODE == MODE_USART
+RefreshScheduler displayRefresh(display, 0, 0, REFRESH_BYTES_PER_SEC, 1000);
+#define refreshClock()  millis()
+#else
+RefreshScheduler displayRefresh(display, 0, 0, REFRESH_BYTES_PER_SEC, TIMEBASE_HZ);
+#define refreshClock()  timebaseNow()
+#endif
+#endif
+
+#if SUPERFREQ_MODE == MODE_PERIOD
+
 const byte FREQ_PIN = 2;
 volatile unsigned long ticksRise;
 volatile unsigned long ticksFall;
 volatile unsigned long ticksLow;
 volatile unsigned long ticksHigh;
 
+// Each completed period is queued by the ISR so that loop() can filter and
+// average all of them rather than just displaying the most recent one.
+struct PeriodSample {
+    unsigned long high;
+    unsigned long low;
+    unsigned long rise;     // micros() at the rising edge that ended the period
+};
+PeriodSample periodQueue[PERIOD_QUEUE_SIZE];
+volatile uint8_t periodHead;
+volatile uint8_t periodTail;
+
 void isrPinChange() {
+    BENCH_ON(BENCH_ISR);
     if (digitalRead(2)) { //PIND & 0x04) {
         ticksRise = micros();
         ticksLow = ticksRise - ticksFall;
+        uint8_t next = (periodHead + 1) % PERIOD_QUEUE_SIZE;
+        if (next != periodTail) {
+            periodQueue[periodHead].high = ticksHigh;
+            periodQueue[periodHead].low = ticksLow;
+            periodQueue[periodHead].rise = ticksRise;
+            periodHead = next;
+        }
     } else {
         ticksFall = micros();
         ticksHigh = ticksFall - ticksRise;
     }
+    BENCH_OFF(BENCH_ISR);
 }
 
-void setup() {
-    delay(50);
-    display.initialize();
+// Edge skew calibration
+//
+// The rising and falling edges take different paths through isrPinChange, so the
+// time from the edge to the micros() read is not the same for both.  Every high time
+// reads long or short by the difference and every low time the other way, which skews
+// the duty cycle more as the frequency goes up.  The skew is measured by looping a
+// square wave from Timer1 on D9, which is exactly 50% because it toggles on every
+// compare match, back into D2.  Half of the difference between the average high and
+// low times is the skew.  It is saved in EEPROM and taken off the high time and added
+// to the low time of each result.
+//
+// micros() only counts in 4us steps of 64 clock cycles, so the half period of the
+// square wave is made one cycle longer than a whole number of steps.  Each edge then
+// lands one cycle later in the step than the last one, and the edges sweep across the
+// whole step every 64 half periods, so the rounding averages out to well under a
+// microsecond.  With a half period of exactly whole steps, every edge would round the
+// same way and the result would be the rounding, not the skew.
+const byte CAL_PIN = 9;         // OC1A
+#define CAL_HALF_CYCLES     (F_CPU / 2 / PERIOD_CAL_HZ + 1)
+
+struct EdgeCalibration {
+    uint16_t magic;
+    float skewUs;
+};
+#define EDGE_CAL_MAGIC      0x5343
+#define EDGE_CAL_ADDRESS    ((EdgeCalibration *)0)
+
+float edgeSkewUs;
+uint8_t calSeconds;             // seconds of calibration left, zero when not calibrating
+unsigned long calHigh;
+unsigned long calLow;
+unsigned calCount;
+uint8_t calShowSeconds;         // seconds left to show the calibration result
+
+MedianFilter periodFilter;
+LatencyProbe latency;
+bool fShowLatency;
+bool fLatencyPending;           // an update is timed until its fields are all sent
+unsigned long lastUpdateMs;
+unsigned long lastFrameMs;
+unsigned long lastEdgeUs;
+unsigned long sumHigh;
+unsigned long sumLow;
+unsigned nAccepted;
+unsigned long frameSum;         // accepted periods since the last frame
+unsigned frameCount;
+
+// The frequency is redrawn every frame from the periods in that frame, and the high,
+// low and duty cycle once a second from the periods in that second.  The one second
+// frequency only goes to the serial port.  The compositor keeps the total within
+// PERIOD_FRAME_BYTES per frame.
+TextField freqField(display, 0, 5*8, 9, true);
+TextField highField(display, 2, 5*8, 9, true);
+TextField lowField(display, 4, 5*8, 9, true);
+TextField dutyField(display, 6, 5*8, 10, true);
+
+// The labels and units are fields too, so that the background refresh can repair them
+// along with the readings.
+TextField freqLabel(display, 0, 0, 5, true);
+TextField highLabel(display, 2, 0, 5, true);
+TextField lowLabel(display, 4, 0, 5, true);
+TextField dutyLabel(display, 6, 0, 5, true);
+TextField freqUnit(display, 0, 14*8, 2, true);
+TextField highUnit(display, 2, 14*8, 2, true);
+TextField lowUnit(display, 4, 14*8, 2, true);
+TextField dutyUnit(display, 6, 15*8, 1, true);
+TextField * const periodScreen[] = {
+    &freqLabel, &highLabel, &lowLabel, &dutyLabel,
+    &freqUnit, &highUnit, &lowUnit, &dutyUnit,
+    &freqField, &highField, &lowField, &dutyField
+};
+RefreshScheduler periodRefresh(display, periodScreen, sizeof(periodScreen) / sizeof(periodScreen[0]),
+                               REFRESH_BYTES_PER_SEC, 1000000);
+CompositorField periodFields[] = {
+    { &freqField, 2, PERIOD_FRAME_MS, 0 },
+    { &highField, 1, 1000, 0 },
+    { &lowField, 1, 1000, 0 },
+    { &dutyField, 1, 1000, 0 }
+};
+Compositor compositor(periodFields, sizeof(periodFields) / sizeof(periodFields[0]), PERIOD_FRAME_BYTES);
+
+void drawPeriodLabels() {
+    freqLabel.set("Freq:");
+    highLabel.set("High:");
+    lowLabel.set("Low: ");
+    dutyLabel.set("Duty:");
+    freqUnit.set("Hz");
+    highUnit.set("ms");
+    lowUnit.set("ms");
+    dutyUnit.set("%");
+    const uint8_t count = sizeof(periodScreen) / sizeof(periodScreen[0]);
+    for (uint8_t ix = 0; ix < count; ix++) {
+        periodScreen[ix]->invalidate();
+    }
+    flushFields(periodScreen, count);
+}
+
+void setFrequency(float f) {
+    char buffer[16];
+    dtostrf(f, 9, f < 10.0 ? 2 : 0, buffer);
+    freqField.set(buffer);
+}
+
+// formatLatency
+//
+// Five characters of milliseconds, with as many decimals as fit.
+void formatLatency(char * buffer, uint32_t us) {
+    float ms = us / 1000.0;
+    int prec = (ms < 10.0) ? 3 : (ms < 100.0) ? 2 : (ms < 1000.0) ? 1 : 0;
+    dtostrf(ms, 5, prec, buffer);
+}
+
+// drawLatency
+//
+// The diagnostics screen.  Shows the latency statistics of the normal screen updates
+// since the diagnostics screen was last closed, and prints the same table to serial.
+void drawLatency() {
+    static const char names[][4] = { "wai", "cal", "fmt", "i2c", "tot" };
+    char buffer[24];
+
     display.clear();
-    display.text2x(0, 0, "Freq:         Hz");
-    display.text2x(2, 0, "High:         ms");
-    display.text2x(4, 0, "Low:          ms");
-    display.text2x(6, 0, "Duty:          %");
+    snprintf(buffer, sizeof(buffer), "Latency   n=%u", latency.count());
+    display.text(0, 0, buffer);
+    Serial.println(buffer);
+    if (latency.count() == 0) {
+        return;
+    }
+    display.text(2, 0, "ms    min  mean   max");
+    Serial.println(F("ms    min  mean   max"));
+
+    for (uint8_t ix = 0; ix <= LatencyProbe::TOTAL; ix++) {
+        strcpy(buffer, names[ix]);
+        buffer[3] = ' ';
+        formatLatency(&buffer[4], latency.minimum(ix));
+        buffer[9] = ' ';
+        formatLatency(&buffer[10], latency.mean(ix));
+        buffer[15] = ' ';
+        formatLatency(&buffer[16], latency.maximum(ix));
+        display.text(3 + ix, 0, buffer);
+        Serial.println(buffer);
+    }
+}
+
+void startCalibration() {
+    pinMode(CAL_PIN, OUTPUT);
+    TCCR1A = _BV(COM1A0);                   // toggle OC1A on compare match
+    TCCR1B = _BV(WGM12) | _BV(CS10);        // CTC mode, no prescaler
+    OCR1A = CAL_HALF_CYCLES - 1;
+
+    // The first second is discarded because it has periods from before the switch
+    calSeconds = PERIOD_CAL_SECONDS + 1;
+    calHigh = calLow = 0;
+    calCount = 0;
+    fLatencyPending = false;
+    display.text2x(0, 5*8, "calibrate");
+    freqField.invalidate();
+    Serial.println(F("calibrating, connect D9 to D2"));
+}
+
+// calibrateStep
+//
+// Called once a second during calibration with that second's sums.  At the end, the
+// average period is checked against the calibration frequency to make sure that D9
+// really was connected.
+void calibrateStep() {
+    if (calSeconds <= PERIOD_CAL_SECONDS) {
+        calHigh += sumHigh;
+        calLow += sumLow;
+        calCount += nAccepted;
+    }
+    if (--calSeconds) {
+        return;
+    }
+
+    TCCR1A = 0;
+    TCCR1B = 0;
+    pinMode(CAL_PIN, INPUT);
+
+    // The result stays on the display for a few seconds, then the normal screen is
+    // drawn again.
+    calShowSeconds = 3;
+    float expected = 2.0 * CAL_HALF_CYCLES * 1000000.0 / F_CPU;
+    if ((calCount == 0) || (fabs((float)(calHigh + calLow) / calCount - expected) > expected / 100)) {
+        display.text2x(0, 0, "Cal: no signal  ");
+        Serial.println(F("calibration failed, no signal from D9"));
+        return;
+    }
+
+    EdgeCalibration cal;
+    cal.magic = EDGE_CAL_MAGIC;
+    cal.skewUs = ((float)calHigh - (float)calLow) / 2 / calCount;
+    eeprom_update_block(&cal, EDGE_CAL_ADDRESS, sizeof(cal));
+    edgeSkewUs = cal.skewUs;
+    Serial.print(F("edge skew "));
+    Serial.print(edgeSkewUs, 3);
+    Serial.println(F(" us"));
+
+    char buffer[20];
+    char number[12];
+    dtostrf(edgeSkewUs, 7, 3, number);
+    snprintf(buffer, sizeof(buffer), "Skew: %s us", number);
+    display.text2x(0, 0, buffer);
+}
+
+void periodSetup() {
+    drawPeriodLabels();
+
+    EdgeCalibration cal;
+    eeprom_read_block(&cal, EDGE_CAL_ADDRESS, sizeof(cal));
+    edgeSkewUs = (cal.magic == EDGE_CAL_MAGIC) ? cal.skewUs : 0.0;
 
     ticksRise = ticksFall = micros();
     pinMode(FREQ_PIN, INPUT_PULLUP);
     attachInterrupt(digitalPinToInterrupt(FREQ_PIN), isrPinChange, CHANGE);
+    lastUpdateMs = lastFrameMs = millis();
 }
 
+// periodFrame
+//
+// Redraw whatever the compositor has budget for.  Below the frame rate there are no
+// periods in most frames, so the frequency is left at the last value.  The fields of
+// a one second update can take more than one frame, so its display stage ends with the
+// frame that sends the last of them.
+void periodFrame() {
+    if (frameCount) {
+        setFrequency(frameCount * 1000000.0 / tempcoTicks(frameSum));
+        frameSum = 0;
+        frameCount = 0;
+    }
+    BENCH_ON(BENCH_DISPLAY);
+    compositor.frame();
+    BENCH_OFF(BENCH_DISPLAY);
 
-void loop() {
-    delay(1000);
-    char buffer[20];
-    unsigned long myLow = ticksLow;
-    unsigned long myHigh = ticksHigh;
-    float f;
-    int prec;
-
-    f = 1000000.0 / (myLow + myHigh);
-    prec = f < 10.0 ? 2 : 0;
-    dtostrf(f, 9, prec, buffer);
-    display.text2x(0, 5*8, buffer);
-
-    f = myHigh / 1000.0;
-    prec = f >= 1000.0 ? 0 : 3; 
-    dtostrf(f, 9, prec, buffer);
-    display.text2x(2, 5*8, buffer);
-
-    f = myLow / 1000.0;
-    prec = f >= 1000.0 ? 0 : 3; 
-    dtostrf(f, 9, prec, buffer);
-    display.text2x(4, 5*8, buffer);
-
-    dtostrf(myHigh * 100.0 / (myHigh + myLow), 10, 2, buffer);
-    display.text2x(6, 5*8, buffer);
+    if (fLatencyPending && !highField.dirty() && !lowField.dirty() && !dutyField.dirty()) {
+        fLatencyPending = false;
+        latency.mark(LatencyProbe::DISPLAY);
+    }
 }
 
+void periodLoop() {
+    // Run every queued period through the outlier filter and average the good ones.
+    while (periodTail != periodHead) {
+        PeriodSample & sample = periodQueue[periodTail];
+        if (periodFilter.add(sample.high + sample.low)) {
+            sumHigh += sample.high;
+            sumLow += sample.low;
+            nAccepted++;
+            lastEdgeUs = sample.rise;
+            frameSum += sample.high + sample.low;
+            frameCount++;
+        }
+        periodTail = (periodTail + 1) % PERIOD_QUEUE_SIZE;
+    }
+
+    switch (Serial.read()) {
+        case 'l':
+            // The diagnostics screen replaces the normal one until it is toggled off
+            // again, which also starts a new set of latency statistics.
+            fShowLatency = !fShowLatency;
+            if (fShowLatency) {
+                drawLatency();
+            } else {
+                display.clear();
+                drawPeriodLabels();
+                latency.reset();
+                fLatencyPending = false;
+            }
+            break;
+        case 'c':
+            if (!calSeconds && !calShowSeconds)  startCalibration();
+            break;
+    }
 
+    if (millis() - lastFrameMs < PERIOD_FRAME_MS) {
+        if (!fShowLatency && !calSeconds && !calShowSeconds)  periodRefresh.idle(micros());
+        return;
+    }
+    lastFrameMs += PERIOD_FRAME_MS;
+    if (millis() - lastUpdateMs < 1000) {
+        if (!fShowLatency && !calSeconds && !calShowSeconds)  periodFrame();
+        return;
+    }
+    lastUpdateMs += 1000;
+    if (calSeconds) {
+        calibrateStep();
+    } else if (calShowSeconds) {
+        if (!--calShowSeconds && !fShowLatency)  drawPeriodLabels();
+    }
+    if (fShowLatency || calSeconds || calShowSeconds) {
+        sumHigh = sumLow = 0;
+        nAccepted = 0;
+        frameSum = 0;
+        frameCount = 0;
+        return;
+    }
+    BENCH_ON(BENCH_LOOP);
+    BENCH_ON(BENCH_COMPUTE);
+
+    // Below 1Hz there may not be a complete period in the last second, so fall back
+    // to the most recent edges.
+    float myHigh;
+    float myLow;
+    if (nAccepted) {
+        myHigh = (float)tempcoTicks(sumHigh) / nAccepted;
+        myLow = (float)tempcoTicks(sumLow) / nAccepted;
+        latency.start(lastEdgeUs);
+    } else {
+        myHigh = tempcoTicks(ticksHigh);
+        myLow = tempcoTicks(ticksLow);
+        latency.start(ticksRise);
+    }
+    latency.mark(LatencyProbe::WAIT);
+    sumHigh = sumLow = 0;
+    nAccepted = 0;
+    myHigh -= edgeSkewUs;
+    myLow += edgeSkewUs;
 
+    float f = 1000000.0 / (myLow + myHigh);
+    float high = myHigh / 1000.0;
+    float low = myLow / 1000.0;
+    float duty = myHigh * 100.0 / (myHigh + myLow);
+    BENCH_OFF(BENCH_COMPUTE);
+    latency.mark(LatencyProbe::COMPUTE);
+
+    char buffer[16];
+    dtostrf(high, 9, high >= 1000.0 ? 0 : 3, buffer);
+    highField.set(buffer);
+    dtostrf(low, 9, low >= 1000.0 ? 0 : 3, buffer);
+    lowField.set(buffer);
+    dtostrf(duty, 10, 2, buffer);
+    dutyField.set(buffer);
+    latency.mark(LatencyProbe::FORMAT);
+
+    fLatencyPending = true;
+    periodFrame();
+
+    // There is no room left on the display for the outlier count, so it is
+    // reported on the serial port along with the one second frequency.
+    dtostrf(f, 9, f < 10.0 ? 2 : 0, buffer);
+    Serial.print(buffer);
+    Serial.print(F(" Hz, rejected "));
+    Serial.println(periodFilter.rejected());
+    BENCH_OFF(BENCH_LOOP);
+}
+#endif
+
+
+void setup() {
+    delay(50);
+    benchBegin();
+    Serial.begin(SERIAL_BAUD);
+#if USE_DISPLAY
+    display.initialize();
+    display.clear();
+    benchGlyphs();
+#endif
+    tempcoBegin();
+
+#if SUPERFREQ_MODE == MODE_COUNTER
+    counterSetup();
+#elif SUPERFREQ_MODE == MODE_BURST
+    burstSetup();
+#elif SUPERFREQ_MODE == MODE_DRIFT
+    driftSetup();
+#elif SUPERFREQ_MODE == MODE_TRIGGER
+    triggerSetup();
+#elif SUPERFREQ_MODE == MODE_USART
+    usartSetup();
+#elif SUPERFREQ_MODE == MODE_SETTLE
+    settleSetup();
+#elif SUPERFREQ_MODE == MODE_DASHBOARD
+    dashboardSetup();
+#elif SUPERFREQ_MODE == MODE_LOGGER
+    loggerSetup();
+#elif SUPERFREQ_MODE == MODE_GATED
+    gatedSetup();
+#elif SUPERFREQ_MODE == MODE_SYNC
+    syncSetup();
+#elif SUPERFREQ_MODE == MODE_RATIO
+    ratioSetup();
+#elif SUPERFREQ_MODE == MODE_SLAVE
+    slaveSetup();
+#elif SUPERFREQ_MODE == MODE_SWEEP
+    sweepSetup();
+#elif SUPERFREQ_MODE == MODE_PIPELINE
+    pipelineSetup();
+#elif SUPERFREQ_MODE == MODE_FSK
+    fskSetup();
+#elif SUPERFREQ_MODE == MODE_MAINS
+    mainsSetup();
+#elif SUPERFREQ_MODE == MODE_TEMPCO
+    tempcoSetup();
+#else
+    periodSetup();
+#endif
+}
+
+
+void loop() {
+    tempcoPoll();
+#if USE_DISPLAY && (SUPERFREQ_MODE != MODE_PERIOD) && (SUPERFREQ_MODE != MODE_DASHBOARD)
+    displayRefresh.idle(refreshClock());
+#endif
+
+#if SUPERFREQ_MODE == MODE_COUNTER
+    counterLoop();
+#elif SUPERFREQ_MODE == MODE_BURST
+    burstLoop();
+#elif SUPERFREQ_MODE == MODE_DRIFT
+    driftLoop();
+#elif SUPERFREQ_MODE == MODE_TRIGGER
+    triggerLoop();
+#elif SUPERFREQ_MODE == MODE_USART
+    usartLoop();
+#elif SUPERFREQ_MODE == MODE_SETTLE
+    settleLoop();
+#elif SUPERFREQ_MODE == MODE_DASHBOARD
+    dashboardLoop();
+#elif SUPERFREQ_MODE == MODE_LOGGER
+    loggerLoop();
+#elif SUPERFREQ_MODE == MODE_GATED
+    gatedLoop();
+#elif SUPERFREQ_MODE == MODE_SYNC
+    syncLoop();
+#elif SUPERFREQ_MODE == MODE_RATIO
+    ratioLoop();
+#elif SUPERFREQ_MODE == MODE_SLAVE
+    slaveLoop();
+#elif SUPERFREQ_MODE == MODE_SWEEP
+    sweepLoop();
+#elif SUPERFREQ_MODE == MODE_PIPELINE
+    pipelineLoop();
+#elif SUPERFREQ_MODE == MODE_FSK
+    fskLoop();
+#elif SUPERFREQ_MODE == MODE_MAINS
+    mainsLoop();
+#elif SUPERFREQ_MODE == MODE_TEMPCO
+    tempcoLoop();
+#else
+    periodLoop();
+#endif
+}
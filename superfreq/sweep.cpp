@@ -0,0 +1,256 @@
+#include "superfreq.h"
+#include "sweep.h"
+#include "capture.h"
+#include "stable.h"
+#include "tempco.h"
+#include "timebase.h"
+
+#if SUPERFREQ_MODE == MODE_SWEEP
+
+const byte PWM_PIN = 9;         // OC1A
+#define PWM_TOP         1023    // 10 bits, 16MHz / 1024 = 15.6kHz
+
+struct SweepPoint {
+    uint32_t period;            // settled period in timebase ticks, zero if no input
+    uint16_t settleMs;
+    bool fStable;
+};
+
+static SweepPoint points[SWEEP_STEPS];
+static StabilityDetector detector(SWEEP_TOLERANCE_PPM, SWEEP_HOLD);
+static bool fSweeping;
+static uint8_t step;
+static uint32_t stepTicks;      // when the level for this step was set
+static bool fHaveRise;
+static uint32_t lastRise;
+
+
+static uint16_t pwmLevel(uint8_t ix) {
+    float v = SWEEP_FROM_V + (SWEEP_TO_V - SWEEP_FROM_V) * ix / (SWEEP_STEPS - 1);
+    long level = (long)(v / SWEEP_FULL_SCALE_V * PWM_TOP + 0.5);
+    return (level < 0) ? 0 : (level > PWM_TOP) ? PWM_TOP : level;
+}
+
+
+// The voltage that the PWM level really gives, after rounding to a whole count
+static float levelVolts(uint8_t ix) {
+    return (float)pwmLevel(ix) * SWEEP_FULL_SCALE_V / PWM_TOP;
+}
+
+
+static float pointFreq(uint8_t ix) {
+    return points[ix].period ? tempcoHz(TIMEBASE_HZ) / points[ix].period : 0.0;
+}
+
+
+static void setLevel(uint8_t ix) {
+    OCR1A = pwmLevel(ix);
+    stepTicks = timebaseNow();
+    fHaveRise = false;
+    detector.reset(stepTicks);
+}
+
+
+static void startSweep(void) {
+    display.clear();
+    display.text(0, 0, "Sweep");
+    Serial.println(F("volts,hz,settle_ms,stable"));
+    fSweeping = true;
+    step = 0;
+    setLevel(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Results
+//
+// Rows 0..2 show the fit in the small font and rows 3..7 plot the curve, with each
+// point as a short dash and the fitted line dotted.
+
+enum {
+    PLOT_ROW = 3,
+    PLOT_ROWS = 5,
+    PLOT_HEIGHT = PLOT_ROWS * 8
+};
+
+static void drawPlot(float gain, float offset, float lo, float hi) {
+    float scale = (hi > lo) ? (PLOT_HEIGHT - 1) / (hi - lo) : 0;
+    float vFrom = levelVolts(0);
+    float vTo = levelVolts(SWEEP_STEPS - 1);
+
+    uint8_t pointY[SWEEP_STEPS];
+    uint8_t pointX[SWEEP_STEPS];
+    for (uint8_t ix = 0; ix < SWEEP_STEPS; ix++) {
+        float f = pointFreq(ix);
+        pointX[ix] = (uint16_t)ix * 125 / (SWEEP_STEPS - 1) + 1;
+        pointY[ix] = points[ix].period ? (PLOT_HEIGHT - 1) - (uint8_t)((f - lo) * scale) : 0xff;
+    }
+
+    uint8_t pixels[128];
+    for (uint8_t row = 0; row < PLOT_ROWS; row++) {
+        for (uint8_t col = 0; col < 128; col++) {
+            uint8_t bits = 0;
+            if ((col & 3) == 0) {
+                float f = offset + gain * (vFrom + (vTo - vFrom) * (col - 1) / 125);
+                if ((f >= lo) && (f <= hi)) {
+                    uint8_t y = (PLOT_HEIGHT - 1) - (uint8_t)((f - lo) * scale);
+                    if ((y >> 3) == row)  bits |= 1 << (y & 7);
+                }
+            }
+            pixels[col] = bits;
+        }
+        for (uint8_t ix = 0; ix < SWEEP_STEPS; ix++) {
+            if ((pointY[ix] >> 3) == row) {
+                for (uint8_t col = pointX[ix] - 1; col <= pointX[ix] + 1; col++) {
+                    pixels[col] |= 1 << (pointY[ix] & 7);
+                }
+            }
+        }
+        display.fillAreaWithBytes(PLOT_ROW + row, 0, 1, 128, pixels, sizeof(pixels));
+    }
+}
+
+
+// endSweep
+//
+// Fit a line to the points that have a frequency and show and print it.
+static void endSweep(void) {
+    fSweeping = false;
+
+    float sumV = 0.0, sumF = 0.0, sumVV = 0.0, sumVF = 0.0;
+    float lo = 0.0, hi = 0.0;
+    uint8_t n = 0;
+    uint8_t unstable = 0;
+    for (uint8_t ix = 0; ix < SWEEP_STEPS; ix++) {
+        if (!points[ix].fStable)  unstable++;
+        if (!points[ix].period)  continue;
+        float v = levelVolts(ix);
+        float f = pointFreq(ix);
+        sumV += v;
+        sumF += f;
+        sumVV += v * v;
+        sumVF += v * f;
+        if (!n || (f < lo))  lo = f;
+        if (!n || (f > hi))  hi = f;
+        n++;
+    }
+
+    char buffer[24];
+    char number[12];
+    float d = n * sumVV - sumV * sumV;
+    if ((n < 2) || (d == 0.0)) {
+        display.text(0, 0, "Sweep       no input");
+        Serial.println(F("# no fit"));
+        return;
+    }
+    float gain = (n * sumVF - sumV * sumF) / d;
+    float offset = (sumF - gain * sumV) / n;
+
+    float worst = 0.0;
+    for (uint8_t ix = 0; ix < SWEEP_STEPS; ix++) {
+        if (!points[ix].period)  continue;
+        float error = fabs(pointFreq(ix) - (offset + gain * levelVolts(ix)));
+        if (error > worst)  worst = error;
+    }
+    float nonlinearity = (hi > lo) ? worst / (hi - lo) * 100.0 : 0.0;
+
+    dtostrf(gain, 10, 2, number);
+    snprintf(buffer, sizeof(buffer), "Gain %s Hz/V", number);
+    display.text(0, 0, buffer);
+    dtostrf(nonlinearity, 8, 3, number);
+    snprintf(buffer, sizeof(buffer), "Nonlin  %s %%FS", number);
+    display.text(1, 0, buffer);
+    snprintf(buffer, sizeof(buffer), "Steps %2u  unstable %2u", n, unstable);
+    display.text(2, 0, buffer);
+    drawPlot(gain, offset, lo, hi);
+
+    Serial.print(F("# gain "));
+    Serial.print(gain, 3);
+    Serial.print(F(" Hz/V, offset "));
+    Serial.print(offset, 3);
+    Serial.print(F(" Hz, nonlinearity "));
+    Serial.print(nonlinearity, 3);
+    Serial.println(F(" %FS"));
+}
+
+
+// finishStep
+//
+// Record the step and move on to the next level.  The settling time runs from the
+// level change to the start of the run that was stable.
+static void finishStep(bool fStable) {
+    SweepPoint & p = points[step];
+    p.period = detector.mean();
+    p.fStable = fStable;
+    p.settleMs = fStable ? tempcoTicks(detector.start() - stepTicks) / (TIMEBASE_HZ / 1000) : SWEEP_STEP_TIMEOUT_MS;
+
+    char buffer[24];
+    char number[12];
+    snprintf(buffer, sizeof(buffer), "Sweep  %2u/%2u", step + 1, SWEEP_STEPS);
+    display.text(0, 0, buffer);
+    dtostrf(pointFreq(step), 11, 2, number);
+    snprintf(buffer, sizeof(buffer), "Last %s Hz", number);
+    display.text(1, 0, buffer);
+
+    Serial.print(levelVolts(step), 4);
+    Serial.print(',');
+    Serial.print(pointFreq(step), 3);
+    Serial.print(',');
+    Serial.print(p.settleMs);
+    Serial.print(',');
+    Serial.println(fStable ? 1 : 0);
+
+    if (++step < SWEEP_STEPS) {
+        setLevel(step);
+    } else {
+        endSweep();
+    }
+}
+
+
+void sweepSetup(void) {
+    pinMode(PWM_PIN, OUTPUT);
+    ICR1 = PWM_TOP;
+    OCR1A = 0;
+    TCCR1A = _BV(COM1A1) | _BV(WGM11);              // fast PWM with TOP in ICR1
+    TCCR1B = _BV(WGM13) | _BV(WGM12) | _BV(CS10);   // no prescaler
+
+    timebaseBegin();
+    captureBegin(RISING);
+    startSweep();
+}
+
+
+void sweepLoop(void) {
+    if (Serial.read() == 'g') {
+        startSweep();
+    }
+
+    CaptureEdge edge;
+    while (captureGet(edge)) {
+        // Edges from before the level changed belong to the last step
+        if (!fSweeping || ((int32_t)(edge.ticks - stepTicks) < 0)) {
+            continue;
+        }
+        if (fHaveRise && detector.add(lastRise, edge.ticks - lastRise)) {
+            finishStep(true);
+            continue;
+        }
+        if (!fHaveRise) {
+            detector.reset(edge.ticks);
+        }
+        fHaveRise = true;
+        lastRise = edge.ticks;
+    }
+
+    if (captureTakeOverruns()) {
+        // A lost edge makes a long period, so start the run again
+        fHaveRise = false;
+    }
+
+    if (fSweeping && (timebaseNow() - stepTicks > timebaseTicksFromMs(SWEEP_STEP_TIMEOUT_MS))) {
+        finishStep(false);
+    }
+}
+
+#endif
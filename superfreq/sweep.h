@@ -0,0 +1,32 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <Arduino.h>
+
+// VCO transfer curve sweep
+//
+// Steps a control voltage through SWEEP_STEPS evenly spaced levels from SWEEP_FROM_V to
+// SWEEP_TO_V and measures the frequency on D2 at each one, to characterize a VCO or the
+// control voltage input of a 555.  The control voltage is a 15.6kHz 10-bit PWM on D9
+// (Timer1), which needs an RC filter, for example 10K and 1uF, before the VCO input.
+//
+// Each step ends as soon as the frequency is stable, using the same detector as the
+// settle mode: SWEEP_HOLD periods in a row within SWEEP_TOLERANCE_PPM of their mean.
+// The mean of that run is the frequency for the step.  A step that doesn't settle within
+// SWEEP_STEP_TIMEOUT_MS uses the mean of its last run and is flagged as unstable.  The
+// settled time is also recorded, which includes the filter's own settling.
+//
+// When the sweep is done, a straight line is fitted to the curve by least squares.  The
+// display shows the gain in Hz/V, the nonlinearity as the largest difference from the
+// line as a percentage of the frequency span, and a plot of the curve against the line.
+//
+// Each step is printed on the serial port as volts, Hz, settling time in ms, and 1 if
+// it was stable or 0 if not, followed by a comment line with the fit.
+//
+// Serial commands:
+//   g    start a new sweep
+
+void sweepSetup(void);
+void sweepLoop(void);
+
+#endif
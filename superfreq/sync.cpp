@@ -0,0 +1,350 @@
+#include "superfreq.h"
+#include "sync.h"
+#include "counter.h"
+#include "timebase.h"
+
+#if USE_SYNC
+
+const byte SYNC_PIN = 3;        // INT1
+
+#define SYNC_FRAME          32
+#define SYNC_UNIT_TICKS     256                 // one timebase overflow
+#define SYNC_PERIOD_TICKS   (SYNC_PERIOD_MS * (TIMEBASE_HZ / 1000UL))
+#define SYNC_QUEUE_SIZE     4                   // must be a power of two
+#define SYNC_RATE_PULSES    16                  // pulses that the rate is measured over
+#define SYNC_EDGE_TICK      128                 // Timer2 count at which the edges are made
+
+// 2000 ticks a ms, so 16ms is 125 overflows
+#if SYNC_PERIOD_MS % 16
+#error SYNC_PERIOD_MS must be a multiple of 16ms
+#endif
+
+enum {
+    PULSE_ZERO,
+    PULSE_ONE,
+    PULSE_MARKER,
+    PULSE_BAD
+};
+
+struct SyncPulse {
+    uint32_t rise;      // timebase ticks at the rising edge
+    uint16_t width;     // ticks from the rising edge to the falling edge
+};
+
+// Pulse generation, used by the timebase overflow ISR on the master
+static bool fMaster;
+static uint32_t nextPulse;          // ticks at which the next pulse starts
+static uint32_t emitIndex;          // number of the next pulse
+static uint8_t pulseUnits;          // overflows left in the current pulse
+
+// Pulses received by the INT1 ISR
+static SyncPulse pulseQueue[SYNC_QUEUE_SIZE];
+static volatile uint8_t pulseHead;
+static volatile uint8_t pulseTail;
+static uint32_t riseTicks;
+
+// Decoder state, only used from loop()
+static int8_t framePos;             // position in the frame of the next pulse, -1 if unknown
+static uint32_t frameBits;
+static bool fLocked;
+static uint32_t lastIndex;          // number of the last pulse, valid when locked
+static uint32_t lastTicks;          // local ticks of the last pulse
+static bool fHaveLast;
+static uint32_t history[SYNC_RATE_PULSES];  // local ticks of the last pulses, a ring
+static uint8_t historyPos;          // where the next pulse goes in history
+static uint8_t historyCount;        // pulses in history that follow on from each other
+static uint32_t spanTicks;          // local ticks over spanPeriods periods
+static uint8_t spanPeriods;         // 0 if the rate is unknown
+
+
+ISR(INT1_vect) {
+    uint8_t pins = PIND;
+    uint32_t t = timebaseNowFromIsr();
+    if (pins & _BV(PD3)) {
+        riseTicks = t;
+    } else {
+        uint8_t head = pulseHead;
+        uint8_t next = (head + 1) & (SYNC_QUEUE_SIZE - 1);
+        if (next != pulseTail) {
+            pulseQueue[head].rise = riseTicks;
+            uint32_t width = t - riseTicks;
+            pulseQueue[head].width = (width > 0xffff) ? 0xffff : width;
+            pulseHead = next;
+        }
+    }
+}
+
+
+// Length of pulse k in overflows
+static uint8_t pulseLength(uint32_t k) {
+    uint8_t pos = k % SYNC_FRAME;
+    if (pos == 0)  return 3;
+    return ((k / SYNC_FRAME) >> (pos - 1)) & 1 ? 2 : 1;
+}
+
+
+// Compare output modes of OC2B
+#define SYNC_OC2B_CLEAR     _BV(COM2B1)
+#define SYNC_OC2B_SET       (_BV(COM2B1) | _BV(COM2B0))
+
+// syncEdge
+//
+// Make OC2B set or clear D3 when Timer2 reaches SYNC_EDGE_TICK in this overflow.  It
+// does the same at every overflow after that, which changes nothing until the mode is
+// switched again.  If the interrupt ran so late that the count is already there, the
+// edge is forced now instead, a little late.  Forcing an edge that the compare match
+// has just made does nothing.
+static void syncEdge(uint8_t mode) {
+    TCCR2A = (TCCR2A & ~(_BV(COM2B1) | _BV(COM2B0))) | mode;
+    if (TCNT2 >= SYNC_EDGE_TICK) {
+        TCCR2B |= _BV(FOC2B);
+    }
+}
+
+
+// syncOverflow
+//
+// Called by the timebase overflow ISR.  On the master, starts a pulse when it is due
+// and ends it after its length in overflows.
+void syncOverflow(void) {
+    if (!fMaster)  return;
+
+    if (pulseUnits) {
+        if (--pulseUnits == 0) {
+            syncEdge(SYNC_OC2B_CLEAR);
+        }
+    } else if ((int32_t)((timebaseOverflows << 8) - nextPulse) >= 0) {
+        syncEdge(SYNC_OC2B_SET);
+        pulseUnits = pulseLength(emitIndex++);
+        nextPulse += SYNC_PERIOD_TICKS;
+    }
+}
+
+
+void syncBegin(bool master) {
+    uint8_t oldSREG = SREG;
+    cli();
+    fMaster = master;
+    if (fMaster) {
+        // Timer2 stays in normal mode for the timebase, with OC2B driving D3
+        OCR2B = SYNC_EDGE_TICK;
+        TCCR2A = (TCCR2A & ~(_BV(COM2B1) | _BV(COM2B0))) | SYNC_OC2B_CLEAR;
+        TCCR2B |= _BV(FOC2B);
+        digitalWrite(SYNC_PIN, LOW);
+        pinMode(SYNC_PIN, OUTPUT);
+    } else {
+        pinMode(SYNC_PIN, INPUT);
+    }
+    nextPulse = (timebaseNowFromIsr() & ~(uint32_t)(SYNC_UNIT_TICKS - 1)) + SYNC_PERIOD_TICKS;
+    emitIndex = 0;
+    pulseUnits = 0;
+    pulseHead = pulseTail = 0;
+    EICRA = (EICRA & ~(_BV(ISC11) | _BV(ISC10))) | _BV(ISC10);     // INT1 on any change
+    EIFR = _BV(INTF1);
+    EIMSK |= _BV(INT1);
+    SREG = oldSREG;
+
+    framePos = -1;
+    fLocked = false;
+    fHaveLast = false;
+    historyCount = 0;
+    spanPeriods = 0;
+}
+
+
+static uint8_t classify(uint16_t width) {
+    if (width < SYNC_UNIT_TICKS * 3 / 2)  return PULSE_ZERO;
+    if (width < SYNC_UNIT_TICKS * 5 / 2)  return PULSE_ONE;
+    if (width < SYNC_UNIT_TICKS * 7 / 2)  return PULSE_MARKER;
+    return PULSE_BAD;
+}
+
+
+// addHistory
+//
+// Keep the time of a pulse that follows on from the ones before it, and measure the
+// local period over as many of them as there are.
+static void addHistory(uint32_t rise) {
+    if (historyCount < SYNC_RATE_PULSES)  historyCount++;
+    history[historyPos] = rise;
+    historyPos = (historyPos + 1) % SYNC_RATE_PULSES;
+
+    // The oldest pulse kept is historyCount - 1 places before this one
+    uint8_t oldest = (historyPos + SYNC_RATE_PULSES - historyCount) % SYNC_RATE_PULSES;
+    spanPeriods = historyCount - 1;
+    spanTicks = rise - history[oldest];
+}
+
+
+// addPulse
+//
+// Follow the frame and keep the last pulse for mapping.  A pulse that arrives more
+// than half a period late means one was missed, so the count can't be trusted, and the
+// rate is measured again from this pulse.
+static void addPulse(const SyncPulse & pulse) {
+    uint8_t kind = classify(pulse.width);
+
+    if (fHaveLast) {
+        uint32_t interval = pulse.rise - lastTicks;
+        if ((interval > SYNC_PERIOD_TICKS * 3 / 2) || (interval < SYNC_PERIOD_TICKS / 2)) {
+            kind = PULSE_BAD;
+            historyCount = 0;
+        }
+    }
+    fHaveLast = true;
+    lastTicks = pulse.rise;
+    lastIndex++;
+    addHistory(pulse.rise);
+
+    if (kind == PULSE_BAD) {
+        framePos = -1;
+        fLocked = false;
+    } else if (kind == PULSE_MARKER) {
+        // The bits of the frame that just ended give its number, so this marker
+        // starts the next frame.
+        if (framePos == SYNC_FRAME) {
+            uint32_t index = (frameBits + 1) * SYNC_FRAME;
+            fLocked = !fLocked || (index == lastIndex);
+            lastIndex = index;
+        } else {
+            fLocked = false;
+        }
+        framePos = 1;
+        frameBits = 0;
+    } else if ((framePos > 0) && (framePos < SYNC_FRAME)) {
+        if (kind == PULSE_ONE)  frameBits |= 1UL << (framePos - 1);
+        framePos++;
+    } else {
+        framePos = -1;
+        fLocked = false;
+    }
+}
+
+
+void syncPoll(void) {
+    while (pulseTail != pulseHead) {
+        addPulse(pulseQueue[pulseTail]);
+        pulseTail = (pulseTail + 1) & (SYNC_QUEUE_SIZE - 1);
+    }
+}
+
+
+bool syncLocked(void) {
+    return fLocked;
+}
+
+
+uint32_t syncIndex(void) {
+    return lastIndex;
+}
+
+
+// syncRatePpm
+//
+// How fast the local timebase runs compared to the master, over the last
+// SYNC_RATE_PULSES pulses.
+float syncRatePpm(void) {
+    if (!spanPeriods)  return 0.0;
+    uint32_t expected = spanPeriods * SYNC_PERIOD_TICKS;
+    return (float)(int32_t)(spanTicks - expected) * 1000000.0 / expected;
+}
+
+
+// syncToCommon
+//
+// Map a local timebase tick count to common time, as ms and us since pulse zero.  The
+// time must be after the last pulse, or at most one period before it.  Returns false
+// if the unit isn't locked.
+bool syncToCommon(uint32_t ticks, uint32_t & ms, uint16_t & us) {
+    if (!fLocked || !spanPeriods)  return false;
+
+    uint32_t index = lastIndex;
+    int32_t delta = ticks - lastTicks;
+    if (delta < 0) {
+        index--;
+        delta += spanTicks / spanPeriods;
+        if (delta < 0)  return false;
+    }
+    float scale = (float)spanPeriods * SYNC_PERIOD_TICKS / spanTicks;
+    uint32_t offsetUs = delta * scale / (TIMEBASE_HZ / 1000000);
+    ms = index * SYNC_PERIOD_MS + offsetUs / 1000;
+    us = offsetUs % 1000;
+    return true;
+}
+
+#endif
+
+
+#if SUPERFREQ_MODE == MODE_SYNC
+
+// The labels and units either side of the readings
+static TextField freqLabel(display, 0, 0, 5, true);
+static TextField syncLabel(display, 2, 0, 5, true);
+static TextField indexLabel(display, 4, 0, 5, true);
+static TextField rateLabel(display, 6, 0, 5, true);
+static TextField freqUnit(display, 0, 14*8, 2, true);
+static TextField syncUnit(display, 2, 14*8, 2, true);
+static TextField indexUnit(display, 4, 14*8, 2, true);
+static TextField rateUnit(display, 6, 13*8, 3, true);
+static TextField * const labels[] = {
+    &freqLabel, &syncLabel, &indexLabel, &rateLabel,
+    &freqUnit, &syncUnit, &indexUnit, &rateUnit
+};
+
+void syncSetup(void) {
+    freqLabel.set("Freq:");
+    syncLabel.set("Sync:");
+    indexLabel.set("Idx:");
+    rateLabel.set("Rate:");
+    freqUnit.set("Hz");
+    rateUnit.set("ppm");
+    flushFields(labels, sizeof(labels) / sizeof(labels[0]));
+    displayRefresh.setFields(labels, sizeof(labels) / sizeof(labels[0]));
+
+    timebaseBegin();
+    syncBegin(SYNC_MASTER);
+    counterBegin();
+}
+
+
+void syncLoop(void) {
+    char buffer[20];
+    CounterGate gate;
+
+    syncPoll();
+    if (!counterPoll(timebaseTicksFromMs(SYNC_GATE_MS), gate)) {
+        return;
+    }
+
+    float seconds = (float)gate.ticks / TIMEBASE_HZ;
+    float f = gate.edges / seconds;
+    int prec = counterDecimals(f, gate);
+    dtostrf(f, 9, prec, buffer);
+    display.text2x(0, 5*8, buffer);
+
+    display.text2x(2, 5*8, !syncLocked() ? "   ------" : SYNC_MASTER ? "   master" : "   locked");
+    snprintf(buffer, sizeof(buffer), "%9lu", (unsigned long)syncIndex());
+    display.text2x(4, 5*8, buffer);
+    dtostrf(syncRatePpm(), 8, 2, buffer);
+    display.text2x(6, 5*8, buffer);
+
+    // unit, common time at the end of the gate, gate time, edges, frequency
+    uint32_t ms;
+    uint16_t us;
+    Serial.print(SYNC_UNIT_ID);
+    Serial.print(',');
+    if (syncToCommon(gate.end, ms, us)) {
+        snprintf(buffer, sizeof(buffer), "%lu.%03u", (unsigned long)ms, us);
+        Serial.print(buffer);
+    } else {
+        Serial.print('-');
+    }
+    Serial.print(',');
+    Serial.print(seconds, 6);
+    Serial.print(',');
+    Serial.print(gate.edges);
+    Serial.print(',');
+    Serial.println(f, prec);
+}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef SYNC_H
+#define SYNC_H
+
+#include <Arduino.h>
+
+// Sync line
+//
+// Puts the readings of several superfreq units on one timeline.  The units share a
+// sync line on D3.  One master unit drives a pulse onto it every SYNC_PERIOD_MS, and
+// every unit, the master included, timestamps the rising edge of each pulse with its
+// own timebase in the INT1 interrupt.  Pulse k marks common time k * SYNC_PERIOD_MS.
+// A local timestamp is mapped to common time from the nearest pulse before it, scaled
+// by the mean local period over the last SYNC_RATE_PULSES pulses, so a unit whose
+// crystal is off by some ppm still lands on the master's timeline.  Averaging over
+// many pulses keeps the jitter of the INT1 timestamps out of the rate.
+//
+// The pulses are counted in frames of 32.  The first pulse of a frame is a marker three
+// units long, where a unit is one timebase overflow (128us).  The other 31 pulses are
+// one unit for a zero bit or two units for a one bit, and give the frame number, least
+// significant bit first.  A unit that starts late locks at the second marker it sees,
+// and drops the lock if a pulse goes missing or a frame number doesn't follow on.
+//
+// The master generates the pulses in the timebase overflow interrupt, so loop() can't
+// delay them.  D3 is the Timer2 OC2B pin, so the interrupt only arms the compare match
+// to set or clear it half way through the overflow, and every edge lands exactly on
+// its tick however late the interrupt runs.  The INT1 interrupt fires for the
+// master's own output pin as well.
+
+void syncBegin(bool master);
+void syncPoll(void);
+void syncOverflow(void);
+
+bool syncLocked(void);
+uint32_t syncIndex(void);
+float syncRatePpm(void);
+bool syncToCommon(uint32_t ticks, uint32_t & ms, uint16_t & us);
+
+void syncSetup(void);
+void syncLoop(void);
+
+#endif
@@ -0,0 +1,349 @@
+#include <avr/eeprom.h>
+#include "superfreq.h"
+#include "tempco.h"
+#include "counter.h"
+#include "timebase.h"
+
+#if USE_TEMPCO
+
+#define CORRECT_TIMEBASE    (TEMPCO_ENABLE && (SUPERFREQ_MODE != MODE_TEMPCO))
+
+// Conversions thrown away after the switch to the 1.1V reference, while it settles
+#define DISCARD_SAMPLES     4
+
+static bool fStarted;
+static uint8_t discard;
+static uint16_t samples;
+static uint32_t sampleSum;
+static int16_t reading;             // 1/16 ADC count, zero until the first reading
+
+#if CORRECT_TIMEBASE
+static TempcoCurve curve;
+static bool fHaveCurve;
+static float clockPpm;
+static float clockScale;            // true clock rate over nominal
+static int32_t tickScale;           // correction factor minus one, times 2^32
+
+
+// setCorrection
+//
+// A clock that is fast by e counts 1 + e ticks for every true tick, so intervals are
+// corrected by multiplying them by 1 / (1 + e).
+static void setCorrection(void) {
+    clockPpm = fHaveCurve ? tempcoCurvePpm(curve, reading) : 0.0;
+    float e = clockPpm * 1.0e-6;
+    clockScale = 1.0 + e;
+    tickScale = lround(-e / (1.0 + e) * 4294967296.0);
+}
+
+
+float tempcoPpm(void) {
+    return clockPpm;
+}
+
+
+// tempcoTicks
+//
+// Correct an interval measured with the timebase to true time.
+uint32_t tempcoTicks(uint32_t ticks) {
+    return ticks + (int32_t)(((int64_t)ticks * tickScale) >> 32);
+}
+
+
+// tempcoHz
+//
+// Correct a frequency that the system clock counts as hz to the true frequency.
+float tempcoHz(float hz) {
+    return hz * clockScale;
+}
+#endif
+
+
+void tempcoBegin(void) {
+    // Temperature sensor against the internal 1.1V reference.  The ADC clock is left
+    // at the 125kHz that the Arduino core sets.
+    ADMUX = _BV(REFS1) | _BV(REFS0) | _BV(MUX3);
+    ADCSRA |= _BV(ADEN);
+    fStarted = false;
+    discard = DISCARD_SAMPLES;
+    samples = 0;
+    sampleSum = 0;
+    reading = 0;
+
+#if CORRECT_TIMEBASE
+    eeprom_read_block(&curve, TEMPCO_CURVE_ADDRESS, sizeof(curve));
+    fHaveCurve = (curve.magic == TEMPCO_MAGIC);
+    clockPpm = 0.0;
+    clockScale = 1.0;
+    tickScale = 0;
+    if (fHaveCurve) {
+        Serial.println(F("tempco curve loaded"));
+    } else {
+        Serial.println(F("no tempco curve, timebase not corrected"));
+    }
+#endif
+}
+
+
+// tempcoPoll
+//
+// Call frequently from loop().  Collects the result of the last conversion, if it is
+// done, and starts the next one.  Returns true when a new reading is ready.
+bool tempcoPoll(void) {
+    if (ADCSRA & _BV(ADSC))  return false;
+
+    if (fStarted) {
+        uint16_t value = ADC;
+        if (discard) {
+            discard--;
+        } else {
+            sampleSum += value;
+            samples++;
+        }
+    }
+    ADCSRA |= _BV(ADSC);
+    fStarted = true;
+
+    if (samples < TEMPCO_SAMPLES)  return false;
+    reading = sampleSum * 16 / TEMPCO_SAMPLES;
+    sampleSum = 0;
+    samples = 0;
+#if CORRECT_TIMEBASE
+    setCorrection();
+#endif
+    return true;
+}
+
+
+int16_t tempcoReading(void) {
+    return reading;
+}
+
+
+// Typical sensor response from the Atmel application note, good to about 10C
+float tempcoCelsius(int16_t reading) {
+    return (reading / 16.0 - 324.31) / 1.22;
+}
+
+
+float tempcoCurvePpm(const TempcoCurve & curve, int16_t reading) {
+    if (reading < curve.low)  reading = curve.low;
+    if (reading > curve.high)  reading = curve.high;
+    float x = (reading - curve.center) / 16.0;
+    return curve.c0 + x * (curve.c1 + x * curve.c2);
+}
+
+#endif
+
+
+#if SUPERFREQ_MODE == MODE_TEMPCO
+
+// The points must span this many 1/16 ADC counts before a line, and then a quadratic,
+// is fitted.  Until then the fit is only the mean error.
+#define LINEAR_SPAN         (2 * 16)
+#define QUADRATIC_SPAN      (10 * 16)
+
+// Points further off than this are a missing or wrong reference, not the clock
+#define MAX_ERROR_PPM       10000
+
+// Least squares sums, with x the reading minus the first one in ADC counts
+static float xSums[5];              // sum of x^k, xSums[0] is the number of points
+static float ySums[3];              // sum of error x^k
+static uint16_t points;
+static TempcoCurve fit;
+static bool fFit;
+
+
+static void restart(void) {
+    memset(xSums, 0, sizeof(xSums));
+    memset(ySums, 0, sizeof(ySums));
+    points = 0;
+    fFit = false;
+}
+
+
+// solve
+//
+// Solve n linear equations, the augmented matrix a, by Gaussian elimination with
+// partial pivoting.  Returns false if they are singular.
+static bool solve(float a[3][4], uint8_t n, float c[3]) {
+    for (uint8_t col = 0; col < n; col++) {
+        uint8_t pivot = col;
+        for (uint8_t row = col + 1; row < n; row++) {
+            if (fabs(a[row][col]) > fabs(a[pivot][col]))  pivot = row;
+        }
+        if (a[pivot][col] == 0.0)  return false;
+        for (uint8_t j = col; j <= n; j++) {
+            float t = a[col][j];
+            a[col][j] = a[pivot][j];
+            a[pivot][j] = t;
+        }
+        for (uint8_t row = col + 1; row < n; row++) {
+            float f = a[row][col] / a[col][col];
+            for (uint8_t j = col; j <= n; j++) {
+                a[row][j] -= f * a[col][j];
+            }
+        }
+    }
+    for (int8_t row = n - 1; row >= 0; row--) {
+        float s = a[row][n];
+        for (uint8_t j = row + 1; j < n; j++) {
+            s -= a[row][j] * c[j];
+        }
+        c[row] = s / a[row][row];
+    }
+    return true;
+}
+
+
+// addPoint
+//
+// Add the clock error at a reading to the sums and fit the curve again, with as many
+// terms as the span of the points supports.
+static void addPoint(int16_t reading, float ppm) {
+    if (!points) {
+        fit.center = fit.low = fit.high = reading;
+    }
+    if (reading < fit.low)  fit.low = reading;
+    if (reading > fit.high)  fit.high = reading;
+    points++;
+
+    float x = (reading - fit.center) / 16.0;
+    float p = 1.0;
+    for (uint8_t k = 0; k < 5; k++) {
+        xSums[k] += p;
+        if (k < 3)  ySums[k] += ppm * p;
+        p *= x;
+    }
+
+    int16_t span = fit.high - fit.low;
+    uint8_t n = (span >= QUADRATIC_SPAN) ? 3 : (span >= LINEAR_SPAN) ? 2 : 1;
+    float a[3][4];
+    float c[3] = { 0.0, 0.0, 0.0 };
+    for (uint8_t row = 0; row < n; row++) {
+        for (uint8_t col = 0; col < n; col++) {
+            a[row][col] = xSums[row + col];
+        }
+        a[row][n] = ySums[row];
+    }
+    if (solve(a, n, c)) {
+        fit.magic = TEMPCO_MAGIC;
+        fit.c0 = c[0];
+        fit.c1 = c[1];
+        fit.c2 = c[2];
+        fFit = true;
+    }
+}
+
+
+static void showFit(void) {
+    char buffer[24];
+    char number[12];
+
+    dtostrf((fit.high - fit.low) / 16.0, 4, 1, number);
+    snprintf(buffer, sizeof(buffer), "Points %4u span %s", points, number);
+    display.text(3, 0, buffer);
+    dtostrf(fit.c0, 10, 3, number);
+    snprintf(buffer, sizeof(buffer), "c0 %s ppm   ", number);
+    display.text(4, 0, buffer);
+    dtostrf(fit.c1, 10, 4, number);
+    snprintf(buffer, sizeof(buffer), "c1 %s ppm/C ", number);
+    display.text(5, 0, buffer);
+    dtostrf(fit.c2, 10, 5, number);
+    snprintf(buffer, sizeof(buffer), "c2 %s ppm/C2", number);
+    display.text(6, 0, buffer);
+}
+
+
+// The title, and the status line for the commands
+static TextField titleLabel(display, 0, 0, 21, false);
+static TextField statusField(display, 7, 0, 20, false);
+static TextField * const labels[] = { &titleLabel, &statusField };
+
+static void showStatus(const char * s) {
+    statusField.set(s);
+    statusField.flush();
+}
+
+
+void tempcoSetup(void) {
+    titleLabel.set("Tempco calibration");
+    titleLabel.flush();
+    showStatus("s save  r restart");
+    displayRefresh.setFields(labels, sizeof(labels) / sizeof(labels[0]));
+    Serial.println(F("temp_c,reading,error_ppm,fit_ppm"));
+
+    restart();
+    timebaseBegin();
+    counterBegin();
+}
+
+
+void tempcoLoop(void) {
+    switch (Serial.read()) {
+        case 'r':
+            restart();
+            showStatus("restarted");
+            break;
+        case 's':
+            if (fFit) {
+                eeprom_update_block(&fit, TEMPCO_CURVE_ADDRESS, sizeof(fit));
+                showStatus("saved");
+                Serial.print(F("# saved c0 "));
+                Serial.print(fit.c0, 4);
+                Serial.print(F(" c1 "));
+                Serial.print(fit.c1, 5);
+                Serial.print(F(" c2 "));
+                Serial.println(fit.c2, 6);
+            }
+            break;
+        case 'e':
+            fit.magic = 0;
+            eeprom_update_block(&fit.magic, &TEMPCO_CURVE_ADDRESS->magic, sizeof(fit.magic));
+            fFit = false;
+            showStatus("erased");
+            Serial.println(F("# erased"));
+            break;
+    }
+
+    CounterGate gate;
+    if (!counterPoll(timebaseTicksFromMs(TEMPCO_CAL_GATE_MS), gate) || (gate.edges == 0)) {
+        return;
+    }
+    int16_t reading = tempcoReading();
+    if (!reading)  return;
+
+    // The reference is exact, so the gate really lasted edges / TEMPCO_REF_HZ seconds
+    // and the difference in ticks is the clock error.
+    uint32_t expected = (uint64_t)gate.edges * TIMEBASE_HZ / TEMPCO_REF_HZ;
+    int32_t diff = gate.ticks - expected;
+    float ppm = diff * 1.0e6 / expected;
+
+    char buffer[24];
+    char number[12];
+    char raw[12];
+    dtostrf(tempcoCelsius(reading), 5, 1, number);
+    dtostrf(reading / 16.0, 6, 1, raw);
+    snprintf(buffer, sizeof(buffer), "Temp %s C %s", number, raw);
+    display.text(1, 0, buffer);
+    dtostrf(ppm, 9, 2, number);
+    snprintf(buffer, sizeof(buffer), "Error %s ppm", number);
+    display.text(2, 0, buffer);
+
+    if (fabs(ppm) > MAX_ERROR_PPM) {
+        showStatus("check reference");
+        return;
+    }
+    addPoint(reading, ppm);
+    showFit();
+
+    Serial.print(tempcoCelsius(reading), 1);
+    Serial.print(',');
+    Serial.print(reading / 16.0, 2);
+    Serial.print(',');
+    Serial.print(ppm, 3);
+    Serial.print(',');
+    Serial.println(tempcoCurvePpm(fit, reading), 3);
+}
+
+#endif
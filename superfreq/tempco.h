@@ -0,0 +1,70 @@
+#ifndef TEMPCO_H
+#define TEMPCO_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Temperature compensated timebase
+//
+// The 16MHz ceramic resonator on a Nano changes frequency with temperature by tens of
+// ppm over a normal room range, and every reading moves with it.  The ATmega328P has a
+// temperature sensor on ADC channel 8, which follows the die and so the board.  With
+// TEMPCO_ENABLE, the sensor is read over and over, and the clock error at each reading
+// is taken from a curve measured by the tempco calibration mode and saved in EEPROM.
+// Every mode corrects its readings with it: intervals measured in timebase ticks or
+// micros() go through tempcoTicks, and frequencies and times worked out in floating
+// point use tempcoHz(TIMEBASE_HZ), the true rate of the timebase, in place of
+// TIMEBASE_HZ.  The counter engine corrects its gate times itself.
+//
+// The ADC is polled from loop(), one conversion at a time with no interrupt, so the
+// capture and counter interrupts are never held off or slowed.  Each reading averages
+// TEMPCO_SAMPLES conversions.  The correction is a 32-bit fixed point factor, worked out
+// in floating point only when a new reading arrives, and tempcoTicks applies it to an
+// interval with one integer multiply.  tempcoTicks has a resolution of one unit of the
+// interval, so it suits sums and long intervals, and tempcoHz the rest.
+//
+// The sensor is uncalibrated, so the temperature in degrees is only good to about 10C,
+// but it is steady, and the curve is in the sensor's own units.  Outside of the range
+// the calibration covered, the curve is held at its end values.
+
+// Clock error curve, error in ppm = c0 + c1 x + c2 x^2 where x is the reading minus
+// center, in ADC counts (about 1C each).
+struct TempcoCurve {
+    uint16_t magic;
+    int16_t center;         // readings in 1/16 ADC count
+    int16_t low;
+    int16_t high;
+    float c0;
+    float c1;
+    float c2;
+};
+
+#define TEMPCO_MAGIC        0x5443
+#define TEMPCO_CURVE_ADDRESS ((TempcoCurve *)16)    // after the period mode edge calibration
+
+#if USE_TEMPCO
+void tempcoBegin(void);
+bool tempcoPoll(void);
+int16_t tempcoReading(void);
+float tempcoCelsius(int16_t reading);
+float tempcoCurvePpm(const TempcoCurve & curve, int16_t reading);
+#else
+inline void tempcoBegin(void)       {}
+inline bool tempcoPoll(void)        { return false; }
+#endif
+
+// The correction is never applied in the calibration mode, which measures the raw clock
+#if TEMPCO_ENABLE && (SUPERFREQ_MODE != MODE_TEMPCO)
+float tempcoPpm(void);
+uint32_t tempcoTicks(uint32_t ticks);
+float tempcoHz(float hz);
+#else
+inline float tempcoPpm(void)        { return 0.0; }
+inline uint32_t tempcoTicks(uint32_t ticks) { return ticks; }
+inline float tempcoHz(float hz)     { return hz; }
+#endif
+
+void tempcoSetup(void);
+void tempcoLoop(void);
+
+#endif
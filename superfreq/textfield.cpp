@@ -0,0 +1,82 @@
+#include "textfield.h"
+
+// The field starts out blank and dirty so that the first flush clears its area.
+TextField::TextField(SSD1306Display & display, uint8_t row, uint8_t column, uint8_t width, bool fLarge)
+    : display(display), row(row), column(column), width(width), fLarge(fLarge) {
+    if (this->width > MAX_WIDTH)  this->width = MAX_WIDTH;
+    memset(text, ' ', this->width);
+    text[this->width] = '\0';
+    invalidate();
+}
+
+
+// set
+//
+// Set the text of the field.  Text shorter than the field is padded with spaces and
+// longer text is cut off.
+void TextField::set(const char * s) {
+    for (uint8_t ix = 0; ix < width; ix++) {
+        char c = *s ? *s++ : ' ';
+        if (c != text[ix]) {
+            text[ix] = c;
+            if (ix < dirtyFirst)  dirtyFirst = ix;
+            if (ix > dirtyLast)  dirtyLast = ix;
+        }
+    }
+}
+
+
+// invalidate
+//
+// Mark the whole field as dirty so that the next flush redraws it.
+void TextField::invalidate(void) {
+    dirtyFirst = 0;
+    dirtyLast = width - 1;
+}
+
+
+// flush
+//
+// Send the dirty span to the display, or as much of the start of it as fits in
+// maxBytes.  Returns the number of bytes sent on the bus, counting the addressing of
+// each row, which is zero if the field was already up to date or not even one
+// character fits.
+uint16_t TextField::flush(uint16_t maxBytes) {
+    if (!dirty() || (maxBytes <= overhead()))  return 0;
+
+    char span[MAX_WIDTH + 1];
+    uint8_t len = dirtyLast - dirtyFirst + 1;
+    uint16_t fit = (maxBytes - overhead()) / charBytes();
+    if (fit == 0)  return 0;
+    if (fit < len)  len = fit;
+    memcpy(span, text + dirtyFirst, len);
+    span[len] = '\0';
+
+    if (fLarge) {
+        display.text2x(row, column + dirtyFirst * 8, span);
+    } else {
+        display.text(row, column + dirtyFirst * 6, span);
+    }
+    uint16_t bytes = overhead() + len * charBytes();
+
+    if (dirtyFirst + len > dirtyLast) {
+        dirtyFirst = 0xff;
+        dirtyLast = 0;
+    } else {
+        dirtyFirst += len;
+    }
+    return bytes;
+}
+
+
+// flushFields
+//
+// Flush a set of fields, which may be on different displays, in one pass.  Returns the
+// total number of bus bytes sent.
+uint16_t flushFields(TextField * const fields[], uint8_t count) {
+    uint16_t bytes = 0;
+    for (uint8_t ix = 0; ix < count; ix++) {
+        bytes += fields[ix]->flush();
+    }
+    return bytes;
+}
@@ -0,0 +1,56 @@
+#ifndef TEXTFIELD_H
+#define TEXTFIELD_H
+
+#include <Arduino.h>
+#include "ssd1306lite.h"
+
+// TextField
+//
+// A fixed position text area on a display that only sends the characters that have
+// changed.  A field remembers the text that it holds.  Setting new text marks the span
+// from the first to the last changed character as dirty, and nothing is sent until
+// flush is called.  Setting a frequency that changed only in its last few digits sends
+// just those digits, which is a small fraction of the bus time of a full redraw.
+//
+// Deferring the writes lets the fields of one or more displays be set during the
+// measurement code and then flushed together in one pass over the bus.
+
+class TextField {
+    public:
+        enum {
+            MAX_WIDTH = 21      // a full row of the 6x8 font
+        };
+
+        TextField(SSD1306Display & display, uint8_t row, uint8_t column, uint8_t width, bool fLarge);
+
+        void set(const char * s);
+        void invalidate(void);
+        bool dirty(void) const { return dirtyFirst <= dirtyLast; }
+        uint16_t flush(void)        { return flush(0xffff); }
+        uint16_t flush(uint16_t maxBytes);
+        uint16_t refresh(void)      { invalidate(); return flush(); }
+
+        // Bus bytes to send the whole field, or the dirty span of it, including the
+        // position command and data header that start each row of the font
+        uint16_t size(void) const   { return overhead() + width * charBytes(); }
+        uint16_t dirtyBytes(void) const {
+            return dirty() ? overhead() + (dirtyLast - dirtyFirst + 1) * charBytes() : 0;
+        }
+
+    private:
+        uint8_t charBytes(void) const   { return fLarge ? 16 : 6; }
+        uint8_t overhead(void) const    { return (fLarge ? 2 : 1) * SSD1306Display::ROW_OVERHEAD; }
+
+        SSD1306Display & display;
+        uint8_t row;
+        uint8_t column;
+        uint8_t width;
+        bool fLarge;            // 8x16 font if true, 6x8 font if false
+        uint8_t dirtyFirst;     // span of characters not yet sent, empty if first > last
+        uint8_t dirtyLast;
+        char text[MAX_WIDTH + 1];
+};
+
+uint16_t flushFields(TextField * const fields[], uint8_t count);
+
+#endif
@@ -0,0 +1,41 @@
+#include "config.h"
+#include "timebase.h"
+#include "sync.h"
+
+volatile uint32_t timebaseOverflows;
+
+ISR(TIMER2_OVF_vect) {
+    timebaseOverflows++;
+#if USE_SYNC
+    syncOverflow();
+#endif
+}
+
+
+// timebaseBegin
+//
+// Start Timer2 in normal mode with a /8 prescaler.  This takes Timer2 away from
+// analogWrite on D3 and D11 and from the tone() function.
+void timebaseBegin(void) {
+    uint8_t oldSREG = SREG;
+    cli();
+    TCCR2A = 0;
+    TCCR2B = _BV(CS21);         // clk/8 = 2MHz
+    TCNT2 = 0;
+    timebaseOverflows = 0;
+    TIFR2 = _BV(TOV2);          // clear any stale overflow
+    TIMSK2 = _BV(TOIE2);
+    SREG = oldSREG;
+}
+
+
+// timebaseNow
+//
+// Read the current tick count from outside of an ISR.
+uint32_t timebaseNow(void) {
+    uint8_t oldSREG = SREG;
+    cli();
+    uint32_t t = timebaseNowFromIsr();
+    SREG = oldSREG;
+    return t;
+}
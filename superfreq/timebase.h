@@ -0,0 +1,39 @@
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include <Arduino.h>
+
+// High resolution timebase
+//
+// Timer2 runs from the system clock with a prescaler of 8, giving a 2MHz tick (0.5us).
+// Timer2 overflows are counted in an interrupt to extend the 8-bit timer to 32 bits.
+// The tick count wraps about every 35 minutes, so always subtract tick values rather
+// than comparing them directly.
+//
+// This is eight times finer than micros() and leaves Timer0 to the Arduino core for
+// millis() and delay().
+
+enum { TIMEBASE_HZ = 2000000 };
+
+extern volatile uint32_t timebaseOverflows;
+
+void timebaseBegin(void);
+uint32_t timebaseNow(void);
+
+// timebaseNowFromIsr
+//
+// Read the current tick count.  Interrupts must be disabled, so this is intended to
+// be called from inside an ISR.  If the timer has overflowed but the overflow
+// interrupt has not been serviced yet, the pending overflow is counted here.
+inline uint32_t timebaseNowFromIsr(void) {
+    uint8_t t = TCNT2;
+    uint32_t ov = timebaseOverflows;
+    if ((TIFR2 & _BV(TOV2)) && (t < 255)) {
+        ov++;
+    }
+    return (ov << 8) | t;
+}
+
+inline uint32_t timebaseTicksFromMs(uint32_t ms) { return ms * (TIMEBASE_HZ / 1000); }
+
+#endif
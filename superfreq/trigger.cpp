@@ -0,0 +1,313 @@
+#include "superfreq.h"
+#include "trigger.h"
+#include "capture.h"
+#include "filter.h"
+#include "tempco.h"
+#include "timebase.h"
+
+#if SUPERFREQ_MODE == MODE_TRIGGER
+
+const byte TRIGGER_PIN = 3;     // INT1
+
+enum {
+    STATE_ARMED,        // recording, waiting for a trigger
+    STATE_TRIGGERED,    // recording the edges after the trigger
+    STATE_FROZEN        // capture complete
+};
+
+// Edge history.  Levels are packed eight to a byte.
+static uint32_t histTicks[TRIGGER_HISTORY];
+static uint8_t histLevels[(TRIGGER_HISTORY + 7) / 8];
+static uint8_t histNext;        // index of the next entry to be written
+static uint8_t histCount;
+
+static uint8_t state;
+static uint32_t triggerTicks;
+static char triggerSource;
+static uint8_t postCount;
+static bool fGap;               // edges were lost after the trigger
+static unsigned long triggerMs;
+
+static MedianFilter periodFilter;
+static bool fHaveRise;
+static uint32_t lastRise;
+
+// Set by the external trigger interrupt
+static volatile bool fExternalTrigger;
+static volatile uint32_t externalTicks;
+
+
+ISR(INT1_vect) {
+    externalTicks = timebaseNowFromIsr();
+    fExternalTrigger = true;
+}
+
+
+// Entry ix of the history, where zero is the oldest
+static uint8_t histIndex(uint8_t ix) {
+    uint8_t n = ((histCount < TRIGGER_HISTORY) ? 0 : histNext) + ix;
+    return (n >= TRIGGER_HISTORY) ? n - TRIGGER_HISTORY : n;
+}
+
+static uint32_t edgeTicks(uint8_t ix) {
+    return histTicks[histIndex(ix)];
+}
+
+static uint8_t edgeLevel(uint8_t ix) {
+    uint8_t n = histIndex(ix);
+    return (histLevels[n >> 3] >> (n & 7)) & 1;
+}
+
+
+static void arm(void) {
+    histNext = 0;
+    histCount = 0;
+    fHaveRise = false;
+    periodFilter.reset();
+    fGap = false;
+    fExternalTrigger = false;
+    state = STATE_ARMED;
+    display.clear();
+    display.text(0, 0, "Armed");
+}
+
+
+static void trigger(uint32_t ticks, char source) {
+    triggerTicks = ticks;
+    triggerSource = source;
+    triggerMs = millis();
+    postCount = 0;
+    state = STATE_TRIGGERED;
+}
+
+
+// periodOutOfRange
+//
+// Check the period that ends at a rising edge against the trigger limits.
+static bool periodOutOfRange(uint32_t period) {
+    static const uint32_t minTicks = (uint32_t)TRIGGER_MIN_PERIOD_US * (TIMEBASE_HZ / 1000000);
+    static const uint32_t maxTicks = (uint32_t)TRIGGER_MAX_PERIOD_US * (TIMEBASE_HZ / 1000000);
+
+    if (minTicks || maxTicks) {
+        return (period < minTicks) || (maxTicks && (period > maxTicks));
+    }
+    return !periodFilter.add(period);
+}
+
+
+static void record(const CaptureEdge & edge) {
+    uint8_t n = histNext;
+    histTicks[n] = edge.ticks;
+    if (edge.level) {
+        histLevels[n >> 3] |= 1 << (n & 7);
+    } else {
+        histLevels[n >> 3] &= ~(1 << (n & 7));
+    }
+    if (++histNext >= TRIGGER_HISTORY)  histNext = 0;
+    if (histCount < TRIGGER_HISTORY)  histCount++;
+
+    if (state == STATE_TRIGGERED) {
+        if ((int32_t)(edge.ticks - triggerTicks) >= 0) {
+            postCount++;
+        }
+        return;
+    }
+
+    if (edge.level) {
+        if (fHaveRise && periodOutOfRange(edge.ticks - lastRise)) {
+            trigger(edge.ticks, 'p');
+            postCount = 1;
+        }
+        fHaveRise = true;
+        lastRise = edge.ticks;
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Timing diagram
+//
+// Each trace is two display rows.  A high level is drawn near the top of the upper
+// row and a low level near the bottom of the lower row.  A column that contains an
+// edge gets a vertical line, so a burst of edges too fast to resolve shows as a
+// solid block.  The trigger is marked with a tick below the trace.
+
+enum {
+    TRACE_HIGH = 0x02,      // upper row, bit 1
+    TRACE_LOW = 0x40,       // lower row, bit 6
+    TRACE_EDGE_UPPER = 0xfe,
+    TRACE_EDGE_LOWER = 0x7f
+};
+
+static void drawTrace(uint8_t row, uint32_t t0, uint32_t t1) {
+    uint8_t upper[128];
+    uint8_t lower[128];
+    uint32_t colTicks = (t1 - t0) / 128 + 1;
+
+    // Find the level at the start of the trace
+    uint8_t ix = 0;
+    while ((ix < histCount) && ((int32_t)(edgeTicks(ix) - t0) < 0)) {
+        ix++;
+    }
+    uint8_t level = (ix > 0) ? edgeLevel(ix - 1) : !edgeLevel(0);
+
+    for (uint8_t col = 0; col < 128; col++) {
+        uint32_t colEnd = t0 + (col + 1) * colTicks;
+        bool fEdge = false;
+        while ((ix < histCount) && ((int32_t)(edgeTicks(ix) - colEnd) < 0)) {
+            level = edgeLevel(ix++);
+            fEdge = true;
+        }
+        if (fEdge) {
+            upper[col] = TRACE_EDGE_UPPER;
+            lower[col] = TRACE_EDGE_LOWER;
+        } else {
+            upper[col] = level ? TRACE_HIGH : 0;
+            lower[col] = level ? 0 : TRACE_LOW;
+        }
+    }
+    display.fillAreaWithBytes(row, 0, 1, 128, upper, sizeof(upper));
+    display.fillAreaWithBytes(row + 1, 0, 1, 128, lower, sizeof(lower));
+
+    // Trigger marker
+    memset(upper, 0, sizeof(upper));
+    if (((int32_t)(triggerTicks - t0) >= 0) && ((int32_t)(t1 - triggerTicks) >= 0)) {
+        upper[(triggerTicks - t0) / colTicks] = 0x07;
+    }
+    display.fillAreaWithBytes(row + 2, 0, 1, 128, upper, sizeof(upper));
+}
+
+
+static void drawCapture(void) {
+    char buffer[24];
+    char span[12];
+
+    display.clear();
+    if (histCount == 0) {
+        display.text(0, 0, "Trigger: no edges");
+        return;
+    }
+
+    uint32_t t0 = edgeTicks(0);
+    uint32_t t1 = edgeTicks(histCount - 1);
+    if ((int32_t)(triggerTicks - t1) > 0)  t1 = triggerTicks;
+    if ((int32_t)(t0 - triggerTicks) > 0)  t0 = triggerTicks;
+
+    dtostrf((float)tempcoTicks(t1 - t0) / (TIMEBASE_HZ / 1000), 8, 3, span);
+    snprintf(buffer, sizeof(buffer), "Trig %c %u%c%s ms", triggerSource, histCount, fGap ? '!' : ' ', span);
+    display.text(0, 0, buffer);
+    drawTrace(1, t0, t1);
+
+    // Zoom in to TRIGGER_ZOOM edges either side of the trigger
+    uint8_t ixTrig = 0;
+    while ((ixTrig < histCount - 1) && ((int32_t)(edgeTicks(ixTrig) - triggerTicks) < 0)) {
+        ixTrig++;
+    }
+    uint8_t ixFirst = (ixTrig > TRIGGER_ZOOM) ? ixTrig - TRIGGER_ZOOM : 0;
+    uint8_t ixLast = (ixTrig + TRIGGER_ZOOM < histCount) ? ixTrig + TRIGGER_ZOOM : histCount - 1;
+    uint32_t z0 = edgeTicks(ixFirst);
+    uint32_t z1 = edgeTicks(ixLast);
+    if ((int32_t)(z0 - triggerTicks) > 0)  z0 = triggerTicks;
+    if ((int32_t)(triggerTicks - z1) > 0)  z1 = triggerTicks;
+
+    dtostrf((float)tempcoTicks(z1 - z0) / (TIMEBASE_HZ / 1000), 8, 3, span);
+    snprintf(buffer, sizeof(buffer), "Zoom %u%s ms", ixLast - ixFirst + 1, span);
+    display.text(4, 0, buffer);
+    drawTrace(5, z0, z1);
+}
+
+
+// exportCapture
+//
+// Write the frozen capture as CSV.  Times are in microseconds relative to the trigger.
+static void exportCapture(void) {
+    Serial.print(F("trigger,"));
+    Serial.println(triggerSource);
+    if (fGap) {
+        Serial.println(F("# edges were lost after the trigger"));
+    }
+    Serial.println(F("index,time_us,level"));
+    for (uint8_t ix = 0; ix < histCount; ix++) {
+        int32_t t = edgeTicks(ix) - triggerTicks;
+        Serial.print(ix);
+        Serial.print(',');
+        Serial.print(t / tempcoHz(TIMEBASE_HZ / 1000000), 1);
+        Serial.print(',');
+        Serial.println(edgeLevel(ix));
+    }
+}
+
+
+static void freeze(void) {
+    state = STATE_FROZEN;
+    drawCapture();
+    exportCapture();
+}
+
+
+void triggerSetup(void) {
+    timebaseBegin();
+    arm();
+    captureBegin(CHANGE);
+
+    pinMode(TRIGGER_PIN, INPUT_PULLUP);
+    EICRA |= _BV(ISC11) | _BV(ISC10);   // INT1 on rising edge
+    EIFR = _BV(INTF1);
+    EIMSK |= _BV(INT1);
+}
+
+
+void triggerLoop(void) {
+    switch (Serial.read()) {
+        case 't':
+            if (state == STATE_ARMED)  trigger(timebaseNow(), 's');
+            break;
+        case 'a':
+            arm();
+            break;
+        case 'e':
+            if (state == STATE_FROZEN)  exportCapture();
+            break;
+    }
+
+    if ((state == STATE_ARMED) && fExternalTrigger) {
+        cli();
+        uint32_t t = externalTicks;
+        sei();
+        trigger(t, 'x');
+    }
+
+    // Edges keep arriving after the capture is frozen and are discarded.  The capture
+    // is frozen at the edge that completes the post-trigger window, so the edges still
+    // queued behind it cannot overwrite the history from before the trigger.
+    CaptureEdge edge;
+    while (captureGet(edge)) {
+        if (state != STATE_FROZEN) {
+            record(edge);
+            if ((state == STATE_TRIGGERED) && (postCount >= TRIGGER_POST)) {
+                freeze();
+            }
+        }
+    }
+
+    // The edges that were dropped came after everything in the queue.  Before a
+    // trigger, the history starts again after the gap, and after one the capture is
+    // marked as incomplete.
+    if (captureTakeOverruns()) {
+        if (state == STATE_ARMED) {
+            histNext = 0;
+            histCount = 0;
+            fHaveRise = false;
+        } else if (state == STATE_TRIGGERED) {
+            fGap = true;
+        }
+    }
+
+    if (state == STATE_TRIGGERED) {
+        if (fGap || (millis() - triggerMs > TRIGGER_TIMEOUT_MS)) {
+            freeze();
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef TRIGGER_H
+#define TRIGGER_H
+
+#include <Arduino.h>
+
+// Triggered capture
+//
+// Single-shot logic capture for finding one-off glitches.  While armed, every edge
+// on D2 is recorded in a ring of the last TRIGGER_HISTORY edges.  When a trigger
+// occurs, TRIGGER_POST more edges are recorded and then the ring is frozen, so it
+// holds the edges leading up to the trigger as well as the ones that followed.
+//
+// Trigger sources:
+//   - a period outside TRIGGER_MIN_PERIOD_US..TRIGGER_MAX_PERIOD_US, or if both are
+//     zero, a period that the median outlier filter rejects
+//   - a rising edge on the external trigger input, D3
+//   - the serial command t
+//
+// The frozen capture is drawn as a timing diagram, once for the whole capture and
+// once zoomed in around the trigger, and is exported to the serial port.  If edges
+// are lost while armed, the history starts again after the gap.  If they are lost
+// after the trigger, the capture is frozen there and marked with a ! after the edge
+// count, and the export says so.
+//
+// Serial commands:
+//   t    trigger now
+//   a    re-arm
+//   e    export the frozen capture as CSV
+
+void triggerSetup(void);
+void triggerLoop(void);
+
+#endif
@@ -0,0 +1,197 @@
+#include "superfreq.h"
+#include "usartcap.h"
+#include "tempco.h"
+
+#if SUPERFREQ_MODE == MODE_USART
+
+enum {
+    SAMPLES = USART_CAPTURE_BYTES * 8,
+    UBRR_VALUE = F_CPU / (2UL * USART_SAMPLE_HZ) - 1
+};
+
+static uint8_t samples[USART_CAPTURE_BYTES];
+static bool fOverrun;
+
+
+static inline uint8_t sampleAt(uint16_t ix) {
+    return (samples[ix >> 3] >> (7 - (ix & 7))) & 1;
+}
+
+
+// usartCapture
+//
+// Switch USART0 to MSPIM, fill the sample buffer, and then restore the serial port.
+// Interrupts are off for the whole capture because a single interrupt would stall the
+// polling loop long enough to lose bytes.  Returns false if a receive overrun occurred,
+// which means the sample rate is too high for the loop.
+//
+// The transmitter is primed with two bytes, one in the shift register and one in the
+// buffer, so that XCK runs without gaps.  Each received byte frees a transmit buffer
+// slot, which is refilled right away.
+bool usartCapture(void) {
+    uint8_t * p = samples;
+    uint8_t * end = samples + USART_CAPTURE_BYTES;
+
+    Serial.flush();
+    Serial.end();
+
+    uint8_t oldSREG = SREG;
+    cli();
+    UBRR0 = 0;
+    DDRD |= _BV(PD4);                           // XCK output selects master mode
+    UCSR0C = _BV(UMSEL01) | _BV(UMSEL00);       // MSPIM, SPI mode 0, MSB first
+    UCSR0B = _BV(RXEN0) | _BV(TXEN0);
+    UBRR0 = UBRR_VALUE;                         // must be set after the transmitter is enabled
+    UCSR0A = _BV(TXC0);                         // clear a stale transmit complete
+
+    UDR0 = 0;
+    UDR0 = 0;
+    while (p < end) {
+        while (!(UCSR0A & _BV(RXC0)))
+            ;
+        *p++ = UDR0;
+        UDR0 = 0;
+    }
+    fOverrun = UCSR0A & _BV(DOR0);
+
+    // Let the last dummy bytes finish before switching modes
+    while (!(UCSR0A & _BV(TXC0)))
+        ;
+    UCSR0B = 0;
+    DDRD &= ~_BV(PD4);
+    SREG = oldSREG;
+
+    Serial.begin(SERIAL_BAUD);
+    return !fOverrun;
+}
+
+
+// usartAnalyze
+//
+// Walk the samples once, tracking run lengths.  A run that ends before reaching
+// USART_GLITCH_SAMPLES is a glitch, except for the partial runs at the start and end
+// of the buffer.
+void usartAnalyze(UsartTrace & trace) {
+    memset(&trace, 0, sizeof(trace));
+    trace.fOverrun = fOverrun;
+
+    uint8_t level = sampleAt(0);
+    uint16_t runStart = 0;
+    bool fFirstRun = true;
+    uint16_t highTotal = 0;     // high samples up to the most recent rising edge
+
+    for (uint16_t ix = 1; ix < SAMPLES; ix++) {
+        uint8_t s = sampleAt(ix);
+        if (s == level)  continue;
+
+        if (!fFirstRun && (ix - runStart < USART_GLITCH_SAMPLES)) {
+            trace.glitches++;
+        }
+        if (level && trace.rises) {
+            highTotal += ix - runStart;
+        }
+        if (s) {
+            if (trace.rises == 0)  trace.firstRise = ix;
+            trace.lastRise = ix;
+            trace.highSamples = highTotal;
+            trace.rises++;
+        }
+        level = s;
+        runStart = ix;
+        fFirstRun = false;
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// USART capture mode display
+//
+// Rows 0..3 hold the results in the small font and rows 5..6 show the first 128
+// samples as a trace, one sample per column.
+
+static unsigned long lastCaptureMs;
+
+static void drawSamples(uint8_t row) {
+    uint8_t upper[128];
+    uint8_t lower[128];
+    uint8_t prev = sampleAt(0);
+
+    for (uint8_t col = 0; col < 128; col++) {
+        uint8_t s = sampleAt(col);
+        if (s != prev) {
+            upper[col] = 0xfe;
+            lower[col] = 0x7f;
+        } else {
+            upper[col] = s ? 0x02 : 0;
+            lower[col] = s ? 0 : 0x40;
+        }
+        prev = s;
+    }
+    display.fillAreaWithBytes(row, 0, 1, 128, upper, sizeof(upper));
+    display.fillAreaWithBytes(row + 1, 0, 1, 128, lower, sizeof(lower));
+}
+
+
+static void exportSamples(void) {
+    Serial.print(F("rate_hz,"));
+    Serial.println(USART_SAMPLE_HZ);
+    for (uint16_t ix = 0; ix < USART_CAPTURE_BYTES; ix++) {
+        if (samples[ix] < 0x10)  Serial.print('0');
+        Serial.print(samples[ix], HEX);
+        if ((ix & 31) == 31)  Serial.println();
+    }
+    Serial.println();
+}
+
+
+static void showResults(void) {
+    UsartTrace trace;
+    char buffer[24];
+    char number[12];
+
+    usartAnalyze(trace);
+
+    if (trace.rises > 1) {
+        uint16_t span = trace.lastRise - trace.firstRise;
+        dtostrf((float)(trace.rises - 1) * tempcoHz(USART_SAMPLE_HZ) / span, 11, 1, number);
+        snprintf(buffer, sizeof(buffer), "Freq %s Hz", number);
+        display.text(0, 0, buffer);
+        dtostrf(trace.highSamples * 100.0 / span, 11, 2, number);
+        snprintf(buffer, sizeof(buffer), "Duty %s %%", number);
+        display.text(1, 0, buffer);
+    } else {
+        display.text(0, 0, "Freq    no edges    ");
+        display.text(1, 0, "Duty           -    ");
+    }
+
+    snprintf(buffer, sizeof(buffer), "Glitch%5u Edge%5u", trace.glitches, trace.rises);
+    display.text(2, 0, buffer);
+    dtostrf(USART_SAMPLE_HZ / 1000000.0, 5, 2, number);
+    snprintf(buffer, sizeof(buffer), "%sMHz x%5u %s", number, SAMPLES, trace.fOverrun ? "OVR" : "   ");
+    display.text(3, 0, buffer);
+
+    drawSamples(5);
+}
+
+
+void usartSetup(void) {
+    display.clear();
+    usartCapture();
+    showResults();
+    lastCaptureMs = millis();
+}
+
+
+void usartLoop(void) {
+    if (Serial.read() == 'e') {
+        exportSamples();
+    }
+
+    if (millis() - lastCaptureMs >= USART_REPEAT_MS) {
+        lastCaptureMs = millis();
+        usartCapture();
+        showResults();
+    }
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef USARTCAP_H
+#define USARTCAP_H
+
+#include <Arduino.h>
+
+// USART sampling capture
+//
+// Interrupt and polling based capture can't follow signals in the MHz range.  This mode
+// puts USART0 into master SPI mode (MSPIM), where it generates a clock on XCK (D4) and
+// shifts in one bit from RXD (D0) on every clock.  The USART becomes a hardware shift
+// register sampling the input at USART_SAMPLE_HZ, up to 8MHz, and a tight polling loop
+// moves each received byte into a RAM buffer.  The result is a short logic analyzer trace
+// of USART_CAPTURE_BYTES * 8 samples that is analyzed for frequency, duty cycle and
+// glitches.
+//
+// D0 is also driven by the USB serial chip through a 1K resistor, so the signal source
+// must be able to drive that load.  The USART can't run the serial port while it is
+// sampling, so the serial port is shut down for each capture and restarted afterwards.
+// Dummy bytes are clocked out of TXD (D1) during the capture and may show up as noise
+// on the host.
+//
+// Serial commands:
+//   e    export the last capture as hex, first sample in the MSB of the first byte
+
+struct UsartTrace {
+    uint16_t rises;         // rising edges
+    uint16_t firstRise;     // sample index of the first and last rising edges
+    uint16_t lastRise;
+    uint16_t highSamples;   // high samples between the first and last rising edges
+    uint16_t glitches;      // high or low pulses shorter than USART_GLITCH_SAMPLES
+    bool fOverrun;          // the polling loop did not keep up with the USART
+};
+
+bool usartCapture(void);
+void usartAnalyze(UsartTrace & trace);
+
+void usartSetup(void);
+void usartLoop(void);
+
+#endif
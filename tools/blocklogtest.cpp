@@ -0,0 +1,354 @@
+// blocklogtest
+//
+// Host test of BlockLog, the raw block log of the logger mode, against a file backed
+// block device like the one sflog2csv reads.  The device counts what each call into
+// the log asks of it, and can be told to stay busy after a write, like a card that is
+// slow to program.  No call to append() or poll() may do more than one step of a
+// write, so the logger's loop() never waits for the card.
+//
+// The log is checked to
+//   - find its end after a restart, for logs of many lengths, and not run on into the
+//     blocks of an older log
+//   - write a full block with its header and records where sflog2csv expects them
+//   - hold back records that arrive while a block is written, drop them once that
+//     fills, and give the number dropped in the next block header
+//   - read back through sflog2csv with every record and every drop in order
+//
+// Run it from the tools directory, after building sflog2csv.
+//
+// usage: blocklogtest
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blocklog.h"
+#include "logger.h"
+#include "fileblockdev.h"
+
+#define IMAGE_NAME      "blocklogtest.img"
+#define IMAGE_BLOCKS    1024
+#define FIRST_BLOCK     8       // like LOGGER_FIRST_BLOCK, not at the start of the image
+
+static long failures;
+
+#define CHECK(x)    check((x), #x, __LINE__)
+
+static void check(bool fOk, const char * what, int line) {
+    if (!fOk && (failures++ < 10)) {
+        printf("line %d: %s\n", line, what);
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Block device
+
+class TestBlockDevice : public FileBlockDevice {
+    public:
+        TestBlockDevice(FILE * file) : FileBlockDevice(file) {
+            busyPolls = 0;
+            fStuck = false;
+            busyLeft = 0;
+            calls = 0;
+            bytes = 0;
+        }
+
+        uint32_t busyPolls;     // calls to busy() that report busy after each write
+        bool fStuck;            // report busy until this is cleared
+        unsigned calls;         // write calls since the last step
+        unsigned bytes;         // bytes sent since the last step
+
+        virtual bool writeBegin(uint32_t block) {
+            calls++;
+            return FileBlockDevice::writeBegin(block);
+        }
+
+        virtual void writeBytes(const uint8_t * data, uint16_t count) {
+            calls++;
+            bytes += count;
+            FileBlockDevice::writeBytes(data, count);
+        }
+
+        virtual bool writeEnd(void) {
+            calls++;
+            busyLeft = busyPolls;
+            return FileBlockDevice::writeEnd();
+        }
+
+        virtual bool busy(void) {
+            calls++;
+            if (fStuck)  return true;
+            if (busyLeft) {
+                busyLeft--;
+                return true;
+            }
+            return false;
+        }
+
+    private:
+        uint32_t busyLeft;
+};
+
+
+static FILE * image;
+
+// Start a new, blank image, which reads as zeros like an erased card
+static void blankImage(void) {
+    static uint8_t zeros[BlockDevice::BLOCK_SIZE];
+    rewind(image);
+    for (int ix = 0; ix < IMAGE_BLOCKS; ix++) {
+        fwrite(zeros, sizeof(zeros), 1, image);
+    }
+    fflush(image);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Log
+
+// The records that the log took, in order, for the check against sflog2csv
+static LoggerRecord accepted[IMAGE_BLOCKS * 42];
+static long nAccepted;
+static uint32_t nextMs;
+
+static LoggerRecord makeRecord(void) {
+    LoggerRecord r;
+    r.ms = nextMs;
+    r.edges = 1000 + nextMs % 997;
+    r.ticks = 2000000 + nextMs % 1009;
+    nextMs += 1000;
+    return r;
+}
+
+// Each call into the log may only do one step of a write: start it, send one chunk,
+// end it, or check once whether the device is still busy.
+static void endStep(TestBlockDevice & device) {
+    CHECK(device.calls <= 2);
+    CHECK(device.bytes <= BlockLog::CHUNK_SIZE);
+    device.calls = 0;
+    device.bytes = 0;
+}
+
+static bool append(BlockLog & log, TestBlockDevice & device) {
+    LoggerRecord r = makeRecord();
+    bool fOk = log.append(&r);
+    endStep(device);
+    if (fOk)  accepted[nAccepted++] = r;
+    return fOk;
+}
+
+static void poll(BlockLog & log, TestBlockDevice & device) {
+    log.poll();
+    endStep(device);
+}
+
+// Poll until the block being written is done
+static void finishWrite(BlockLog & log, TestBlockDevice & device) {
+    for (int n = 0; (n < 1000) && (log.state() != BlockLog::IDLE); n++) {
+        poll(log, device);
+    }
+    CHECK(log.state() == BlockLog::IDLE);
+}
+
+static const uint16_t CAPACITY = (BlockDevice::BLOCK_SIZE - sizeof(BlockLogHeader)) / sizeof(LoggerRecord);
+
+static void writeBlocks(BlockLog & log, TestBlockDevice & device, uint32_t blocks) {
+    for (uint32_t ix = 0; ix < blocks * CAPACITY; ix++) {
+        CHECK(append(log, device));
+        finishWrite(log, device);
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Tests
+
+// A log of each length is continued after its last block.  A new log written over a
+// longer one stops at its own end.
+static void testRestart(void) {
+    static const uint32_t lengths[] = { 0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 100 };
+    for (unsigned ix = 0; ix < sizeof(lengths) / sizeof(lengths[0]); ix++) {
+        blankImage();
+        TestBlockDevice device(image);
+        BlockLog log(device, sizeof(LoggerRecord));
+        CHECK(log.begin(FIRST_BLOCK, false));
+        writeBlocks(log, device, lengths[ix]);
+
+        BlockLog restarted(device, sizeof(LoggerRecord));
+        CHECK(restarted.begin(FIRST_BLOCK, false));
+        CHECK(restarted.session() == 1);
+        if (restarted.blocks() != lengths[ix]) {
+            CHECK(restarted.blocks() == lengths[ix]);
+            printf("  log of %lu blocks restarted at %lu\n", (unsigned long)lengths[ix],
+                   (unsigned long)restarted.blocks());
+        }
+    }
+
+    blankImage();
+    TestBlockDevice device(image);
+    BlockLog log(device, sizeof(LoggerRecord));
+    CHECK(log.begin(FIRST_BLOCK, false));
+    writeBlocks(log, device, 20);
+    CHECK(log.begin(FIRST_BLOCK, true));
+    CHECK(log.session() == 2);
+    CHECK(log.blocks() == 0);
+    writeBlocks(log, device, 5);
+    CHECK(log.begin(FIRST_BLOCK, false));
+    CHECK(log.session() == 2);
+    CHECK(log.blocks() == 5);
+}
+
+
+// The first full block is on the device with its header and the records in order
+static void testFullBlock(void) {
+    blankImage();
+    TestBlockDevice device(image);
+    BlockLog log(device, sizeof(LoggerRecord));
+    CHECK(log.begin(FIRST_BLOCK, false));
+    nAccepted = 0;
+    writeBlocks(log, device, 1);
+    CHECK(log.blocks() == 1);
+
+    uint8_t block[BlockDevice::BLOCK_SIZE];
+    CHECK(device.readBlock(FIRST_BLOCK, block));
+    const BlockLogHeader & h = *(const BlockLogHeader *)block;
+    CHECK(h.magic == BLOCKLOG_MAGIC);
+    CHECK(h.version == BLOCKLOG_VERSION);
+    CHECK(h.recordSize == sizeof(LoggerRecord));
+    CHECK(h.session == 1);
+    CHECK(h.sequence == 0);
+    CHECK(h.count == CAPACITY);
+    CHECK(h.dropped == 0);
+    CHECK(memcmp(block + sizeof(BlockLogHeader), accepted, CAPACITY * sizeof(LoggerRecord)) == 0);
+}
+
+
+// While a block is written, records are held back until the pending area is full and
+// then dropped, however long the device stays busy.  The held records start the next
+// block and the drops are counted in its header.
+static void testDropped(void) {
+    blankImage();
+    TestBlockDevice device(image);
+    device.busyPolls = 50;
+    BlockLog log(device, sizeof(LoggerRecord));
+    CHECK(log.begin(FIRST_BLOCK, false));
+    nAccepted = 0;
+
+    for (uint16_t ix = 0; ix < CAPACITY; ix++) {
+        CHECK(append(log, device));
+    }
+    CHECK(log.state() == BlockLog::SENDING);
+
+    const uint16_t HELD = BlockLog::PENDING_SIZE / sizeof(LoggerRecord);
+    const uint16_t EXTRA = 100;
+    uint16_t nHeld = 0;
+    for (uint16_t ix = 0; ix < HELD + EXTRA; ix++) {
+        if (append(log, device))  nHeld++;
+        poll(log, device);
+        device.fStuck = (log.state() == BlockLog::PROGRAMMING);
+    }
+    CHECK(log.state() == BlockLog::PROGRAMMING);
+    CHECK(nHeld == HELD);
+    CHECK(log.dropped() == EXTRA);
+
+    device.fStuck = false;
+    finishWrite(log, device);
+    CHECK(log.blocks() == 1);
+    log.flush();
+    finishWrite(log, device);
+
+    uint8_t block[BlockDevice::BLOCK_SIZE];
+    CHECK(device.readBlock(FIRST_BLOCK + 1, block));
+    const BlockLogHeader & h = *(const BlockLogHeader *)block;
+    CHECK(h.sequence == 1);
+    CHECK(h.count == HELD);
+    CHECK(h.dropped == EXTRA);
+    CHECK(memcmp(block + sizeof(BlockLogHeader), accepted + CAPACITY, HELD * sizeof(LoggerRecord)) == 0);
+}
+
+
+// A log with full blocks, drops, a restart and a partly filled block reads back
+// through sflog2csv with every record that was taken, and the drops where they were
+// counted.
+static void testConvert(void) {
+    blankImage();
+    TestBlockDevice device(image);
+    device.busyPolls = 5;
+    BlockLog log(device, sizeof(LoggerRecord));
+    CHECK(log.begin(FIRST_BLOCK, false));
+    nAccepted = 0;
+
+    // Records arrive every few polls, so the busy card sometimes drops a few
+    uint32_t totalDropped = 0;
+    srand(1);
+    for (long n = 0; n < 20 * CAPACITY; n++) {
+        append(log, device);
+        for (int k = rand() % 3; k > 0; k--) {
+            poll(log, device);
+        }
+    }
+    totalDropped += log.dropped();
+    CHECK(totalDropped > 0);
+    finishWrite(log, device);
+    log.flush();
+    finishWrite(log, device);
+
+    BlockLog restarted(device, sizeof(LoggerRecord));
+    CHECK(restarted.begin(FIRST_BLOCK, false));
+    for (int n = 0; n < CAPACITY / 2; n++) {
+        CHECK(append(restarted, device));
+    }
+    restarted.flush();
+    finishWrite(restarted, device);
+
+    char command[64];
+    snprintf(command, sizeof(command), "./sflog2csv %s %d 2>/dev/null", IMAGE_NAME, FIRST_BLOCK);
+    FILE * csv = popen(command, "r");
+    CHECK(csv != NULL);
+    if (csv == NULL)  return;
+
+    char line[128];
+    long records = 0;
+    uint32_t droppedLines = 0;
+    CHECK(fgets(line, sizeof(line), csv) && (strcmp(line, "ms,edges,ticks,frequency\n") == 0));
+    while (fgets(line, sizeof(line), csv)) {
+        unsigned count;
+        if (sscanf(line, "# %u records dropped", &count) == 1) {
+            droppedLines += count;
+            continue;
+        }
+        char expected[128];
+        const LoggerRecord & r = accepted[records];
+        snprintf(expected, sizeof(expected), "%lu,%lu,%lu,%.4f\n", (unsigned long)r.ms,
+                 (unsigned long)r.edges, (unsigned long)r.ticks, r.edges * 2000000.0 / r.ticks);
+        if ((records >= nAccepted) || (strcmp(line, expected) != 0)) {
+            check(false, "sflog2csv line matches the record", __LINE__);
+            printf("  record %ld: %s", records, line);
+            break;
+        }
+        records++;
+    }
+    CHECK(pclose(csv) == 0);
+    CHECK(records == nAccepted);
+    CHECK(droppedLines == totalDropped);
+}
+
+
+int main(void) {
+    image = fopen(IMAGE_NAME, "w+b");
+    if (image == NULL) {
+        perror(IMAGE_NAME);
+        return 1;
+    }
+
+    testRestart();
+    testFullBlock();
+    testDropped();
+    testConvert();
+
+    fclose(image);
+    remove(IMAGE_NAME);
+    printf("blocklogtest: %ld failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,48 @@
+// FileBlockDevice
+//
+// A BlockDevice backed by an ordinary file, such as an image of an SD card made with
+// dd or the card's device node itself.  Lets the firmware's BlockLog code and its
+// format be used on a host.
+
+#ifndef FILEBLOCKDEV_H
+#define FILEBLOCKDEV_H
+
+#include <stdio.h>
+#include "blockdev.h"
+
+class FileBlockDevice : public BlockDevice {
+    public:
+        FileBlockDevice(FILE * file) : file(file), fWriting(false) {}
+
+        virtual bool readBlock(uint32_t block, uint8_t * data) {
+            return (fseek(file, (long)block * BLOCK_SIZE, SEEK_SET) == 0) &&
+                   (fread(data, BLOCK_SIZE, 1, file) == 1);
+        }
+
+        virtual bool writeBegin(uint32_t block) {
+            fWriting = (fseek(file, (long)block * BLOCK_SIZE, SEEK_SET) == 0);
+            return fWriting;
+        }
+
+        virtual void writeBytes(const uint8_t * data, uint16_t count) {
+            if (fWriting && (fwrite(data, 1, count, file) != count)) {
+                fWriting = false;
+            }
+        }
+
+        virtual bool writeEnd(void) {
+            bool fOk = fWriting && (fflush(file) == 0);
+            fWriting = false;
+            return fOk;
+        }
+
+        virtual bool busy(void) {
+            return false;
+        }
+
+    private:
+        FILE * file;
+        bool fWriting;
+};
+
+#endif
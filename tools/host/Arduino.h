@@ -0,0 +1,58 @@
+// Host stand-in for the parts of the Arduino core and AVR headers that the firmware
+// modules built by the host tests use.  The registers are plain variables, so a test
+// can play the part of the hardware, and an ISR is an ordinary function that the test
+// calls when the interrupt would fire.
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <avr/pgmspace.h>
+
+typedef uint8_t byte;
+
+#define HIGH            1
+#define LOW             0
+#define INPUT           0
+#define OUTPUT          1
+#define INPUT_PULLUP    2
+#define CHANGE          1
+#define FALLING         2
+#define RISING          3
+#define A4              18
+#define A5              19
+
+#define _BV(bit)        (1 << (bit))
+#define ISR(vector)     void vector(void)
+
+inline void pinMode(uint8_t, uint8_t)   {}
+inline void noInterrupts(void)          {}
+inline void interrupts(void)            {}
+inline void cli(void)                   {}
+inline void sei(void)                   {}
+
+// Set by the test
+extern unsigned long hostMillis;
+inline unsigned long millis(void)       { return hostMillis; }
+
+// Timer2, the timebase
+extern volatile uint8_t TCNT2, TIFR2;
+enum { TOV2 = 0 };
+
+// TWI
+extern volatile uint8_t TWAR, TWCR, TWDR, TWSR;
+enum { TWIE = 0, TWEN = 2, TWSTO = 4, TWEA = 6, TWINT = 7 };
+
+// SPI and the SS pin change interrupt
+extern volatile uint8_t SPCR, SPDR, PINB, DDRB, PCMSK0, PCIFR, PCICR;
+enum { SPIE = 7, SPE = 6, PB2 = 2, PB4 = 4, PCINT2 = 2, PCIF0 = 0, PCIE0 = 0 };
+
+// Port D, where the slave configuration moves the display
+extern volatile uint8_t PORTD, DDRD;
+enum { PD6 = 6, PD7 = 7 };
+
+#endif
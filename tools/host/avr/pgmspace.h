@@ -0,0 +1,7 @@
+#ifndef HOST_PGMSPACE_H
+#define HOST_PGMSPACE_H
+
+#define PROGMEM
+#define pgm_read_byte(address)  (*(const uint8_t *)(address))
+
+#endif
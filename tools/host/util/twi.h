@@ -0,0 +1,19 @@
+#ifndef HOST_TWI_H
+#define HOST_TWI_H
+
+// TWI status codes from the ATmega328P datasheet
+#define TW_SR_SLA_ACK           0x60
+#define TW_SR_ARB_LOST_SLA_ACK  0x68
+#define TW_SR_DATA_ACK          0x80
+#define TW_SR_DATA_NACK         0x88
+#define TW_SR_STOP              0xa0
+#define TW_ST_SLA_ACK           0xa8
+#define TW_ST_ARB_LOST_SLA_ACK  0xb0
+#define TW_ST_DATA_ACK          0xb8
+#define TW_ST_DATA_NACK         0xc0
+#define TW_ST_LAST_DATA         0xc8
+#define TW_BUS_ERROR            0x00
+
+#define TW_STATUS               (TWSR & 0xf8)
+
+#endif
@@ -0,0 +1,82 @@
+// sflog2csv
+//
+// Converts a log written by the superfreq logger mode to CSV.  The input is an image
+// of the SD card, made for example with
+//
+//   dd if=/dev/sdX of=card.img bs=512 skip=2048 count=100000
+//
+// in which case the log starts at block 0 of the image, or the card device itself with
+// the first block of the log given on the command line.
+//
+// Each record becomes a line with the millis() time stamp at the end of the gate, the
+// edge count, the gate length in 0.5us ticks and the frequency.  The ticks, and so the
+// frequency, already have the logger's temperature correction if it was built with
+// TEMPCO_ENABLE.  Records that the logger had to drop are noted with a comment line
+// where they were lost.
+//
+// usage: sflog2csv image [first_block]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blocklog.h"
+#include "logger.h"
+#include "fileblockdev.h"
+
+#define TIMEBASE_HZ     2000000.0
+
+static bool validBlock(const BlockLogHeader & h, uint16_t session, uint32_t sequence) {
+    return (h.magic == BLOCKLOG_MAGIC) && (h.version == BLOCKLOG_VERSION) &&
+           (h.recordSize == sizeof(LoggerRecord)) && (h.session == session) &&
+           (h.sequence == sequence);
+}
+
+
+int main(int argc, char * argv[]) {
+    if ((argc < 2) || (argc > 3)) {
+        fprintf(stderr, "usage: sflog2csv image [first_block]\n");
+        return 2;
+    }
+
+    FILE * file = fopen(argv[1], "rb");
+    if (file == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+    uint32_t firstBlock = (argc > 2) ? strtoul(argv[2], NULL, 0) : 0;
+
+    FileBlockDevice device(file);
+    uint8_t buffer[BlockDevice::BLOCK_SIZE];
+    const BlockLogHeader & h = *(const BlockLogHeader *)buffer;
+
+    if (!device.readBlock(firstBlock, buffer) || !validBlock(h, h.session, 0)) {
+        fprintf(stderr, "sflog2csv: no log at block %lu\n", (unsigned long)firstBlock);
+        return 1;
+    }
+    uint16_t session = h.session;
+
+    printf("ms,edges,ticks,frequency\n");
+    unsigned long records = 0;
+    unsigned long dropped = 0;
+    uint32_t sequence = 0;
+    while (device.readBlock(firstBlock + sequence, buffer) && validBlock(h, session, sequence)) {
+        if (h.dropped) {
+            printf("# %u records dropped\n", h.dropped);
+            dropped += h.dropped;
+        }
+        for (uint16_t ix = 0; ix < h.count; ix++) {
+            LoggerRecord r;
+            memcpy(&r, buffer + sizeof(BlockLogHeader) + ix * sizeof(LoggerRecord), sizeof(r));
+            printf("%lu,%lu,%lu,%.4f\n", (unsigned long)r.ms, (unsigned long)r.edges,
+                   (unsigned long)r.ticks, r.ticks ? r.edges * TIMEBASE_HZ / r.ticks : 0.0);
+        }
+        records += h.count;
+        sequence++;
+    }
+
+    fprintf(stderr, "session %u: %lu blocks, %lu records, %lu dropped\n",
+            session, (unsigned long)sequence, records, dropped);
+    fclose(file);
+    return 0;
+}
@@ -0,0 +1,161 @@
+#!/usr/bin/env python3
+"""sfmirror - rebuild the superfreq display from its serial mirror and save PNGs.
+
+The sketch must be built with SUPERFREQ_MIRROR defined.  It then sends every
+write to the display RAM as a packet on the serial port, see mirror.h for the
+format.  This viewer applies the packets to a copy of the 128x64 screen, passes
+the normal text output of the sketch through to stdout, and saves the screen as
+a PNG whenever it changes, at most once per interval.
+
+The input is a serial port, which needs pyserial, or a file holding a raw
+capture of the serial output.  Opening the port resets the Arduino, so the
+mirror starts from the same blank screen as the display.
+
+usage: sfmirror.py [-b baud] [-o screen.png] [-a] [-s scale] [-i seconds] port_or_file
+  -b   baud rate, default 115200
+  -o   output PNG, default screen.png
+  -a   also save every change as screen-NNNN.png next to the output
+  -s   pixels per display pixel, default 4
+  -i   minimum seconds between saves, default 0.5
+"""
+
+import argparse
+import os
+import struct
+import sys
+import time
+import zlib
+
+ROWS = 8
+COLUMNS = 128
+
+PACKET = 0xfe
+END = 0x00
+ZEROS = 0x80
+
+
+class Mirror:
+    """Parser for the mirror packets and the screen they describe."""
+
+    def __init__(self):
+        self.screen = bytearray(ROWS * COLUMNS)
+        self.state = self._text
+        self.text = bytearray()
+
+    def feed(self, data):
+        """Process input bytes.  Returns true if a packet changed the screen."""
+        changed = False
+        for b in data:
+            changed |= self.state(b) or False
+        return changed
+
+    def _text(self, b):
+        if b == PACKET:
+            self.state = self._row
+        elif b == ord('\n'):
+            sys.stdout.write(self.text.decode('ascii', 'replace').rstrip('\r') + '\n')
+            sys.stdout.flush()
+            self.text.clear()
+        else:
+            self.text.append(b)
+
+    def _row(self, b):
+        self.row = b & (ROWS - 1)
+        self.state = self._column
+
+    def _column(self, b):
+        self.column = b & (COLUMNS - 1)
+        self.fChanged = False
+        self.state = self._token
+
+    def _token(self, b):
+        if b == END:
+            self.state = self._text
+            return self.fChanged
+        if b & ZEROS:
+            self.column = (self.column + (b & ~ZEROS) + 1) & (COLUMNS - 1)
+        else:
+            self.literals = b
+            self.state = self._literal
+
+    def _literal(self, b):
+        self.screen[self.row * COLUMNS + self.column] ^= b
+        self.column = (self.column + 1) & (COLUMNS - 1)
+        self.fChanged = True
+        self.literals -= 1
+        if self.literals == 0:
+            self.state = self._token
+
+    def png(self, scale):
+        """The screen as a grayscale PNG, lit pixels white."""
+        lines = []
+        for y in range(ROWS * 8):
+            row = self.screen[(y >> 3) * COLUMNS:((y >> 3) + 1) * COLUMNS]
+            bit = 1 << (y & 7)
+            line = bytes(255 if (b & bit) else 0 for b in row for _ in range(scale))
+            lines.extend([b'\x00' + line] * scale)
+
+        def chunk(kind, data):
+            body = kind + data
+            return struct.pack('>I', len(data)) + body + struct.pack('>I', zlib.crc32(body))
+
+        header = struct.pack('>IIBBBBB', COLUMNS * scale, ROWS * 8 * scale, 8, 0, 0, 0, 0)
+        return (b'\x89PNG\r\n\x1a\n' + chunk(b'IHDR', header) +
+                chunk(b'IDAT', zlib.compress(b''.join(lines))) + chunk(b'IEND', b''))
+
+
+def open_input(path, baud):
+    if os.path.isfile(path):
+        f = open(path, 'rb')
+        return lambda: f.read(4096)
+    import serial
+    port = serial.Serial(path, baud, timeout=0.1)
+    return lambda: port.read(port.in_waiting or 1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='superfreq display mirror viewer')
+    parser.add_argument('input')
+    parser.add_argument('-b', '--baud', type=int, default=115200)
+    parser.add_argument('-o', '--output', default='screen.png')
+    parser.add_argument('-a', '--all', action='store_true')
+    parser.add_argument('-s', '--scale', type=int, default=4)
+    parser.add_argument('-i', '--interval', type=float, default=0.5)
+    args = parser.parse_args()
+
+    read = open_input(args.input, args.baud)
+    mirror = Mirror()
+    frames = 0
+    fPending = False
+    lastSave = 0.0
+
+    def save():
+        nonlocal frames
+        image = mirror.png(args.scale)
+        with open(args.output, 'wb') as f:
+            f.write(image)
+        if args.all:
+            base, ext = os.path.splitext(args.output)
+            with open('%s-%04d%s' % (base, frames, ext), 'wb') as f:
+                f.write(image)
+        frames += 1
+
+    try:
+        while True:
+            data = read()
+            if not data and os.path.isfile(args.input):
+                break
+            fPending |= mirror.feed(data)
+            if fPending and (time.monotonic() - lastSave >= args.interval):
+                save()
+                fPending = False
+                lastSave = time.monotonic()
+    except KeyboardInterrupt:
+        pass
+
+    if fPending:
+        save()
+
+
+if __name__ == '__main__':
+    main()
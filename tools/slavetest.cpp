@@ -0,0 +1,340 @@
+// slavetest
+//
+// Host test of the slave mode register map.  slave.cpp is built for the host with the
+// registers as plain variables, and this plays the bus master against its TWI or SPI
+// interrupt handlers, one byte at a time.  Between the bytes of a transaction, time
+// moves on and slaveLoop() runs, so new results are published while the transaction
+// is reading.  The input frequency changes at every update, so that no two updates
+// have the same registers.
+//
+// Every transaction must return the bytes of the bank that was in front when it
+// started, which are read cleanly just before it, however many updates are due while
+// it runs.
+//
+// The clean reads are also decoded at the offsets and in the byte order given in
+// slave.h, independently of SlaveRegisters, and must agree with the square wave.  Its
+// half periods are whole ticks, so the duty is 50% and every period is a whole number
+// of ticks from two of the seven half periods.  The number of periods in an update
+// must fit the time between the reads that saw it and the updates either side of it
+// appear.
+//
+// usage: slavetest [transactions]
+
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "superfreq.h"
+#include "slave.h"
+#include "capture.h"
+#include "timebase.h"
+
+#if SLAVE_BUS == SLAVE_BUS_I2C
+#include <util/twi.h>
+#define BUS_NAME    "i2c"
+#else
+#define BUS_NAME    "spi"
+#endif
+
+// The hardware
+unsigned long hostMillis;
+volatile uint8_t TCNT2, TIFR2;
+volatile uint8_t TWAR, TWCR, TWDR, TWSR;
+volatile uint8_t SPCR, SPDR, PINB = _BV(PB2), DDRB, PCMSK0, PCIFR, PCICR;
+volatile uint8_t PORTD, DDRD;
+volatile uint32_t timebaseOverflows;
+
+void TWI_vect(void);
+void SPI_STC_vect(void);
+void PCINT0_vect(void);
+
+void timebaseBegin(void) {}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Capture engine
+//
+// A square wave whose frequency is set by the second it is in, delivered up to the
+// current time.
+
+static uint64_t edgeTicks;       // never wraps, unlike the timebase
+static uint8_t edgeLevel;
+
+void captureBegin(uint8_t sense) {
+    edgeTicks = 0;
+    edgeLevel = LOW;
+}
+
+bool captureGet(CaptureEdge & edge) {
+    if (edgeTicks > (uint64_t)hostMillis * (TIMEBASE_HZ / 1000)) {
+        return false;
+    }
+    uint32_t hz = 500 + (edgeTicks / TIMEBASE_HZ % 7) * 100;
+    edgeLevel = !edgeLevel;
+    edge.ticks = (uint32_t)edgeTicks;
+    edge.level = edgeLevel;
+    edgeTicks += TIMEBASE_HZ / hz / 2;
+    return true;
+}
+
+uint16_t captureTakeOverruns(void) {
+    return 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Bus master
+
+static unsigned updates;
+
+// Time passes between two bytes, sometimes long enough for one or two updates
+static void between(void) {
+    if (rand() % 4 == 0) {
+        hostMillis += rand() % (2 * SLAVE_UPDATE_MS);
+        slaveLoop();
+        updates++;
+    }
+}
+
+#if SLAVE_BUS == SLAVE_BUS_I2C
+static void twiEvent(uint8_t status) {
+    TWSR = status;
+    TWI_vect();
+}
+
+// Write the pointer, then a repeated start and read count bytes
+static void busRead(uint8_t pointer, uint8_t * data, uint8_t count, bool fBetween) {
+    twiEvent(TW_SR_SLA_ACK);
+    TWDR = pointer;
+    twiEvent(TW_SR_DATA_ACK);
+    twiEvent(TW_ST_SLA_ACK);
+    data[0] = TWDR;
+    for (uint8_t ix = 1; ix < count; ix++) {
+        if (fBetween)  between();
+        twiEvent(TW_ST_DATA_ACK);
+        data[ix] = TWDR;
+    }
+    twiEvent(TW_ST_DATA_NACK);
+}
+
+#else
+static uint8_t spiExchange(uint8_t mosi) {
+    uint8_t miso = SPDR;
+    SPDR = mosi;
+    SPI_STC_vect();
+    return miso;
+}
+
+static void spiSelect(bool fSelect) {
+    if (fSelect) {
+        PINB &= ~_BV(PB2);
+    } else {
+        PINB |= _BV(PB2);
+    }
+    PCINT0_vect();
+}
+
+// The address byte returns STATUS, which is checked along with the rest
+static uint8_t spiStatus;
+
+static void busRead(uint8_t pointer, uint8_t * data, uint8_t count, bool fBetween) {
+    spiSelect(true);
+    spiStatus = spiExchange(pointer);
+    for (uint8_t ix = 0; ix < count; ix++) {
+        if (fBetween)  between();
+        data[ix] = spiExchange(0);
+    }
+    spiSelect(false);
+}
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Register map
+
+// The register offsets published in slave.h
+enum {
+    REG_ID = 0x00,
+    REG_VERSION = 0x01,
+    REG_STATUS = 0x02,
+    REG_SEQUENCE = 0x03,
+    REG_FREQUENCY = 0x04,
+    REG_PERIOD = 0x08,
+    REG_PERIOD_MIN = 0x0c,
+    REG_PERIOD_MAX = 0x10,
+    REG_PERIODS = 0x14,
+    REG_DUTY = 0x18,
+    REG_OVERRUNS = 0x1a,
+    REG_UPDATE_MS = 0x1c,
+    REG_RESERVED = 0x1e
+};
+
+static uint32_t le16(const uint8_t * regs, uint8_t offset) {
+    return regs[offset] | ((uint32_t)regs[offset + 1] << 8);
+}
+
+static uint32_t le32(const uint8_t * regs, uint8_t offset) {
+    return le16(regs, offset) | (le16(regs, offset + 2) << 16);
+}
+
+static const uint32_t NS_PER_TICK = 1000000000UL / TIMEBASE_HZ;
+static const uint32_t SHORTEST_HALF = TIMEBASE_HZ / 1100 / 2;   // ticks
+static const uint32_t LONGEST_HALF = TIMEBASE_HZ / 500 / 2;
+
+static bool inRange(uint32_t value, uint32_t lo, uint32_t hi) {
+    return (value >= lo) && (value <= hi);
+}
+
+// Check the registers of an update against the square wave.  Returns false and says
+// why if they don't match.
+static bool checkValues(const uint8_t * regs) {
+    const char * fault = NULL;
+    uint32_t frequency = le32(regs, REG_FREQUENCY);
+    uint32_t period = le32(regs, REG_PERIOD);
+    uint32_t periodMin = le32(regs, REG_PERIOD_MIN);
+    uint32_t periodMax = le32(regs, REG_PERIOD_MAX);
+    uint32_t periods = le32(regs, REG_PERIODS);
+    uint32_t duty = le16(regs, REG_DUTY);
+
+    if ((regs[REG_ID] != SLAVE_ID) || (regs[REG_VERSION] != SLAVE_VERSION)) {
+        fault = "id or version";
+    } else if ((le16(regs, REG_UPDATE_MS) != SLAVE_UPDATE_MS) || (le16(regs, REG_RESERVED) != 0)) {
+        fault = "update time or reserved";
+    } else if (((regs[REG_STATUS] & ~SLAVE_STATUS_NO_INPUT) != SLAVE_STATUS_VALID) ||
+               (le16(regs, REG_OVERRUNS) != 0)) {
+        fault = "status or overruns";
+    } else if (regs[REG_STATUS] & SLAVE_STATUS_NO_INPUT) {
+        // An update that catches up on a late one can come too soon for a whole period
+        if (frequency || period || periodMin || periodMax || periods || duty)  fault = "no input";
+    } else if (!inRange(periodMin, 2 * SHORTEST_HALF * NS_PER_TICK, periodMax) ||
+               !inRange(periodMax, periodMin, 2 * LONGEST_HALF * NS_PER_TICK) ||
+               (periodMin % NS_PER_TICK) || (periodMax % NS_PER_TICK)) {
+        fault = "shortest or longest period";
+    } else if (!inRange(frequency, (uint32_t)(1.0e12 / periodMax), (uint32_t)(1.0e12 / periodMin + 1))) {
+        fault = "frequency";
+    } else if (!inRange(period, periodMin, periodMax) || (period % NS_PER_TICK) ||
+               (fabs(period - 1.0e12 / frequency) > NS_PER_TICK)) {
+        fault = "mean period";
+    } else if (periods == 0) {
+        fault = "number of periods";
+    } else {
+        // A period that spans a change of frequency has two different halves, which
+        // moves the duty by up to half their difference
+        double ticks = (double)periods * period / NS_PER_TICK;
+        double changes = ceil(ticks / TIMEBASE_HZ) + 1;
+        double slack = 10000.0 * changes * (LONGEST_HALF - SHORTEST_HALF) / 2 / ticks;
+        if (fabs(duty - 5000.0) > slack + 1)  fault = "duty";
+    }
+
+    if (fault) {
+        printf("sequence %u: %s wrong, %lu mHz, %lu ns (%lu-%lu), %lu periods, duty %lu\n",
+               regs[REG_SEQUENCE], fault, (unsigned long)frequency, (unsigned long)period,
+               (unsigned long)periodMin, (unsigned long)periodMax, (unsigned long)periods,
+               (unsigned long)duty);
+    }
+    return fault == NULL;
+}
+
+
+// When each sequence number was first and last read cleanly, the newest last
+struct Seen {
+    uint8_t sequence;
+    unsigned long firstMs;
+    unsigned long lastMs;
+};
+static Seen seen[3];
+static unsigned nSeen;
+
+// Note a clean read of an update.  When three updates in a row have been seen, the
+// newest one was published after the middle one was last seen and before it was first
+// seen itself, and the middle one likewise, which bounds the time its periods came in.
+// Returns false if the number of periods is outside what the wave can give in that
+// time.
+static bool checkPeriods(const uint8_t * regs) {
+    uint8_t sequence = regs[REG_SEQUENCE];
+    if (nSeen && (sequence == seen[2].sequence)) {
+        seen[2].lastMs = hostMillis;
+        return true;
+    }
+    seen[0] = seen[1];
+    seen[1] = seen[2];
+    seen[2].sequence = sequence;
+    seen[2].firstMs = seen[2].lastMs = hostMillis;
+    if ((++nSeen < 3) || (seen[1].sequence != (uint8_t)(sequence - 1)) ||
+        (seen[0].sequence != (uint8_t)(sequence - 2))) {
+        return true;
+    }
+
+    uint32_t shortestMs = seen[1].lastMs - seen[1].firstMs;
+    uint32_t longestMs = seen[2].firstMs - seen[0].lastMs;
+    uint32_t periods = le32(regs, REG_PERIODS);
+    if ((periods + 1 < shortestMs * 500 / 1000) || (periods > longestMs * 1100 / 1000 + 1)) {
+        printf("sequence %u: %lu periods in %lu to %lu ms\n", sequence, (unsigned long)periods,
+               (unsigned long)shortestMs, (unsigned long)longestMs);
+        return false;
+    }
+    return true;
+}
+
+
+int main(int argc, char * argv[]) {
+    long transactions = (argc > 1) ? atol(argv[1]) : 20000;
+    const uint8_t SIZE = sizeof(SlaveRegisters);
+
+    slaveSetup();
+    srand(1);
+
+    long failures = 0;
+    long spanned = 0;
+    long checked = 0;
+    for (long n = 0; n < transactions; n++) {
+        hostMillis += rand() % SLAVE_UPDATE_MS;
+        slaveLoop();
+
+        uint8_t before[SIZE];
+        busRead(0, before, SIZE, false);
+        if (before[REG_STATUS] & SLAVE_STATUS_VALID) {
+            bool fValues = checkValues(before);
+            if (!checkPeriods(before))  fValues = false;
+            if (!fValues && (failures++ < 10)) {
+                printf("transaction %ld: registers do not match the input\n", n);
+            }
+            checked++;
+        }
+
+        uint8_t pointer = rand() % (SIZE + 4);
+        uint8_t count = 1 + rand() % (SIZE + 8);
+        uint8_t data[SIZE + 8];
+        unsigned updatesBefore = updates;
+        busRead(pointer, data, count, true);
+
+        bool fOk = true;
+        for (uint8_t ix = 0; ix < count; ix++) {
+            uint8_t reg = pointer + ix;
+            fOk &= (data[ix] == ((reg < SIZE) ? before[reg] : 0xff));
+        }
+#if SLAVE_BUS == SLAVE_BUS_SPI
+        fOk &= (spiStatus == before[offsetof(SlaveRegisters, status)]);
+#endif
+        if (!fOk && (failures++ < 10)) {
+            printf("transaction %ld: %u bytes from 0x%02x do not match sequence %u\n",
+                   n, count, pointer, before[offsetof(SlaveRegisters, sequence)]);
+        }
+
+        uint8_t after[SIZE];
+        busRead(0, after, SIZE, false);
+        if ((after[REG_STATUS] & SLAVE_STATUS_VALID) && !checkPeriods(after) && (failures++ < 10)) {
+            printf("transaction %ld: periods after it do not match the input\n", n);
+        }
+        if ((updates != updatesBefore) && (after[offsetof(SlaveRegisters, sequence)] !=
+                                           before[offsetof(SlaveRegisters, sequence)])) {
+            spanned++;
+        }
+    }
+
+    printf("slavetest %s: %ld transactions, %ld spanned an update, %ld checked, %ld failed\n",
+           BUS_NAME, transactions, spanned, checked, failures);
+    return (failures || !spanned || !checked) ? 1 : 0;
+}